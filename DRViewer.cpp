@@ -3,8 +3,19 @@
 #include "shader_m.h"
 #include "camera.h"
 #include "widgets.h"
+#include "geometry.h"
+#include "octree.h"
+#include "voxel_map.h"
+#include "tsdf_volume.h"
+#include "surfel_map.h"
+#include "point_index.h"
+#include "thread_pool.h"
+#include "grid_utils.h"
 
 #include <unordered_map>
+#include <algorithm>
+#include <cmath>
+#include <limits>
 #include <mutex>
 #include <string.h>
 #include <GLFW/glfw3.h>
@@ -20,11 +31,6 @@
   #error "unidentified operation system!"
 #endif
 
-#ifdef __SSE4_1__
-#define USE_SSE
-#include <immintrin.h>
-#endif
-
 namespace std{
 //specialize hash for using SubWindowPos as key in unordered_map
 template <>
@@ -40,18 +46,25 @@ struct hash<visual_utils::SubWindowPos>{
 
 namespace visual_utils{
 
+//vertices with a normal are lit by a light at the eye, others keep their color
 constexpr char const* VERTEX_SHADER_DEFAULT=
         "#version 330 core\n"
         "layout (location = 0) in vec3 aPos;\n"
         "layout (location = 1) in vec3 aColor;\n"
+        "layout (location = 2) in vec3 aNormal;\n"
         "out vec3 Color;\n"
         "uniform mat4 model;\n"
         "uniform mat4 view;"
         "uniform mat4 projection;\n"
         "void main()\n"
         "{\n"
-        "gl_Position = projection * view * model * vec4(aPos, 1.0f);\n"
+        "vec4 eye_pos = view * model * vec4(aPos, 1.0f);\n"
+        "gl_Position = projection * eye_pos;\n"
         "Color = aColor;\n"
+        "if(dot(aNormal, aNormal) > 0.0){\n"
+            "vec3 n = normalize(mat3(view * model) * aNormal);\n"
+            "Color *= 0.3 + 0.7 * abs(dot(n, normalize(eye_pos.xyz)));\n"
+        "}\n"
         "}\n";
 
 constexpr char const* FRAGMENT_SHADER_DEFAULT=
@@ -84,6 +97,35 @@ constexpr char const* TEXTURE_FRAGMENT_SHADER =
             "FragColor = texture(texture1, TexCoord);\n"
         "}\n";
 
+//point of a depth frame is generated from the pixel numbered by gl_VertexID
+constexpr char const* DEPTH_VERTEX_SHADER =
+        "#version 330 core\n"
+        "out vec3 Color;\n"
+        "uniform mat4 model;\n"
+        "uniform mat4 view;\n"
+        "uniform mat4 projection;\n"
+        "uniform usampler2D depth_map;\n"
+        "uniform sampler2D color_map;\n"
+        "uniform bool has_color;\n"
+        "uniform vec4 intrinsics;\n"   //fx fy cx cy
+        "uniform vec3 depth_range;\n"  //scale min max
+        "uniform int step;\n"
+        "void main()\n"
+        "{\n"
+            "int width = textureSize(depth_map, 0).x;\n"
+            "int index = gl_VertexID * step;\n"
+            "ivec2 pixel = ivec2(index % width, index / width);\n"
+            "float d = float(texelFetch(depth_map, pixel, 0).r) * depth_range.x;\n"
+            "if(d < depth_range.y || d > depth_range.z){\n"
+                "gl_Position = vec4(2.0, 2.0, 2.0, 1.0);\n"   //clipped
+                "Color = vec3(0.0);\n"
+                "return;\n"
+            "}\n"
+            "vec2 ray = (vec2(pixel) - intrinsics.zw) / intrinsics.xy;\n"
+            "gl_Position = projection * view * model * vec4(ray * d, d, 1.0f);\n"
+            "Color = has_color ? texelFetch(color_map, pixel, 0).rgb : vec3(1.0);\n"
+        "}\n";
+
 constexpr char const* DEFAULT_WINDOW_NAME = "DRViewer";
 
 /*--------------helper functions definitions----------*/
@@ -95,7 +137,24 @@ constexpr float kSceneMoveSpeedFactor = 0.00125f;
 constexpr float kPointSizeExpandSpeed = 1.0f;
 constexpr float kMaxPointSize = 10.0f;
 constexpr float kMinPointSize = 1.0f;
-constexpr int kNormalImageWidth = 640;
+constexpr size_t kBufferGrowthFactor = 2;
+constexpr int kNumStreamRegions = 3;
+constexpr size_t kStreamRegionAlignment = 256;
+constexpr size_t kCullingBlockSize = 8192; //vertices per bounding box of bound point cloud
+constexpr int kMortonBits = 10;           //per axis of the curve grouping unordered vertices
+constexpr int kRadixBits = 15;            //per pass of sorting vertices along the curve
+constexpr size_t kLodEvictFrames = 120; //release octree nodes not drawn for this many frames
+constexpr int kNumFrameTimers = 3;      //frames whose GPU time may be in flight at once
+constexpr size_t kSettleFrames = 3;     //view must stay still this long before drawing all points
+constexpr size_t kMinPointBudget = 100000;
+constexpr size_t kMinTimedPoints = 10000; //frames with fewer points tell little about throughput
+constexpr double kThroughputSmoothing = 0.25;
+constexpr GLsizei kMaxAttribStride = 2048; //least GL_MAX_VERTEX_ATTRIB_STRIDE of all drivers
+constexpr float kPickRadius = 4.0f;       //in pixels around the cursor
+//sub-window images are uploaded at their own resolution and minified by the sampler, those
+//at least this many times larger than their viewport are sampled through mipmaps rebuilt on
+//GPU, as a single level would alias
+constexpr int kMipmapMinification = 2;
 
 GLenum GLFormat(ImageFormat format){
     switch(format) {
@@ -106,6 +165,26 @@ GLenum GLFormat(ImageFormat format){
     }
 }
 
+//glTexStorage2D is core since 4.2, otherwise try to load it from ARB_texture_storage
+bool LoadTextureStorage(){
+    if(GLAD_GL_VERSION_4_2)
+        return glTexStorage2D != nullptr;
+    if(!glfwExtensionSupported("GL_ARB_texture_storage"))
+        return false;
+    glad_glTexStorage2D = (PFNGLTEXSTORAGE2DPROC)glfwGetProcAddress("glTexStorage2D");
+    return glad_glTexStorage2D != nullptr;
+}
+
+//glBufferStorage is core since 4.4, otherwise try to load it from ARB_buffer_storage
+bool LoadBufferStorage(){
+    if(GLAD_GL_VERSION_4_4)
+        return glBufferStorage != nullptr;
+    if(!glfwExtensionSupported("GL_ARB_buffer_storage"))
+        return false;
+    glad_glBufferStorage = (PFNGLBUFFERSTORAGEPROC)glfwGetProcAddress("glBufferStorage");
+    return glad_glBufferStorage != nullptr;
+}
+
 template <typename T>
 struct ImageMemoryDeleter{
     void operator ()(const T* data){
@@ -113,136 +192,33 @@ struct ImageMemoryDeleter{
     }
 };
 
-//resize image by bilinear interpolation
-void MapPixels(byte* __restrict__ dst, const byte* __restrict__ src, int width, int height,
-               int raw_width, int raw_height, int channels, float factor){
-#ifdef USE_SSE
-    static const __m128i offset_x = _mm_set_epi32(3,2,1,0);
-    const __m128 fs = _mm_set1_ps(factor);
-    const __m128i chs = _mm_set1_epi32(channels);
-    const __m128i widths =_mm_set1_epi32(width * channels);
-    const __m128i strides = _mm_set1_epi32(raw_width * channels);
-
-    const size_t stride = width;
-    const size_t aligned_stride = stride / 4 * 4;
-    int32_t* lxly_buf = (int32_t*)_mm_malloc(sizeof(int32_t) * 4, 16);
-    int32_t* uxly_buf = (int32_t*)_mm_malloc(sizeof(int32_t) * 4, 16);
-    int32_t* lxuy_buf = (int32_t*)_mm_malloc(sizeof(int32_t) * 4, 16);
-    int32_t* uxuy_buf = (int32_t*)_mm_malloc(sizeof(int32_t) * 4, 16);
-    int32_t* xys_buf = (int32_t*)_mm_malloc(sizeof(int32_t) * 4, 16);
-    float* res_buf = (float*)_mm_malloc(sizeof(float) * 4, 16);
-#endif
-    for(int y = 0; y < height; y++){
-        int x = 0;
-#ifdef USE_SSE //accelerate computation using SSE
-        __m128i yss = _mm_set1_epi32(y);
-        __m128 ysd = _mm_mul_ps(_mm_cvtepi32_ps(yss), fs);
-        __m128i ws = _mm_mullo_epi32(yss, widths);
-
-        __m128 ly = _mm_round_ps(ysd, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
-        __m128 uy = _mm_add_ps(ly, _mm_set1_ps(1.0f));
-        __m128 ucy = _mm_sub_ps(uy, ysd);
-        __m128 cly = _mm_sub_ps(ysd, ly);
-        __m128i lyi = _mm_cvtps_epi32(ly);
-        __m128i uyi = _mm_cvtps_epi32(uy);
-        __m128i wl = _mm_mullo_epi32(strides, lyi);
-        __m128i wu = _mm_mullo_epi32(strides, uyi);
-        for(; x < aligned_stride; x += 4){
-            __m128i xss = _mm_add_epi32(_mm_set1_epi32(x), offset_x);
-            __m128i xys = _mm_add_epi32(ws, _mm_mullo_epi32(xss, chs));
-            __m128 xsd = _mm_mul_ps(_mm_cvtepi32_ps(xss), fs);
-
-            __m128 lx = _mm_round_ps(xsd, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
-            __m128 ux = _mm_add_ps(lx, _mm_set1_ps(1.0f));
-            __m128 ucx = _mm_sub_ps(ux, xsd);
-            __m128 clx = _mm_sub_ps(xsd, lx);
-            __m128i lxi = _mm_cvtps_epi32(lx);
-            __m128i uxi = _mm_cvtps_epi32(ux);
-
-            __m128i lxlyi = _mm_add_epi32(wl, _mm_mullo_epi32(lxi, chs));
-            __m128i uxlyi = _mm_add_epi32(wl, _mm_mullo_epi32(uxi, chs));
-            __m128i lxuyi = _mm_add_epi32(wu, _mm_mullo_epi32(lxi, chs));
-            __m128i uxuyi = _mm_add_epi32(wu, _mm_mullo_epi32(uxi, chs));
-
-            for(int c=0; c < channels; c++){
-                //gather
-                __m128i c4 = _mm_set1_epi32(c);
-                _mm_store_si128((__m128i*)lxly_buf, _mm_add_epi32(lxlyi, c4));
-                _mm_store_si128((__m128i*)uxly_buf, _mm_add_epi32(uxlyi, c4));
-                _mm_store_si128((__m128i*)lxuy_buf, _mm_add_epi32(lxuyi, c4));
-                _mm_store_si128((__m128i*)uxuy_buf, _mm_add_epi32(uxuyi, c4));
-                __m128 intensities_lxly = _mm_set_ps(src[lxly_buf[3]],src[lxly_buf[2]],src[lxly_buf[1]],src[lxly_buf[0]]);
-                __m128 intensities_uxly = _mm_set_ps(src[uxly_buf[3]],src[uxly_buf[2]],src[uxly_buf[1]],src[uxly_buf[0]]);
-                __m128 intensities_lxuy = _mm_set_ps(src[lxuy_buf[3]],src[lxuy_buf[2]],src[lxuy_buf[1]],src[lxuy_buf[0]]);
-                __m128 intensities_uxuy = _mm_set_ps(src[uxuy_buf[3]],src[uxuy_buf[2]],src[uxuy_buf[1]],src[uxuy_buf[0]]);
-
-                __m128 ll = _mm_mul_ps(intensities_lxly, _mm_mul_ps(ucx, ucy));
-                __m128 ul = _mm_mul_ps(intensities_uxly, _mm_mul_ps(clx, ucy));
-                __m128 lu = _mm_mul_ps(intensities_lxuy, _mm_mul_ps(ucx, cly));
-                __m128 uu = _mm_mul_ps(intensities_uxuy, _mm_mul_ps(clx, cly));
-                __m128 res = _mm_add_ps(_mm_add_ps(ll, ul),_mm_add_ps(lu, uu));
-
-                //scatter
-                _mm_store_si128((__m128i*)xys_buf, _mm_add_epi32(xys, c4));
-                _mm_store_ps(res_buf, res);
-                dst[xys_buf[0]] = (byte)res_buf[0];
-                dst[xys_buf[1]] = (byte)res_buf[1];
-                dst[xys_buf[2]] = (byte)res_buf[2];
-                dst[xys_buf[3]] = (byte)res_buf[3];
-            }
-        }
-#endif
-
-        for(; x < width; x++){
-            float px = factor * x;
-            float py = factor * y;
-            int ix = (int)px;
-            int iy = (int)py;
-            float dx = px - (float)ix;
-            float dy = py - (float)iy;
-            for(int c = 0; c < channels; c++)
-                dst[(y * width + x)*channels + c] = (1 - dx)*(1 - dy)*src[(iy*raw_width + ix) * channels + c] +
-                                                    dx*(1 - dy)*src[(iy*raw_width + ix + 1) * channels + c] +
-                                                    dy*(1 - dx)*src[((iy + 1)*raw_width + ix) * channels + c] +
-                                                    dx*dy*src[((iy+1)*raw_width + ix + 1) * channels + c];
-        }
-    }
-
-#ifdef USE_SSE
-    _mm_free(lxly_buf);
-    _mm_free(uxly_buf);
-    _mm_free(lxuy_buf);
-    _mm_free(uxuy_buf);
-    _mm_free(xys_buf);
-    _mm_free(res_buf);
-#endif
+//write raw image resized to width x height, the size AllocateImageMemory picked for it, into
+//dst; rows are copied or resized in parallel bands
+void ConvertImage(byte* dst, const byte* raw_data, int width, int height,
+                  int raw_width, int raw_height, int channels){
+    if(width != raw_width || height != raw_height){
+        ResizeImage(raw_data, raw_width, raw_height, channels, dst, width, height);
+        return;
+    }
+    size_t row_bytes = (size_t)width * channels;
+    ThreadPool::Global().ParallelFor(0, height, kRowGrain, [&](size_t begin, size_t end){
+        memcpy(dst + begin * row_bytes, raw_data + begin * row_bytes, (end - begin) * row_bytes);
+    });
 }
 
+//images are kept at their own size unless a side exceeds max_size(if nonzero), the largest
+//texture of the backend, then they're shrunk on CPU to fit
 byte* AllocateImageMemory(const byte* raw_data, int& width, int& height,
-                          ImageFormat format, bool norm_scale){
-    byte* data = nullptr;
+                          ImageFormat format, int max_size){
     int channels = format > 1? 4 : 3;
-    size_t num_bytes = 0;
-    if(norm_scale && width != kNormalImageWidth){
-        int raw_width = width;
-        int raw_height = height;
-        if(width > kNormalImageWidth){
-            width = kNormalImageWidth;
-        }else{
-            //scale width to highest power of 2 less than the original
-            width = std::pow(2.0f, (int)std::log2(width));
-        }
-
-        float factor = (float)raw_width / width;
-        height = 1.0f / factor * height;
-        num_bytes = width * height * channels;
-        data = new byte[num_bytes];
-        MapPixels(data, raw_data, width, height, raw_width, raw_height, channels, factor);
-    }else{
-        num_bytes = width * height * channels;
-        data = new byte[num_bytes];
-        memcpy(data, raw_data, num_bytes);
+    int raw_width = width;
+    int raw_height = height;
+    if(max_size > 0 && std::max(width, height) > max_size){
+        width = std::max(1, (int)((int64_t)raw_width * max_size / std::max(raw_width, raw_height)));
+        height = std::max(1, (int)((float)width / raw_width * raw_height));
     }
+    byte* data = new byte[(size_t)width * height * channels];
+    ConvertImage(data, raw_data, width, height, raw_width, raw_height, channels);
     return data;
 }
 
@@ -252,26 +228,28 @@ public:
     int width, height;
     ImageFormat format;
     byte* data;
+    size_t version = 0; //stamped whenever pixels change, see ImplDRViewerBase::NextVersion
 
     Image(int _w=0, int _h=0, ImageFormat _f=RGB) :
         width(_w), height(_h), format(_f), data(nullptr) {}
-    //norm sacle means whether or not scale image to a normal size for rendering;
-    //set it true when image displayed abnormally or the image is too large
-    Image(const byte* _data, int _width, int _height, ImageFormat _format,
-          bool norm_scale = false){
+    //max_size limits the sides of the copy, see AllocateImageMemory
+    Image(const byte* _data, int _width, int _height, ImageFormat _format, int max_size = 0){
         if(_data == nullptr)
             return;
         width = _width;
         height = _height;
         format = _format;
-        Allocate(_data, norm_scale);
+        Allocate(_data, max_size);
     }
 
-    void Allocate(const byte* _data, bool norm_scale){
-        data = AllocateImageMemory(_data, width, height, format, norm_scale);
+    void Allocate(const byte* _data, int max_size){
+        data = AllocateImageMemory(_data, width, height, format, max_size);
         smem.reset(data, ImageMemoryDeleter<byte>());
     }
 
+    //whether no other copy shares the pixels, which may then be overwritten
+    bool Unique() const { return smem.use_count() == 1; }
+
     Image(const Image&) = default;
     Image(Image&&) noexcept = default;
     Image& operator=(const Image& rhs){
@@ -280,6 +258,7 @@ public:
              height = rhs.height;
              format = rhs.format;
              data = rhs.data;
+             version = rhs.version;
              smem = rhs.smem;
         }
         return *this;
@@ -291,6 +270,7 @@ public:
              height = rhs.height;
              format = rhs.format;
              data = rhs.data;
+             version = rhs.version;
              smem = std::move(rhs.smem);
 
              rhs.width = 0;
@@ -305,21 +285,199 @@ private:
 };
 
 
+int PointFormatStride(PointFormat format){
+    switch(format) {
+        case POINT_F32_RGB_F32: return 6 * sizeof(float);
+        case POINT_F32_RGBA8:   return 3 * sizeof(float) + 4;
+        case POINT_U16_RGBA8:   return 4 * sizeof(uint16_t) + 4;
+    }
+    return 0;
+}
+
+inline byte QuantizeColor(float c){
+    return (byte)(std::min(std::max(c, 0.0f), 1.0f) * 255.0f + 0.5f);
+}
+
+//points of a chunk repacked into the given format, drawn with the chunk's pose as model matrix;
+//16-bit positions are normalized to the chunk's bounding box, which the dequantization matrix
+//maps back, so they are decoded by the model transform in the vertex shader
+struct PointChunk{
+    //shared by copies of the chunk(e.g. snapshots for export), never modified once published
+    std::shared_ptr<std::vector<byte>> vertices;
+    size_t num_vertices = 0;
+    AABB box;   //in chunk frame
+    PointFormat format = POINT_F32_RGB_F32;
+    glm::mat4 dequantization = glm::mat4(1.0f);
+    glm::mat4 pose = glm::mat4(1.0f);
+    size_t version = 0;
+
+    PointChunk() = default;
+    PointChunk(const void* data, size_t num, int stride, int pos_off, int col_off, PointFormat _format){
+        const byte* src = static_cast<const byte*>(data);
+        AABB bounds;
+        for(size_t i = 0; i < num; i++){
+            glm::vec3 p;
+            memcpy(&p[0], src + i * stride + pos_off, 3 * sizeof(float));
+            bounds.Extend(p);
+        }
+        Allocate(num, bounds, _format);
+        Pack(0, data, num, stride, pos_off, col_off);
+    }
+
+    //reserve room for num points inside box, which must be known before any point is packed
+    void Allocate(size_t num, const AABB& bounds, PointFormat _format){
+        vertices = std::make_shared<std::vector<byte>>(num * PointFormatStride(_format));
+        num_vertices = num;
+        box = bounds;
+        format = _format;
+        dequantization = glm::mat4(1.0f);
+        if(format == POINT_U16_RGBA8)
+            dequantization = glm::scale(glm::translate(glm::mat4(1.0f), box.lower),
+                                        glm::max(box.Extent(), glm::vec3(1e-6f)));
+    }
+
+    //repack num input points as points [first, first + num), disjoint ranges may be packed
+    //concurrently
+    void Pack(size_t first, const void* data, size_t num, int stride, int pos_off, int col_off){
+        const byte* src = static_cast<const byte*>(data);
+        const int dst_stride = PointFormatStride(format);
+        byte* dst = vertices->data() + first * dst_stride;
+        switch(format) {
+        case POINT_F32_RGB_F32:
+            for(size_t i = 0; i < num; i++, src += stride, dst += dst_stride){
+                memcpy(dst, src + pos_off, 3 * sizeof(float));
+                memcpy(dst + 3 * sizeof(float), src + col_off, 3 * sizeof(float));
+            }
+            break;
+        case POINT_F32_RGBA8:
+            for(size_t i = 0; i < num; i++, src += stride, dst += dst_stride){
+                const float* col = reinterpret_cast<const float*>(src + col_off);
+                memcpy(dst, src + pos_off, 3 * sizeof(float));
+                byte* rgba = dst + 3 * sizeof(float);
+                rgba[0] = QuantizeColor(col[0]);
+                rgba[1] = QuantizeColor(col[1]);
+                rgba[2] = QuantizeColor(col[2]);
+                rgba[3] = 255;
+            }
+            break;
+        case POINT_U16_RGBA8:{
+            const glm::vec3 lower = box.lower;
+            glm::vec3 extent = glm::max(box.Extent(), glm::vec3(1e-6f));
+            glm::vec3 inv_extent = glm::vec3(65535.0f) / extent;
+            for(size_t i = 0; i < num; i++, src += stride, dst += dst_stride){
+                const float* pos = reinterpret_cast<const float*>(src + pos_off);
+                const float* col = reinterpret_cast<const float*>(src + col_off);
+                uint16_t* qpos = reinterpret_cast<uint16_t*>(dst);
+                for(int k = 0; k < 3; k++)
+                    qpos[k] = (uint16_t)((pos[k] - lower[k]) * inv_extent[k] + 0.5f);
+                qpos[3] = 0;
+                byte* rgba = dst + 4 * sizeof(uint16_t);
+                rgba[0] = QuantizeColor(col[0]);
+                rgba[1] = QuantizeColor(col[1]);
+                rgba[2] = QuantizeColor(col[2]);
+                rgba[3] = 255;
+            }
+            break;
+        }
+        }
+    }
+
+    //write points [first, last) in world frame as |x y z r g b|
+    void Unpack(size_t first, size_t last, float* out) const{
+        const int stride = PointFormatStride(format);
+        const glm::mat4 transform = pose * dequantization;
+        const byte* src = vertices->data() + first * stride;
+        for(size_t i = first; i < last; i++, src += stride, out += 6){
+            glm::vec4 p(0.0f, 0.0f, 0.0f, 1.0f);
+            if(format == POINT_U16_RGBA8){
+                const uint16_t* qpos = reinterpret_cast<const uint16_t*>(src);
+                for(int k = 0; k < 3; k++)
+                    p[k] = qpos[k] / 65535.0f;
+            }else
+                memcpy(&p[0], src, 3 * sizeof(float));
+            p = transform * p;
+            out[0] = p.x;
+            out[1] = p.y;
+            out[2] = p.z;
+            if(format == POINT_F32_RGB_F32)
+                memcpy(out + 3, src + 3 * sizeof(float), 3 * sizeof(float));
+            else{
+                const byte* rgba = src + (format == POINT_U16_RGBA8 ? 4 * sizeof(uint16_t) : 3 * sizeof(float));
+                for(int k = 0; k < 3; k++)
+                    out[3 + k] = rgba[k] / 255.0f;
+            }
+        }
+    }
+};
+
+//camera of a multi-camera rig, extrinsics is from camera frame to body frame
+struct RigCamera{
+    CameraIntrinsics intrinsics;
+    glm::mat4 extrinsics;
+    DepthRange range;
+};
+
+//depth map with its color image, back-projected by the backend when drawn; depth and color
+//are only read to upload them and released once the backend keeps them as textures
+struct DepthFrame{
+    std::vector<uint16_t> depth;
+    std::vector<byte> color;
+    bool has_color = false;     //points are white otherwise
+    ImageFormat color_format = RGB;
+    CameraIntrinsics intrinsics = CameraIntrinsics();
+    DepthRange range;
+    AABB box;   //in camera frame, spanned by rays through image corners over valid depth
+    size_t num_valid = 0;
+    glm::mat4 pose = glm::mat4(1.0f);
+    size_t version = 0;
+
+    DepthFrame() = default;
+    DepthFrame(const uint16_t* _depth, const byte* _color, ImageFormat format,
+               const CameraIntrinsics& _intrinsics, const DepthRange& _range) :
+        depth(_depth, _depth + (size_t)_intrinsics.width * _intrinsics.height),
+        color_format(format), intrinsics(_intrinsics), range(_range){
+        size_t channels = format == RGBA || format == BGRA ? 4 : 3;
+        has_color = _color != nullptr;
+        if(has_color)
+            color.assign(_color, _color + depth.size() * channels);
+        float scale = 1.0f / range.factor;
+        float lower = std::numeric_limits<float>::max(), upper = 0.0f;
+        for(uint16_t raw : depth){
+            float d = raw * scale;
+            if(d < range.min_depth || d > range.max_depth)
+                continue;
+            lower = std::min(lower, d);
+            upper = std::max(upper, d);
+            ++num_valid;
+        }
+        if(num_valid == 0)
+            return;
+        for(float d : {lower, upper}){
+            for(int x : {0, intrinsics.width - 1}){
+                for(int y : {0, intrinsics.height - 1})
+                    box.Extend(glm::vec3(d * (x - intrinsics.cx) / intrinsics.fx,
+                                         d * (y - intrinsics.cy) / intrinsics.fy, d));
+            }
+        }
+    }
+};
+
 struct SubWindow{
     //(x,y) represents the downleft corner of the sub-window
     int x, y;
     int w, h;
     float aspect_ratio;
+    int raw_width, raw_height;  //of bound images, which may be shown scaled
     Image image;
+    Image spare;  //image replaced last, its buffer takes the next image of the same size
 
     SubWindow(SubWindowPos pos, const byte* _data, int parent_width, int parent_height,
-              int _img_w, int _img_h, ImageFormat f): image(_img_w, _img_h, f){
+              int _img_w, int _img_h, ImageFormat f):
+        raw_width(_img_w), raw_height(_img_h), image(_img_w, _img_h, f){
         aspect_ratio = (float)_img_w / _img_h;
         size_t area = _img_h * _img_w;
-        if(_data != nullptr && area > 0){
-            bool norm_scale = image.width % 2 != 0 || image.width > kNormalImageWidth;
-            image.Allocate(_data, norm_scale);
-        }
+        if(_data != nullptr && area > 0)
+            image.Allocate(_data, 0);
         Resize(pos, parent_width, parent_height);
     }
 
@@ -331,7 +489,10 @@ struct SubWindow{
             x= rhs.x;
             y= rhs.y;
             aspect_ratio = rhs.aspect_ratio;
+            raw_width = rhs.raw_width;
+            raw_height = rhs.raw_height;
             image = rhs.image;
+            spare = rhs.spare;
         }
         return *this;
     }
@@ -341,7 +502,10 @@ struct SubWindow{
             x= rhs.x;
             y= rhs.y;
             aspect_ratio = rhs.aspect_ratio;
+            raw_width = rhs.raw_width;
+            raw_height = rhs.raw_height;
             image = std::move(rhs.image);
+            spare = std::move(rhs.spare);
 
             rhs.x = 0;
             rhs.y = 0;
@@ -367,6 +531,142 @@ struct SubWindow{
     }
 };
 
+//where the bound point cloud comes from
+enum CloudSource{
+    USER_ARRAY,     //bound as is
+    MERGED_CLOUD,   //merged into the viewer's voxel map
+    FUSED_SURFELS   //fused from depth frames
+};
+
+//bound point cloud with the structures over it, one is bound while writers refresh the
+//other
+struct CloudBuffer{
+    const void* array = nullptr;
+    size_t size = 0;
+    int stride = 0;
+    int pos_off = 0;
+    int col_off = 0;
+    int nor_off = -1;
+    DataUsage usage = STATIC_DATA;
+    size_t generation = 0;          //of the array, appended arrays keep it
+    std::vector<float> vertices;    //the viewer's own vertices |x y z r g b| if array is them
+    PointOctree octree;             //level of detail
+    size_t lod_ingested = 0;        //number of vertices inserted into octree
+    //bounding box of every kCullingBlockSize consecutive vertices, point clouds are mostly
+    //appended frame by frame so consecutive vertices are spatially coherent; those of other
+    //arrays are of every kCullingBlockSize consecutive vertices in order
+    std::vector<AABB> blocks;
+    size_t blocked = 0;             //number of vertices covered by blocks
+    std::vector<uint32_t> order;    //vertices grouped by space, empty if blocks are ranges
+};
+
+//insert two zero bits above each of the lower kMortonBits bits of x
+inline uint32_t SpreadBits(uint32_t x){
+    x &= (1u << kMortonBits) - 1;
+    x = (x | (x << 16)) & 0x30000ff;
+    x = (x | (x << 8)) & 0x300f00f;
+    x = (x | (x << 4)) & 0x30c30c3;
+    x = (x | (x << 2)) & 0x9249249;
+    return x;
+}
+
+//order num_vertices vertices along a Z-order curve over their bounding box, so every
+//kCullingBlockSize consecutive ones in order are close to each other, then shuffle each such
+//group so a prefix of it is an even sample of the group
+void GroupBySpace(const byte* pos, size_t num_vertices, int stride, std::vector<uint32_t>& order){
+    //vertices are split into one part per thread, each counted into its own histogram
+    const size_t num_parts = std::max<size_t>(1, std::min(ThreadPool::Global().NumThreads() + 1,
+                                                          num_vertices / kCullingBlockSize));
+    auto part_begin = [&](size_t part){ return part * num_vertices / num_parts; };
+
+    //a non-finite coordinate would stretch the box over every cell
+    std::vector<AABB> boxes(num_parts);
+    ThreadPool::Global().ParallelFor(0, num_parts, 1, [&](size_t begin, size_t end){
+        for(size_t part = begin; part < end; part++){
+            for(size_t i = part_begin(part); i < part_begin(part + 1); i++){
+                glm::vec3 p;
+                memcpy(&p[0], pos + i * stride, 3 * sizeof(float));
+                if(std::isfinite(p.x) && std::isfinite(p.y) && std::isfinite(p.z))
+                    boxes[part].Extend(p);
+            }
+        }
+    });
+    AABB box;
+    for(const AABB& part_box : boxes)
+        box.Extend(part_box);
+    const float cells = float(1 << kMortonBits);
+    const glm::vec3 scale = glm::vec3(cells) / glm::max(box.Extent(), glm::vec3(1e-6f));
+
+    //code in the upper half, vertex in the lower half
+    std::vector<uint64_t> keys(num_vertices), sorted(num_vertices);
+    ThreadPool::Global().ParallelFor(0, num_vertices, kCullingBlockSize, [&](size_t begin, size_t end){
+        for(size_t i = begin; i < end; i++){
+            glm::vec3 p;
+            memcpy(&p[0], pos + i * stride, 3 * sizeof(float));
+            uint32_t code = 0;
+            for(int k = 0; k < 3; k++){
+                float q = (p[k] - box.lower[k]) * scale[k];
+                //non-finite coordinates land in cell 0
+                uint32_t c = q >= 0.0f ? (uint32_t)std::min(q, cells - 1.0f) : 0;
+                code |= SpreadBits(c) << k;
+            }
+            keys[i] = (uint64_t)code << 32 | i;
+        }
+    });
+    //histograms of parts are laid out one after another, a part's slots of a digit start
+    //after those of earlier digits and of earlier parts, so each pass stays stable
+    const size_t num_digits = size_t(1) << kRadixBits;
+    std::vector<size_t> counts(num_parts * num_digits);
+    for(int shift = 32; shift < 32 + 3 * kMortonBits; shift += kRadixBits){
+        const uint64_t mask = num_digits - 1;
+        ThreadPool::Global().ParallelFor(0, num_parts, 1, [&](size_t begin, size_t end){
+            for(size_t part = begin; part < end; part++){
+                size_t* part_counts = &counts[part * num_digits];
+                std::fill(part_counts, part_counts + num_digits, 0);
+                for(size_t i = part_begin(part); i < part_begin(part + 1); i++)
+                    ++part_counts[(keys[i] >> shift) & mask];
+            }
+        });
+        size_t sum = 0;
+        for(size_t digit = 0; digit < num_digits; digit++){
+            for(size_t part = 0; part < num_parts; part++){
+                size_t& count = counts[part * num_digits + digit];
+                size_t c = count;
+                count = sum;
+                sum += c;
+            }
+        }
+        ThreadPool::Global().ParallelFor(0, num_parts, 1, [&](size_t begin, size_t end){
+            for(size_t part = begin; part < end; part++){
+                size_t* part_counts = &counts[part * num_digits];
+                for(size_t i = part_begin(part); i < part_begin(part + 1); i++)
+                    sorted[part_counts[(keys[i] >> shift) & mask]++] = keys[i];
+            }
+        });
+        keys.swap(sorted);
+    }
+
+    order.resize(num_vertices);
+    size_t num_groups = (num_vertices + kCullingBlockSize - 1) / kCullingBlockSize;
+    ThreadPool::Global().ParallelFor(0, num_groups, 1, [&](size_t begin, size_t end){
+        for(size_t g = begin; g < end; g++){
+            size_t first = g * kCullingBlockSize;
+            size_t count = std::min(kCullingBlockSize, num_vertices - first);
+            uint32_t* group = order.data() + first;
+            for(size_t i = 0; i < count; i++)
+                group[i] = (uint32_t)keys[first + i];
+            //seeded by the group, so rebuilding the order of the same array gives the same one
+            uint32_t state = (uint32_t)g * 2654435761u | 1u;
+            for(size_t i = count; i > 1; i--){
+                state ^= state << 13;
+                state ^= state >> 17;
+                state ^= state << 5;
+                std::swap(group[i - 1], group[state % i]);
+            }
+        }
+    });
+}
+
 }
 
 /*--------------DRViewer class definitions---------------------*/
@@ -380,8 +680,39 @@ public:
         sub_windows_(rhs.sub_windows_){
         array_pcl_ = rhs.array_pcl_;
         size_pcl_ = rhs.size_pcl_;
+        stride_pcl_ = rhs.stride_pcl_;
         pos_off_pcl_ = rhs.pos_off_pcl_;
         col_off_pcl_ = rhs.col_off_pcl_;
+        nor_off_pcl_ = rhs.nor_off_pcl_;
+        usage_pcl_ = rhs.usage_pcl_;
+        version_pcl_ = rhs.version_pcl_;
+        version_traj_ = rhs.version_traj_;
+        version_counter_ = rhs.version_counter_;
+        chunks_ = rhs.chunks_;
+        rig_cameras_ = rhs.rig_cameras_;
+        depth_frames_ = rhs.depth_frames_;
+        tsdf_ = rhs.tsdf_;
+        meshes_ = rhs.meshes_;
+        surfels_ = rhs.surfels_;
+        surfel_fusion_ = rhs.surfel_fusion_;
+        source_pcl_ = rhs.source_pcl_;
+        lod_budget_ = rhs.lod_budget_;
+        group_pcl_ = rhs.group_pcl_;
+        cull_pcl_ = rhs.cull_pcl_;
+        index_enabled_ = rhs.index_enabled_;
+        stream_images_ = rhs.stream_images_;
+        generation_index_ = rhs.generation_index_;
+        index_ = rhs.index_;
+        voxel_map_ = rhs.voxel_map_;
+        merged_input_ = rhs.merged_input_;
+        front_pcl_ = rhs.front_pcl_;
+        back_pcl_ = rhs.back_pcl_;
+        generation_pcl_ = rhs.generation_pcl_;
+        stale_pcl_ = rhs.stale_pcl_;
+        dirty_pcl_ = rhs.dirty_pcl_;
+        target_frame_time_ = rhs.target_frame_time_;
+        max_point_budget_ = rhs.max_point_budget_;
+        PointAtOwnVertices(rhs);
     }
 
     ImplDRViewerBase(ImplDRViewerBase&& rhs) noexcept: traj_(std::move(rhs.traj_)),
@@ -389,8 +720,38 @@ public:
         width_(rhs.width_),height_(rhs.height_){
         array_pcl_ = rhs.array_pcl_;
         size_pcl_ = rhs.size_pcl_;
+        stride_pcl_ = rhs.stride_pcl_;
         pos_off_pcl_ = rhs.pos_off_pcl_;
         col_off_pcl_ = rhs.col_off_pcl_;
+        nor_off_pcl_ = rhs.nor_off_pcl_;
+        usage_pcl_ = rhs.usage_pcl_;
+        version_pcl_ = rhs.version_pcl_;
+        version_traj_ = rhs.version_traj_;
+        version_counter_ = rhs.version_counter_;
+        chunks_ = std::move(rhs.chunks_);
+        rig_cameras_ = std::move(rhs.rig_cameras_);
+        depth_frames_ = std::move(rhs.depth_frames_);
+        tsdf_ = std::move(rhs.tsdf_);
+        meshes_ = std::move(rhs.meshes_);
+        surfels_ = std::move(rhs.surfels_);
+        surfel_fusion_ = rhs.surfel_fusion_;
+        source_pcl_ = rhs.source_pcl_;
+        lod_budget_ = rhs.lod_budget_;
+        group_pcl_ = rhs.group_pcl_;
+        cull_pcl_ = rhs.cull_pcl_;
+        index_enabled_ = rhs.index_enabled_;
+        stream_images_ = rhs.stream_images_;
+        generation_index_ = rhs.generation_index_;
+        index_ = std::move(rhs.index_);
+        voxel_map_ = std::move(rhs.voxel_map_);
+        merged_input_ = rhs.merged_input_;
+        front_pcl_ = std::move(rhs.front_pcl_);
+        back_pcl_ = std::move(rhs.back_pcl_);
+        generation_pcl_ = rhs.generation_pcl_;
+        stale_pcl_ = std::move(rhs.stale_pcl_);
+        dirty_pcl_ = std::move(rhs.dirty_pcl_);
+        target_frame_time_ = rhs.target_frame_time_;
+        max_point_budget_ = rhs.max_point_budget_;
     }
 
     ImplDRViewerBase& operator=(const ImplDRViewerBase& rhs) {
@@ -403,12 +764,43 @@ public:
             api_ = rhs.api_;
             array_pcl_ = rhs.array_pcl_;
             size_pcl_ = rhs.size_pcl_;
+            stride_pcl_ = rhs.stride_pcl_;
             pos_off_pcl_ = rhs.pos_off_pcl_;
             col_off_pcl_ = rhs.col_off_pcl_;
+            nor_off_pcl_ = rhs.nor_off_pcl_;
+            usage_pcl_ = rhs.usage_pcl_;
+            version_pcl_ = rhs.version_pcl_;
+            version_traj_ = rhs.version_traj_;
+            version_counter_ = rhs.version_counter_;
+            chunks_ = rhs.chunks_;
+            rig_cameras_ = rhs.rig_cameras_;
+            depth_frames_ = rhs.depth_frames_;
+            tsdf_ = rhs.tsdf_;
+            meshes_ = rhs.meshes_;
+            surfels_ = rhs.surfels_;
+            surfel_fusion_ = rhs.surfel_fusion_;
+            source_pcl_ = rhs.source_pcl_;
+            lod_budget_ = rhs.lod_budget_;
+            group_pcl_ = rhs.group_pcl_;
+            cull_pcl_ = rhs.cull_pcl_;
+            index_enabled_ = rhs.index_enabled_;
+            stream_images_ = rhs.stream_images_;
+            generation_index_ = rhs.generation_index_;
+            index_ = rhs.index_;
+            voxel_map_ = rhs.voxel_map_;
+            merged_input_ = rhs.merged_input_;
+            front_pcl_ = rhs.front_pcl_;
+            back_pcl_ = rhs.back_pcl_;
+            generation_pcl_ = rhs.generation_pcl_;
+            stale_pcl_ = rhs.stale_pcl_;
+            dirty_pcl_ = rhs.dirty_pcl_;
+            target_frame_time_ = rhs.target_frame_time_;
+            max_point_budget_ = rhs.max_point_budget_;
             model_ = rhs.model_;
             view_ = rhs.view_;
             projection_ = rhs.projection_;
             frustum_pose_ = rhs.frustum_pose_;
+            PointAtOwnVertices(rhs);
         }
         return *this;
     }
@@ -423,8 +815,38 @@ public:
             api_ = rhs.api_;
             array_pcl_ = rhs.array_pcl_;
             size_pcl_ = rhs.size_pcl_;
+            stride_pcl_ = rhs.stride_pcl_;
             pos_off_pcl_ = rhs.pos_off_pcl_;
             col_off_pcl_ = rhs.col_off_pcl_;
+            nor_off_pcl_ = rhs.nor_off_pcl_;
+            usage_pcl_ = rhs.usage_pcl_;
+            version_pcl_ = rhs.version_pcl_;
+            version_traj_ = rhs.version_traj_;
+            version_counter_ = rhs.version_counter_;
+            chunks_ = std::move(rhs.chunks_);
+            rig_cameras_ = std::move(rhs.rig_cameras_);
+            depth_frames_ = std::move(rhs.depth_frames_);
+            tsdf_ = std::move(rhs.tsdf_);
+            meshes_ = std::move(rhs.meshes_);
+            surfels_ = std::move(rhs.surfels_);
+            surfel_fusion_ = rhs.surfel_fusion_;
+            source_pcl_ = rhs.source_pcl_;
+            lod_budget_ = rhs.lod_budget_;
+            group_pcl_ = rhs.group_pcl_;
+            cull_pcl_ = rhs.cull_pcl_;
+            index_enabled_ = rhs.index_enabled_;
+            stream_images_ = rhs.stream_images_;
+            generation_index_ = rhs.generation_index_;
+            index_ = std::move(rhs.index_);
+            voxel_map_ = std::move(rhs.voxel_map_);
+            merged_input_ = rhs.merged_input_;
+            front_pcl_ = std::move(rhs.front_pcl_);
+            back_pcl_ = std::move(rhs.back_pcl_);
+            generation_pcl_ = rhs.generation_pcl_;
+            stale_pcl_ = std::move(rhs.stale_pcl_);
+            dirty_pcl_ = std::move(rhs.dirty_pcl_);
+            target_frame_time_ = rhs.target_frame_time_;
+            max_point_budget_ = rhs.max_point_budget_;
             model_ = rhs.model_;
             view_ = rhs.view_;
             projection_ = rhs.projection_;
@@ -444,31 +866,166 @@ public:
     GraphicAPI APIType() const {return api_;}
 
     void BindPointCloudData(const void* data, size_t num_vertices,
-                            int stride, int pos_off, int col_off){
+                            int stride, int pos_off, int col_off, DataUsage usage, int nor_off){
+        std::lock_guard<std::mutex> cloud_lck(cloud_mtx_);
+        const std::vector<std::pair<size_t, size_t>> none;
+        if(usage == MERGE_DATA || voxel_map_.VoxelSize() > 0.0f){
+            //merged, filtered and copied into the back buffer outside the lock, rendering
+            //only waits for the swap
+            SwitchCloudSource(MERGED_CLOUD);
+            std::vector<std::pair<size_t, size_t>> updated;
+            DataUsage merged_usage = MergePointCloud(data, num_vertices, stride, pos_off, col_off,
+                                                     usage, updated);
+            PrepareOwnedVertices(voxel_map_.Vertices(), voxel_map_.NumVertices(), merged_usage,
+                                 updated);
+            PrepareCloudStructures(lod_budget_ > 0, updated);
+            {
+                std::lock_guard<std::mutex> lck(mtx_);
+                PublishCloudBuffer(updated);
+            }
+            IngestSpatialIndex();
+            return;
+        }
+
+        //streamed vertices are copied into backend memory outside the lock, so that
+        //rendering is not blocked by the copy
+        void* stream_mem = nullptr;
+        if(usage == STREAM_DATA && data != nullptr){
+            std::lock_guard<std::mutex> lck(mtx_);
+            stream_mem = AcquireStreamMemory(num_vertices * stride);
+        }
+        if(stream_mem != nullptr)
+            memcpy(stream_mem, data, num_vertices * stride);
+
+        SwitchCloudSource(USER_ARRAY);
+        CloudBuffer& back = back_pcl_;
+        back.array = data;
+        back.size = num_vertices;
+        back.stride = stride;
+        back.pos_off = pos_off;
+        back.col_off = col_off;
+        back.nor_off = nor_off;
+        back.usage = usage;
+        back.generation = generation_pcl_;
+        PrepareCloudStructures(lod_budget_ > 0, none);
+        {
+            std::lock_guard<std::mutex> lck(mtx_);
+            PublishCloudBuffer(none);
+            if(stream_mem != nullptr)
+                CommitStreamMemory();
+        }
+        IngestSpatialIndex();
+        //owned vertices bound before are no longer used
+        std::vector<float>().swap(back_pcl_.vertices);
+    }
+
+    void EnableLevelOfDetail(size_t point_budget){
+        std::lock_guard<std::mutex> cloud_lck(cloud_mtx_);
+        RebuildCloudStructures(point_budget);
+    }
+
+    void EnableImageStreaming(bool enable){
         std::lock_guard<std::mutex> lck(mtx_);
-        array_pcl_ = data;
-        size_pcl_ = num_vertices;
-        stride_pcl_ = stride;
-        pos_off_pcl_ = pos_off;
-        col_off_pcl_ = col_off;
+        stream_images_ = enable;
     }
 
-    void BindImageData(const byte* data, int w, int h, ImageFormat f, SubWindowPos sub_win){
+    void EnableSpatialGrouping(bool enable){
+        std::lock_guard<std::mutex> cloud_lck(cloud_mtx_);
+        group_pcl_ = enable;
+        RebuildCloudStructures(lod_budget_);
+    }
+
+    void EnableCloudCulling(bool enable){
+        std::lock_guard<std::mutex> cloud_lck(cloud_mtx_);
+        cull_pcl_ = enable;
+        RebuildCloudStructures(lod_budget_);
+    }
+
+    //the bound point cloud stays, only the structures over it are rebuilt; called under
+    //cloud_mtx_
+    void RebuildCloudStructures(size_t point_budget){
+        const std::vector<std::pair<size_t, size_t>> none;
+        if(source_pcl_ == MERGED_CLOUD)
+            PrepareOwnedVertices(voxel_map_.Vertices(), voxel_map_.NumVertices(), front_pcl_.usage,
+                                 none);
+        else if(source_pcl_ == FUSED_SURFELS)
+            PrepareOwnedVertices(surfels_.Vertices(), surfels_.NumVertices(), APPEND_DATA, none);
+        else{
+            std::vector<float>().swap(back_pcl_.vertices);
+            CopyCloudDescription(front_pcl_, back_pcl_);
+        }
+        PrepareCloudStructures(point_budget > 0, none);
         std::lock_guard<std::mutex> lck(mtx_);
+        lod_budget_ = point_budget;
+        //vertices are not uploaded under level of detail, and the drawing order of a static
+        //array changes with it and with grouping, so upload everything again
+        PublishCloudBuffer(none, true);
+    }
+
+    void BindImageData(const byte* data, int w, int h, ImageFormat f, SubWindowPos sub_win){
         if(data == nullptr || w == 0 || h == 0)
             return;
+        int channels = f > 1 ? 4 : 3;
+        //images are converted without lock, straight into backend memory when it streams
+        //them and else into a buffer swapped in under lock, so that neither producer nor
+        //rendering waits for the other
+        void* image_mem = nullptr;
+        Image image;
+        int image_w = 0, image_h = 0;
+        int max_size = 0;
+        {
+            std::lock_guard<std::mutex> lck(mtx_);
+            max_size = MaxImageSize();
+            auto iter = sub_windows_.find(sub_win);
+            if(iter != sub_windows_.end() && iter->second.raw_width == w &&
+               iter->second.raw_height == h && iter->second.image.format == f){
+                SubWindow& win = iter->second;
+                image_w = win.image.width;
+                image_h = win.image.height;
+                if(stream_images_)
+                    image_mem = AcquireImageMemory(sub_win, (size_t)image_w * image_h * channels);
+                if(image_mem == nullptr && win.spare.data != nullptr && win.spare.Unique() &&
+                   win.spare.width == image_w && win.spare.height == image_h && win.spare.format == f)
+                    image = std::move(win.spare);
+            }
+        }
+        if(image_mem != nullptr)
+            ConvertImage(static_cast<byte*>(image_mem), data, image_w, image_h, w, h, channels);
+        else if(image.data != nullptr)
+            ConvertImage(image.data, data, image_w, image_h, w, h, channels);
+        else
+            image = Image(data, w, h, f, max_size);
+
+        Image retired;  //freed after the lock is released
+        std::lock_guard<std::mutex> lck(mtx_);
         auto iter = sub_windows_.find(sub_win);
-        if(iter != sub_windows_.end()){
-            if(w != iter->second.image.width || h != iter->second.image.height)
-                iter->second = std::move(SubWindow(iter->first, data,
-                                         width_, height_, w, h, f));
-            else
-                memcpy(iter->second.image.data, data, w * h * ((f > 1) ? 4 : 3));
-        }else{
-            sub_windows_.insert(std::make_pair(sub_win, SubWindow(
-                         sub_win, data, width_, height_, w, h, f)));
-            CreateTexture(sub_win);            
-        }        
+        if(image_mem != nullptr){
+            //the sub-window may have been rebound with another image meanwhile
+            bool valid = iter != sub_windows_.end() && iter->second.image.width == image_w &&
+                         iter->second.image.height == image_h && iter->second.image.format == f;
+            size_t version = valid ? NextVersion() : 0;
+            CommitImageMemory(sub_win, version);
+            if(valid){
+                iter->second.image.version = version;
+                return;
+            }
+            //rare enough to convert again under lock
+            image = Image(data, w, h, f, max_size);
+        }
+        if(iter == sub_windows_.end())
+            iter = sub_windows_.insert(std::make_pair(sub_win, SubWindow(
+                         sub_win, nullptr, width_, height_, w, h, f))).first;
+        SubWindow& win = iter->second;
+        if(w != win.raw_width || h != win.raw_height){
+            win.raw_width = w;
+            win.raw_height = h;
+            win.aspect_ratio = (float)w / h;
+            win.Resize(sub_win, width_, height_);
+        }
+        retired = std::move(win.spare);
+        win.spare = std::move(win.image);
+        win.image = std::move(image);
+        win.image.version = NextVersion();
     }
 
     void AddCameraPose(glm::quat& rotation, const glm::vec3& position,
@@ -478,6 +1035,312 @@ public:
         frustum_pose_[3] = glm::vec4(position, 1.0f);
         traj_.emplace_back(position);
         traj_.emplace_back(color);
+        version_traj_ = NextVersion();
+    }
+
+    void AddPointChunk(int id, const void* data, size_t num_vertices,
+                       int stride, int pos_off, int col_off, PointFormat format){
+        if(data == nullptr || num_vertices == 0)
+            return;
+        //repack without holding the lock
+        PointChunk chunk(data, num_vertices, stride, pos_off, col_off, format);
+        std::lock_guard<std::mutex> lck(mtx_);
+        auto iter = chunks_.find(id);
+        if(iter != chunks_.end())
+            chunk.pose = iter->second.pose;
+        chunk.version = NextVersion();
+        chunks_[id] = std::move(chunk);
+    }
+
+    int AddRigCamera(const CameraIntrinsics& intrinsics, const glm::mat4& extrinsics,
+                     const DepthRange& range){
+        std::lock_guard<std::mutex> lck(mtx_);
+        rig_cameras_.push_back(RigCamera{intrinsics, extrinsics, range});
+        return (int)rig_cameras_.size() - 1;
+    }
+
+    //every camera is back-projected into a buffer of its own by a task of its own, then
+    //packed into its part of the chunk, all without holding the lock
+    void SubmitRigFrames(int id, const RigFrame* frames, size_t num_frames,
+                         const glm::mat4& body_pose, PointFormat format){
+        if(frames == nullptr)
+            return;
+        std::vector<RigCamera> cameras;
+        {
+            std::lock_guard<std::mutex> lck(mtx_);
+            cameras = rig_cameras_;
+        }
+        //cameras may have been added since the caller filled frames
+        size_t num_cameras = std::min(num_frames, cameras.size());
+        std::vector<std::vector<float>> points(num_cameras);
+        std::vector<size_t> offsets(num_cameras + 1, 0);
+        std::vector<AABB> boxes(num_cameras);
+        ThreadPool& pool = ThreadPool::Global();
+        pool.ParallelFor(0, num_cameras, 1, [&](size_t begin, size_t end){
+            for(size_t i = begin; i < end; i++){
+                const CameraIntrinsics& K = cameras[i].intrinsics;
+                if(frames[i].depth == nullptr || K.width <= 0 || K.height <= 0)
+                    continue;
+                points[i].resize((size_t)K.width * K.height * 6);
+                size_t n = DepthToPointCloud(frames[i].depth, frames[i].color, frames[i].color_format,
+                                             K, &cameras[i].extrinsics[0][0], points[i].data(),
+                                             cameras[i].range);
+                for(size_t k = 0; k < n; k++)
+                    boxes[i].Extend(glm::vec3(points[i][k * 6], points[i][k * 6 + 1], points[i][k * 6 + 2]));
+                offsets[i + 1] = n;
+            }
+        });
+        AABB box;
+        for(size_t i = 0; i < num_cameras; i++){
+            offsets[i + 1] += offsets[i];
+            if(offsets[i + 1] > offsets[i])
+                box.Extend(boxes[i]);
+        }
+        if(offsets[num_cameras] == 0)
+            return;
+        PointChunk chunk;
+        chunk.Allocate(offsets[num_cameras], box, format);
+        pool.ParallelFor(0, num_cameras, 1, [&](size_t begin, size_t end){
+            for(size_t i = begin; i < end; i++)
+                chunk.Pack(offsets[i], points[i].data(), offsets[i + 1] - offsets[i],
+                           6 * sizeof(float), 0, 3 * sizeof(float));
+        });
+        chunk.pose = body_pose;
+        std::lock_guard<std::mutex> lck(mtx_);
+        chunk.version = NextVersion();
+        chunks_[id] = std::move(chunk);
+    }
+
+    void SetChunkPose(int id, const glm::mat4& pose){
+        std::lock_guard<std::mutex> lck(mtx_);
+        auto iter = chunks_.find(id);
+        if(iter != chunks_.end())
+            iter->second.pose = pose;
+    }
+
+    void RemoveChunk(int id){
+        std::lock_guard<std::mutex> lck(mtx_);
+        chunks_.erase(id);
+    }
+
+    //only model matrices change, so the whole correction is drawn by the next frame
+    void UpdateKeyframePoses(const int* ids, const float* poses, size_t count){
+        if(ids == nullptr || poses == nullptr)
+            return;
+        std::lock_guard<std::mutex> lck(mtx_);
+        for(size_t i = 0; i < count; i++){
+            glm::mat4 pose;
+            memcpy(&pose[0][0], poses + 16 * i, 16 * sizeof(float));
+            auto chunk = chunks_.find(ids[i]);
+            if(chunk != chunks_.end())
+                chunk->second.pose = pose;
+            auto frame = depth_frames_.find(ids[i]);
+            if(frame != depth_frames_.end())
+                frame->second.pose = pose;
+        }
+    }
+
+    //chunks are snapshotted under the lock, which copies only their poses since points
+    //are shared, then transformed in parallel without it
+    size_t ExportPointChunks(float* out, size_t capacity){
+        std::vector<PointChunk> chunks;
+        {
+            std::lock_guard<std::mutex> lck(mtx_);
+            chunks.reserve(chunks_.size());
+            for(const auto& e : chunks_)
+                chunks.push_back(e.second);
+        }
+        std::vector<size_t> offsets(chunks.size() + 1, 0);
+        for(size_t i = 0; i < chunks.size(); i++)
+            offsets[i + 1] = offsets[i] + chunks[i].num_vertices;
+        size_t total = offsets.back();
+        if(out == nullptr || total > capacity)
+            return total;
+        ThreadPool::Global().ParallelFor(0, chunks.size(), 1, [&](size_t begin, size_t end){
+            for(size_t i = begin; i < end; i++)
+                chunks[i].Unpack(0, chunks[i].num_vertices, out + 6 * offsets[i]);
+        });
+        return total;
+    }
+
+    void BindDepthFrame(int id, const uint16_t* depth, const byte* color, ImageFormat color_format,
+                        const CameraIntrinsics& intrinsics, const glm::mat4& pose,
+                        const DepthRange& range){
+        if(depth == nullptr || intrinsics.width <= 0 || intrinsics.height <= 0 || range.factor <= 0)
+            return;
+        //copy without holding the lock
+        DepthFrame frame(depth, color, color_format, intrinsics, range);
+        frame.pose = pose;
+        std::lock_guard<std::mutex> lck(mtx_);
+        frame.version = NextVersion();
+        depth_frames_[id] = std::move(frame);
+    }
+
+    void SetDepthFramePose(int id, const glm::mat4& pose){
+        std::lock_guard<std::mutex> lck(mtx_);
+        auto iter = depth_frames_.find(id);
+        if(iter != depth_frames_.end())
+            iter->second.pose = pose;
+    }
+
+    void RemoveDepthFrame(int id){
+        std::lock_guard<std::mutex> lck(mtx_);
+        depth_frames_.erase(id);
+    }
+
+    void EnableFusion(float voxel_size, float truncation){
+        std::lock_guard<std::mutex> fusion_lck(fusion_mtx_);
+        voxel_size = std::max(voxel_size, 0.0f);
+        tsdf_.Reset(voxel_size, truncation > 0.0f ? truncation : 4.0f * voxel_size);
+        std::lock_guard<std::mutex> lck(mtx_);
+        meshes_.clear();
+    }
+
+    void EnableSurfelFusion(bool enable){
+        std::lock_guard<std::mutex> cloud_lck(cloud_mtx_);
+        //surfels replace the bound point cloud, which is emptied when they are disabled
+        bool bound = source_pcl_ == FUSED_SURFELS;
+        surfel_fusion_ = enable;
+        surfels_.Clear();
+        if(!enable && !bound)
+            return;
+        RestartOwnedCloud();
+        source_pcl_ = FUSED_SURFELS;
+        ExposeSurfels(std::vector<std::pair<size_t, size_t>>());
+    }
+
+    void FuseDepthFrame(const uint16_t* depth, const byte* color, ImageFormat color_format,
+                        const CameraIntrinsics& intrinsics, const glm::mat4& pose,
+                        const DepthRange& range){
+        if(depth == nullptr || range.factor <= 0)
+            return;
+        std::lock_guard<std::mutex> fusion_lck(fusion_mtx_);
+        std::vector<std::pair<uint64_t, TriangleMesh>> meshes;
+        if(tsdf_.VoxelSize() > 0.0f){
+            tsdf_.Integrate(depth, color, color_format, intrinsics, pose, range);
+            tsdf_.ExtractMeshes(meshes);
+        }
+        {
+            std::lock_guard<std::mutex> lck(mtx_);
+            for(auto& e : meshes){
+                if(e.second.indices.empty()){
+                    meshes_.erase(e.first);
+                    continue;
+                }
+                e.second.version = NextVersion();
+                meshes_[e.first] = std::move(e.second);
+            }
+        }
+        //surfels are fused outside mtx_ like merged point clouds, the bound array is a copy
+        std::lock_guard<std::mutex> cloud_lck(cloud_mtx_);
+        if(!surfel_fusion_)
+            return;
+        std::vector<std::pair<size_t, size_t>> updated;
+        surfels_.Fuse(depth, color, color_format, intrinsics, pose, range, updated);
+        ExposeSurfels(updated);
+    }
+
+    void EnableVoxelFilter(float voxel_size){
+        std::lock_guard<std::mutex> cloud_lck(cloud_mtx_);
+        voxel_map_.SetVoxelSize(std::max(voxel_size, 0.0f));
+        RestartOwnedCloud();
+        //a cloud merged at the old voxel size is gone with the map, bind the empty map instead;
+        //an array bound as is stays until the next binding is merged
+        if(source_pcl_ != MERGED_CLOUD)
+            return;
+        const std::vector<std::pair<size_t, size_t>> none;
+        PrepareOwnedVertices(voxel_map_.Vertices(), voxel_map_.NumVertices(), STATIC_DATA, none);
+        PrepareCloudStructures(lod_budget_ > 0, none);
+        {
+            std::lock_guard<std::mutex> lck(mtx_);
+            PublishCloudBuffer(none);
+        }
+        IngestSpatialIndex();
+        std::vector<float>().swap(back_pcl_.vertices);
+    }
+
+    void EnableOutlierFilter(int min_neighbors){
+        std::lock_guard<std::mutex> cloud_lck(cloud_mtx_);
+        voxel_map_.SetMinNeighbors(std::max(min_neighbors, 0));
+    }
+
+    void SetTargetFrameRate(float fps){
+        std::lock_guard<std::mutex> lck(mtx_);
+        target_frame_time_ = fps > 0 ? 1.0f / fps : 0.0f;
+    }
+
+    void SetPointBudget(size_t max_points){
+        std::lock_guard<std::mutex> lck(mtx_);
+        max_point_budget_ = max_points;
+    }
+
+    RenderStats GetRenderStats(){
+        std::lock_guard<std::mutex> lck(mtx_);
+        return stats_;
+    }
+
+    void EnableSpatialIndex(bool enable){
+        std::lock_guard<std::mutex> cloud_lck(cloud_mtx_);
+        index_enabled_ = enable;
+        index_.Clear();
+        IngestSpatialIndex();
+    }
+
+    bool PickPoint(int x, int y, float* point){
+        std::lock_guard<std::mutex> cloud_lck(cloud_mtx_);
+        if(!index_enabled_)
+            return false;
+        glm::vec3 origin, dir;
+        float slope;
+        {
+            std::lock_guard<std::mutex> lck(mtx_);
+            if(width_ <= 0 || height_ <= 0)
+                return false;
+            //ray through the pixel center from the near plane, in the frame of the bound cloud
+            glm::mat4 ndc_to_cloud = glm::inverse(projection_ * view_ * model_);
+            float ndc_x = 2.0f * (x + 0.5f) / width_ - 1.0f, ndc_y = 1.0f - 2.0f * (y + 0.5f) / height_;
+            glm::vec4 near_point = ndc_to_cloud * glm::vec4(ndc_x, ndc_y, -1.0f, 1.0f);
+            glm::vec4 far_point = ndc_to_cloud * glm::vec4(ndc_x, ndc_y, 1.0f, 1.0f);
+            origin = glm::vec3(near_point) / near_point.w;
+            dir = glm::normalize(glm::vec3(far_point) / far_point.w - origin);
+            //kPickRadius pixels span this much per unit of distance from the camera
+            slope = kPickRadius * 2.0f / (height_ * projection_[1][1]);
+        }
+        const CloudBuffer& front = front_pcl_;
+        int64_t i = index_.Pick(origin, dir, slope, front.array, front.stride, front.pos_off);
+        if(i < 0)
+            return false;
+        if(point != nullptr)
+            ReadVertex(i, point);
+        return true;
+    }
+
+    size_t Nearest(const float* p, size_t k, float* out){
+        std::lock_guard<std::mutex> cloud_lck(cloud_mtx_);
+        if(!index_enabled_ || p == nullptr)
+            return 0;
+        std::vector<uint32_t> indices;
+        const CloudBuffer& front = front_pcl_;
+        index_.Nearest(glm::vec3(p[0], p[1], p[2]), k, front.array, front.stride, front.pos_off,
+                       indices);
+        for(size_t i = 0; out != nullptr && i < indices.size(); i++)
+            ReadVertex(indices[i], out + i * 6);
+        return indices.size();
+    }
+
+    size_t QueryBox(const float* lower, const float* upper, float* out, size_t capacity){
+        std::lock_guard<std::mutex> cloud_lck(cloud_mtx_);
+        if(!index_enabled_ || lower == nullptr || upper == nullptr)
+            return 0;
+        std::vector<uint32_t> indices;
+        AABB box(glm::vec3(lower[0], lower[1], lower[2]), glm::vec3(upper[0], upper[1], upper[2]));
+        const CloudBuffer& front = front_pcl_;
+        index_.QueryBox(box, front.array, front.stride, front.pos_off, indices);
+        if(out != nullptr && indices.size() <= capacity){
+            for(size_t i = 0; i < indices.size(); i++)
+                ReadVertex(indices[i], out + i * 6);
+        }
+        return indices.size();
     }
 
 protected:
@@ -491,13 +1354,319 @@ protected:
     int stride_pcl_ = 0;
     int pos_off_pcl_ = 0;
     int col_off_pcl_ = 0;
+    int nor_off_pcl_ = -1;  //no normals when negative
+    DataUsage usage_pcl_ = STATIC_DATA;
+    //every bound resource is stamped from one counter, backends compare the stamp with
+    //the one they uploaded lastly to skip transferring unchanged data
+    size_t version_pcl_ = 0;
+    size_t version_traj_ = 0;
+    size_t version_counter_ = 0;
+    std::unordered_map<int, PointChunk> chunks_;
+    std::vector<RigCamera> rig_cameras_;  //a frustum is drawn per camera when not empty
+    std::unordered_map<int, DepthFrame> depth_frames_;
+    //fusion integrates under fusion_mtx_ alone, so rendering waits only for the exchange
+    //of remeshed blocks in meshes_, which are keyed by TSDFVolume block
+    TSDFVolume tsdf_;
+    std::mutex fusion_mtx_;
+    std::unordered_map<uint64_t, TriangleMesh> meshes_;
+    //surfels fused from depth frames, copied into the owned vertices and bound in
+    //APPEND_DATA usage; touched under cloud_mtx_
+    SurfelMap surfels_;
+    bool surfel_fusion_ = false;
+    size_t lod_budget_ = 0;   //level of detail is disabled when zero
+    bool group_pcl_ = false;  //static arrays are drawn grouped by space, touched under cloud_mtx_
+    bool cull_pcl_ = true;    //culling blocks are built on binding, touched under cloud_mtx_
+    //spatial hash over the bound point cloud for picking and neighbor queries, kept up to
+    //front_pcl_ under cloud_mtx_, which queries take instead of mtx_
+    bool index_enabled_ = false;
+    size_t generation_index_ = 0;  //of the indexed array
+    PointIndex index_;
+    //viewer's own copy of the point cloud, used for MERGE_DATA or when voxel filter is on;
+    //the merged points are then exposed as the bound array in APPEND_DATA usage
+    VoxelMap voxel_map_;
+    size_t merged_input_ = 0;  //vertices of an APPEND_DATA input already merged
+    //writers hold cloud_mtx_ while they merge or fuse vertices, copy them into back_pcl_ and
+    //build the structures over it, and take mtx_ only to swap it with front_pcl_, which the
+    //bound array is described by; locks are taken in the order fusion_mtx_, cloud_mtx_, mtx_
+    std::mutex cloud_mtx_;
+    CloudBuffer front_pcl_, back_pcl_;
+    CloudSource source_pcl_ = USER_ARRAY;
+    size_t generation_pcl_ = 0;   //bumped whenever the bound point cloud starts over
+    //ranges updated by the last swap, which back_pcl_ has yet to catch up with
+    std::vector<std::pair<size_t, size_t>> stale_pcl_;
+    //ranges of already uploaded vertices changed since then, uploaded along with the tail
+    std::vector<std::pair<size_t, size_t>> dirty_pcl_;
+    float target_frame_time_ = 0.0f;  //in seconds, frame rate control is off when zero
+    size_t max_point_budget_ = 0;     //unbounded when zero
+    RenderStats stats_;
     GraphicAPI api_;
     glm::vec3 pos_cam_;
     int width_, height_;    
     std::mutex mtx_;
     std::unordered_map<SubWindowPos, SubWindow> sub_windows_;
+    bool stream_images_ = true;  //producers may write images straight into backend memory
+
+    size_t NextVersion() { return ++version_counter_; }
+
+    //merge an input into voxel_map_ and return the usage the merged vertices are bound in,
+    //ranges of existing vertices it changed are appended to updated
+    DataUsage MergePointCloud(const void* data, size_t num_vertices, int stride, int pos_off,
+                              int col_off, DataUsage usage,
+                              std::vector<std::pair<size_t, size_t>>& updated){
+        size_t first = 0;
+        bool reset = false;
+        if(usage == APPEND_DATA && num_vertices >= merged_input_)
+            first = merged_input_;
+        else if(usage != MERGE_DATA)
+            reset = true;
+        if(reset)
+            RestartOwnedCloud();
+        if(data != nullptr && num_vertices > first)
+            voxel_map_.Insert(static_cast<const byte*>(data) + first * stride, num_vertices - first,
+                              stride, pos_off, col_off, updated);
+        merged_input_ = usage == MERGE_DATA ? 0 : num_vertices;
+        return reset ? STATIC_DATA : APPEND_DATA;
+    }
+
+    //start the owned vertices over, back_pcl_ is then refilled whole
+    void RestartOwnedCloud(){
+        voxel_map_.Clear();
+        merged_input_ = 0;
+        stale_pcl_.clear();
+        ++generation_pcl_;
+    }
+
+    //the bound point cloud starts over when it's taken from another source
+    void SwitchCloudSource(CloudSource source){
+        if(source_pcl_ == source)
+            return;
+        RestartOwnedCloud();
+        source_pcl_ = source;
+    }
+
+    //after copying rhs, bound arrays that were vertices owned by rhs are the copies of them;
+    //moved vectors keep their storage, so moves need not do this
+    void PointAtOwnVertices(const ImplDRViewerBase& rhs){
+        if(rhs.front_pcl_.array == rhs.front_pcl_.vertices.data())
+            front_pcl_.array = front_pcl_.vertices.data();
+        if(rhs.back_pcl_.array == rhs.back_pcl_.vertices.data())
+            back_pcl_.array = back_pcl_.vertices.data();
+        if(rhs.array_pcl_ == rhs.front_pcl_.array)
+            array_pcl_ = front_pcl_.array;
+    }
+
+    static void CopyCloudDescription(const CloudBuffer& src, CloudBuffer& dst){
+        dst.array = src.array;
+        dst.size = src.size;
+        dst.stride = src.stride;
+        dst.pos_off = src.pos_off;
+        dst.col_off = src.col_off;
+        dst.nor_off = src.nor_off;
+        dst.usage = src.usage;
+        dst.generation = src.generation;
+    }
+
+    //bring the vertices of back_pcl_ up to the owned ones: a buffer of an older generation
+    //is copied whole, else only the ranges updated by this and the last swap and the
+    //vertices appended since it was last bound
+    void PrepareOwnedVertices(const float* vertices, size_t num_vertices, DataUsage usage,
+                              const std::vector<std::pair<size_t, size_t>>& updated){
+        CloudBuffer& back = back_pcl_;
+        size_t first = back.generation == generation_pcl_ ? std::min(back.size, num_vertices) : 0;
+        back.vertices.resize(num_vertices * 6);
+        auto copy = [&](size_t begin, size_t end){
+            end = std::min(end, first);
+            if(begin < end)
+                memcpy(&back.vertices[begin * 6], vertices + begin * 6,
+                       (end - begin) * 6 * sizeof(float));
+        };
+        for(auto& range : stale_pcl_)
+            copy(range.first, range.second);
+        for(auto& range : updated)
+            copy(range.first, range.second);
+        if(first < num_vertices)
+            memcpy(&back.vertices[first * 6], vertices + first * 6,
+                   (num_vertices - first) * 6 * sizeof(float));
+        stale_pcl_ = updated;
+
+        back.array = back.vertices.data();
+        back.size = num_vertices;
+        back.stride = 6 * sizeof(float);
+        back.pos_off = 0;
+        back.col_off = 3 * sizeof(float);
+        back.nor_off = -1;
+        back.usage = usage;
+        back.generation = generation_pcl_;
+    }
+
+    //bring the level of detail octree, or else the culling blocks, of back_pcl_ up to its
+    //array: those of an array appended to the bound one extend the bound ones, others are
+    //built from scratch. Runs without mtx_, the bound structures are only read here
+    void PrepareCloudStructures(bool lod, const std::vector<std::pair<size_t, size_t>>& updated){
+        CloudBuffer& back = back_pcl_;
+        const CloudBuffer& front = front_pcl_;
+        bool extend = back.usage == APPEND_DATA && front.usage == APPEND_DATA &&
+                      back.generation == front.generation;
+        const byte* src = static_cast<const byte*>(back.array);
+
+        if(!lod || src == nullptr){
+            back.octree.Clear();
+            back.lod_ingested = 0;
+        }else{
+            if(extend && back.size >= front.lod_ingested){
+                back.octree.CopyChanged(front.octree);
+                back.lod_ingested = front.lod_ingested;
+            }else{
+                back.octree.Clear();
+                back.lod_ingested = 0;
+            }
+            back.octree.Insert(src + back.lod_ingested * back.stride, back.size - back.lod_ingested,
+                               back.stride, back.pos_off, back.col_off);
+            back.lod_ingested = back.size;
+        }
+
+        back.order.clear();
+        if(lod || src == nullptr || back.usage == STREAM_DATA || !cull_pcl_){
+            back.order.shrink_to_fit();
+            back.blocks.clear();
+            back.blocked = 0;
+            return;
+        }
+        const size_t num_blocks = (back.size + kCullingBlockSize - 1) / kCullingBlockSize;
+        src += back.pos_off;
+        //a static array has no order of its own, its vertices may be drawn grouped by space
+        if(group_pcl_ && back.usage == STATIC_DATA &&
+           back.size <= std::numeric_limits<uint32_t>::max()){
+            GroupBySpace(src, back.size, back.stride, back.order);
+            back.blocks.assign(num_blocks, AABB());
+            ThreadPool::Global().ParallelFor(0, num_blocks, 1, [&](size_t begin, size_t end){
+                size_t last = std::min(end * kCullingBlockSize, back.size);
+                for(size_t i = begin * kCullingBlockSize; i < last; i++){
+                    glm::vec3 p;
+                    memcpy(&p[0], src + back.order[i] * (size_t)back.stride, 3 * sizeof(float));
+                    if(std::isfinite(p.x) && std::isfinite(p.y) && std::isfinite(p.z))
+                        back.blocks[i / kCullingBlockSize].Extend(p);
+                }
+            });
+            back.blocked = back.size;
+            return;
+        }
+        back.order.shrink_to_fit();
+        if(extend && back.size >= front.blocked){
+            back.blocks = front.blocks;
+            back.blocked = front.blocked;
+        }else{
+            back.blocks.clear();
+            back.blocked = 0;
+        }
+        back.blocks.resize(num_blocks);
+        //updated vertices may have moved(e.g. merged surfels), boxes only grow to keep them
+        for(auto& range : updated){
+            for(size_t i = range.first; i < std::min(range.second, back.blocked); i++){
+                glm::vec3 p;
+                memcpy(&p[0], src + i * back.stride, 3 * sizeof(float));
+                back.blocks[i / kCullingBlockSize].Extend(p);
+            }
+        }
+        for(size_t i = back.blocked; i < back.size; i++){
+            glm::vec3 p;
+            memcpy(&p[0], src + i * back.stride, 3 * sizeof(float));
+            back.blocks[i / kCullingBlockSize].Extend(p);
+        }
+        back.blocked = back.size;
+    }
 
-    virtual void CreateTexture(SubWindowPos pos) = 0;
+    //swap back_pcl_ in as the bound point cloud and queue its updated ranges for upload, all
+    //of it when it starts over or restart is set
+    void PublishCloudBuffer(const std::vector<std::pair<size_t, size_t>>& updated,
+                            bool restart = false){
+        restart = restart || front_pcl_.generation != back_pcl_.generation;
+        std::swap(front_pcl_, back_pcl_);
+        const CloudBuffer& front = front_pcl_;
+        array_pcl_ = front.array;
+        size_pcl_ = front.size;
+        stride_pcl_ = front.stride;
+        pos_off_pcl_ = front.pos_off;
+        col_off_pcl_ = front.col_off;
+        nor_off_pcl_ = front.nor_off;
+        usage_pcl_ = front.usage;
+        if(usage_pcl_ != APPEND_DATA)
+            dirty_pcl_.clear();
+        else if(restart)
+            dirty_pcl_.assign(1, std::make_pair(size_t(0), std::numeric_limits<size_t>::max()));
+        else
+            dirty_pcl_.insert(dirty_pcl_.end(), updated.begin(), updated.end());
+        CoalesceDirtyRanges();
+        version_pcl_ = NextVersion();
+    }
+
+    //sort and merge overlapping ranges in dirty_pcl_, which is unused under level of detail
+    void CoalesceDirtyRanges(){
+        if(lod_budget_ > 0)
+            dirty_pcl_.clear();
+        else if(dirty_pcl_.size() > 1){
+            std::sort(dirty_pcl_.begin(), dirty_pcl_.end());
+            size_t n = 0;
+            for(size_t i = 1; i < dirty_pcl_.size(); i++){
+                if(dirty_pcl_[i].first <= dirty_pcl_[n].second)
+                    dirty_pcl_[n].second = std::max(dirty_pcl_[n].second, dirty_pcl_[i].second);
+                else
+                    dirty_pcl_[++n] = dirty_pcl_[i];
+            }
+            dirty_pcl_.resize(n + 1);
+        }
+    }
+
+    //copy the surfel map into the back buffer and bind it as an appended point cloud;
+    //updated has the ranges of surfels the last Fuse changed
+    void ExposeSurfels(const std::vector<std::pair<size_t, size_t>>& updated){
+        SwitchCloudSource(FUSED_SURFELS);
+        PrepareOwnedVertices(surfels_.Vertices(), surfels_.NumVertices(), APPEND_DATA, updated);
+        PrepareCloudStructures(lod_budget_ > 0, updated);
+        {
+            std::lock_guard<std::mutex> lck(mtx_);
+            PublishCloudBuffer(updated);
+        }
+        IngestSpatialIndex();
+    }
+
+    //index vertices appended to the bound cloud, rebuild the index if the array may have
+    //changed; streamed arrays change every frame and are not indexed. Called under cloud_mtx_
+    //without mtx_, front_pcl_ only changes under both
+    void IngestSpatialIndex(){
+        if(!index_enabled_)
+            return;
+        const CloudBuffer& front = front_pcl_;
+        if(front.usage != APPEND_DATA || front.size < index_.NumVertices() ||
+           front.generation != generation_index_){
+            index_.Clear();
+            generation_index_ = front.generation;
+        }
+        if(front.array == nullptr || front.usage == STREAM_DATA)
+            return;
+        index_.Insert(front.array, front.size, front.stride, front.pos_off);
+    }
+
+    //copy position and color of bound vertex i to out in the default layout |x y z r g b|,
+    //under cloud_mtx_
+    void ReadVertex(size_t i, float* out) const{
+        const CloudBuffer& front = front_pcl_;
+        const byte* v = static_cast<const byte*>(front.array) + i * front.stride;
+        memcpy(out, v + front.pos_off, 3 * sizeof(float));
+        memcpy(out + 3, v + front.col_off, 3 * sizeof(float));
+    }
+
+    //largest side of images the backend shows without shrinking them on CPU, 0 if unlimited
+    virtual int MaxImageSize() const { return 0; }
+    //return writable memory of at least num_bytes for the next image of sub-window pos if the
+    //backend has any available, it's filled without lock and handed back by CommitImageMemory
+    //under lock with the version of the image, or 0 to drop it
+    virtual void* AcquireImageMemory(SubWindowPos pos, size_t num_bytes) { return nullptr; }
+    virtual void CommitImageMemory(SubWindowPos pos, size_t version) {}
+    //return writable memory of at least num_bytes for STREAM_DATA vertices if the backend has
+    //any available, it's filled without lock and handed back by CommitStreamMemory under lock
+    virtual void* AcquireStreamMemory(size_t num_bytes) { return nullptr; }
+    virtual void CommitStreamMemory() {}
 };
 
 class ImplDRViewerOGL : public ImplDRViewerBase{
@@ -555,21 +1724,44 @@ public:
         }
         plain_shader_ = new Shader(std::string(vert_shader_src), frag_shader_src);
         texture_shader_ = new Shader(std::string(TEXTURE_VERTEX_SHADER), std::string(TEXTURE_FRAGMENT_SHADER));
-        glGenVertexArrays(1, &vao_);
-        glGenBuffers(1, &vbo_);
-        glGenBuffers(1, &ebo_);
+        depth_shader_ = new Shader(std::string(DEPTH_VERTEX_SHADER), std::string(FRAGMENT_SHADER_DEFAULT));
+        depth_shader_->use();
+        depth_shader_->setInt("depth_map", 0);
+        depth_shader_->setInt("color_map", 1);
+        has_buffer_storage_ = LoadBufferStorage();
+        has_texture_storage_ = LoadTextureStorage();
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_texture_size_);
+        mesh_cube_ = CreateMesh(vertices_cube, sizeof(vertices_cube), 36);
+        mesh_coordinates_ = CreateMesh(vertices_coordinates, sizeof(vertices_coordinates), 6);
+        mesh_frustum_ = CreateMesh(vertices_frustum, sizeof(vertices_frustum),
+                                   sizeof(indices_frustum) / sizeof(unsigned short),
+                                   indices_frustum, sizeof(indices_frustum));
+        mesh_grids_ = CreateMesh(vertices_grids, sizeof(vertices_grids),
+                                 sizeof(indices_grids) / sizeof(unsigned short),
+                                 indices_grids, sizeof(indices_grids));
+        mesh_texture_ = CreateMesh(vertices_texture, sizeof(vertices_texture),
+                                   sizeof(indices_texture) / sizeof(unsigned short),
+                                   indices_texture, sizeof(indices_texture), true);
+        glGenVertexArrays(1, &pcl_vao_);
+        glGenBuffers(1, &pcl_vbo_);
+        glGenBuffers(1, &pcl_ebo_);
+        glGenVertexArrays(1, &traj_vao_);
+        glGenBuffers(1, &traj_vbo_);
+        for(FrameTimer& timer : frame_timers_)
+            glGenQueries(1, &timer.query);
+        glGenVertexArrays(1, &depth_vao_);
     }
 
     ImplDRViewerOGL(const ImplDRViewerOGL& rhs): ImplDRViewerBase(rhs),
         plain_shader_(rhs.plain_shader_), texture_shader_(rhs.texture_shader_),
-        window_(rhs.window_),textures_(rhs.textures_){
+        window_(rhs.window_){
         TrivialAssign(rhs);
         ++(*ref_count_);
     }
 
     ImplDRViewerOGL(ImplDRViewerOGL&& rhs) noexcept: ImplDRViewerBase(std::move(rhs)),
         plain_shader_(rhs.plain_shader_), texture_shader_(rhs.texture_shader_),
-        window_(rhs.window_), textures_(std::move(rhs.textures_)){
+        window_(rhs.window_){
         TrivialAssign(rhs);
 
         rhs.plain_shader_ = nullptr;
@@ -584,7 +1776,6 @@ public:
             Destruct();
             TrivialAssign(rhs);
 
-            textures_ = rhs.textures_;
             ImplDRViewerBase::operator=(rhs);
             plain_shader_ = rhs.plain_shader_;
             texture_shader_ = rhs.texture_shader_;
@@ -599,7 +1790,6 @@ public:
             Destruct();
             TrivialAssign(rhs);
 
-            textures_ = std::move(rhs.textures_);
             ImplDRViewerBase::operator=(std::move(rhs));
             plain_shader_ = rhs.plain_shader_;
             texture_shader_ = rhs.texture_shader_;
@@ -630,6 +1820,12 @@ public:
         float current_time = glfwGetTime();
         delta_time_ = current_time - last_time_;
         last_time_ = current_time;
+        ++frame_count_;
+        stats_ = RenderStats();
+        FrameTimer& timer = frame_timers_[frame_count_ % kNumFrameTimers];
+        ReadFrameTimer(timer);
+        glBeginQuery(GL_TIME_ELAPSED, timer.query);
+        double frame_start = glfwGetTime();
 
         glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -644,15 +1840,24 @@ public:
                            (float)width_ / height_, 0.1f, 100.0f);
         plain_shader_->setMat4("view", view_);
         plain_shader_->setMat4("projection", projection_);
+        UpdatePointBudget();
 
 //        DrawCube();
         DrawCoordinateSystem(4.0f);
         DrawGrids();
         DrawFrustum();
         DrawTrajectory();
+        DrawTriangleMeshes();
         DrawPointCloud(point_size_);
+        DrawPointChunks(point_size_);
+        DrawDepthFrames(point_size_);
         DrawTexture();
 
+        glEndQuery(GL_TIME_ELAPSED);
+        timer.pending = true;
+        timer.points = stats_.points_drawn;
+        timer.cpu_time = glfwGetTime() - frame_start;
+
         GLenum err;
         while ((err = glGetError()) != GL_NO_ERROR) {
             printf("OpenGL error: %u", err);
@@ -681,6 +1886,7 @@ private:
 
 private:
     Shader* plain_shader_, *texture_shader_;
+    Shader* depth_shader_ = nullptr;
     GLFWwindow* window_;
     CallbackHelper* callback_helper_;
     float lastX_ = 0.0f, lastY_ = 0.0f;
@@ -688,17 +1894,141 @@ private:
     bool clr_left_mouse_ = true, clr_right_mouse_ = true;
     Camera camera_ = Camera(glm::vec3(0.0f, 0.0f, 0.0f));
     size_t* ref_count_ = nullptr;
-    GLuint vao_, vbo_, ebo_;
+    //constant geometry of widgets, created once and only bound when drawn
+    struct GLMesh{
+        GLuint vao = 0, vbo = 0, ebo = 0;
+        GLsizei count = 0;
+    };
+    GLMesh mesh_cube_, mesh_coordinates_, mesh_frustum_, mesh_grids_, mesh_texture_;
+    //point cloud owns its buffer so that appended vertices can be uploaded alone
+    GLuint pcl_vao_, pcl_vbo_, pcl_ebo_;  //pcl_ebo_ has front_pcl_.order if it is not empty
+    size_t capacity_pcl_ = 0;  //in bytes
+    size_t uploaded_pcl_ = 0;  //number of vertices already resident in pcl_vbo_
+    int uploaded_stride_pcl_ = 0;
+    size_t uploaded_version_pcl_ = 0;
+    GLuint traj_vao_, traj_vbo_;
+    size_t uploaded_version_traj_ = 0;
+    //sub-window image with immutable storage for one size and format, replaced when either
+    //changes and otherwise only updated in place when the image does. With persistent mapping
+    //new images arrive through a ring of kNumStreamRegions regions of a pixel unpack buffer:
+    //the producer fills one without lock and GPU copies it into the texture asynchronously,
+    //a region is reused only after the fence of that copy signaled
+    struct GLTexture{
+        GLuint tex = 0;
+        int width = 0, height = 0;
+        GLenum internal_format = 0;
+        GLsizei levels = 0;  //more than one when minified through mipmaps
+        size_t uploaded_version = 0;
+        GLuint pbo = 0;
+        byte* mapped = nullptr;
+        size_t region_size = 0;  //in bytes
+        GLsync fences[kNumStreamRegions] = {};
+        int ready = -1;     //region filled by producer but not uploaded yet
+        int write = -1;     //region free for producer
+        int acquired = -1;  //region being filled by producer
+        size_t ready_version = 0;
+    };
+    std::unordered_map<SubWindowPos, GLTexture> gl_textures_;
+    struct GLChunk{
+        GLuint vao = 0, vbo = 0;
+        size_t uploaded_version = 0;
+        size_t last_frame = 0;  //frame it was drawn lastly
+        GLsizei step = 0;       //subsampling step its vertex attributes are bound with
+    };
+    std::unordered_map<int, GLChunk> gl_chunks_;
+    struct GLDepthFrame{
+        GLuint depth_tex = 0, color_tex = 0;
+        size_t uploaded_version = 0;
+    };
+    std::unordered_map<int, GLDepthFrame> gl_depth_frames_;
+    struct GLTriangleMesh{
+        GLuint vao = 0, vbo = 0, ebo = 0;
+        GLsizei count = 0;
+        size_t uploaded_version = 0;
+    };
+    std::unordered_map<uint64_t, GLTriangleMesh> gl_meshes_;
+    GLuint depth_vao_ = 0;  //depth frames have no vertex attributes, but drawing needs a vao
+    std::vector<GLChunk> gl_lod_nodes_;  //indexed as octree nodes
+    std::vector<int> lod_selection_;
+    std::vector<GLint> cull_firsts_;
+    std::vector<GLsizei> cull_counts_;
+    std::vector<const GLvoid*> cull_offsets_;   //of cull_firsts_ into pcl_ebo_
+    std::vector<int> cull_chunks_;
+    std::vector<int> cull_depth_frames_;
+    //frame rate control: GPU time of recent frames is read back without waiting and turned
+    //into a points per second estimate, which sizes the point budget while the view moves
+    struct FrameTimer{
+        GLuint query = 0;
+        bool pending = false;
+        size_t points = 0;
+        double cpu_time = 0;
+    };
+    FrameTimer frame_timers_[kNumFrameTimers];
+    double points_per_second_ = 0;
+    glm::mat4 last_mvp_ = glm::mat4(0.0f);
+    size_t still_frames_ = 0;
+    size_t point_budget_ = std::numeric_limits<size_t>::max();
+    size_t subsample_ = 1;  //every subsample_-th point of bound cloud and chunks is drawn
+    //STREAM_DATA point cloud lives in kNumStreamRegions rotating regions of one buffer, each
+    //region is reused only after the fence of its last draw signaled
+    struct StreamRegion{
+        GLsync fence = nullptr;
+        size_t num_vertices = 0;
+        int stride = 0, pos_off = 0, col_off = 0, nor_off = -1;
+        size_t version = 0;     //of the bound point cloud copied into it
+    };
+    bool has_buffer_storage_ = false;
+    bool has_texture_storage_ = false;
+    GLint max_texture_size_ = 0;
+    GLuint stream_vbo_ = 0;
+    byte* stream_mapped_ = nullptr;  //persistently mapped storage, null when falling back
+    size_t stream_region_size_ = 0;  //in bytes
+    StreamRegion stream_regions_[kNumStreamRegions];
+    int stream_front_ = -1;     //region drawn lastly
+    int stream_ready_ = -1;     //region filled by producer but not drawn yet
+    int stream_write_ = -1;     //region free for producer
+    int stream_acquired_ = -1;  //region being filled by producer
     GLfloat point_size_ = 1.0f;
-    std::unordered_map<SubWindowPos, GLuint*> textures_;
+    size_t frame_count_ = 0;
 
 private:
     void TrivialAssign(const ImplDRViewerOGL& rhs) noexcept{
         lastX_ = rhs.lastX_;
         lastY_ = rhs.lastY_;
-        vao_ = rhs.vao_;
-        vbo_ = rhs.vbo_;
-        ebo_ = rhs.ebo_;
+        mesh_cube_ = rhs.mesh_cube_;
+        mesh_coordinates_ = rhs.mesh_coordinates_;
+        mesh_frustum_ = rhs.mesh_frustum_;
+        mesh_grids_ = rhs.mesh_grids_;
+        mesh_texture_ = rhs.mesh_texture_;
+        pcl_vao_ = rhs.pcl_vao_;
+        pcl_vbo_ = rhs.pcl_vbo_;
+        pcl_ebo_ = rhs.pcl_ebo_;
+        capacity_pcl_ = rhs.capacity_pcl_;
+        uploaded_pcl_ = rhs.uploaded_pcl_;
+        uploaded_stride_pcl_ = rhs.uploaded_stride_pcl_;
+        uploaded_version_pcl_ = rhs.uploaded_version_pcl_;
+        traj_vao_ = rhs.traj_vao_;
+        traj_vbo_ = rhs.traj_vbo_;
+        uploaded_version_traj_ = rhs.uploaded_version_traj_;
+        gl_textures_ = rhs.gl_textures_;
+        gl_chunks_ = rhs.gl_chunks_;
+        gl_depth_frames_ = rhs.gl_depth_frames_;
+        gl_meshes_ = rhs.gl_meshes_;
+        depth_vao_ = rhs.depth_vao_;
+        depth_shader_ = rhs.depth_shader_;
+        gl_lod_nodes_ = rhs.gl_lod_nodes_;
+        has_buffer_storage_ = rhs.has_buffer_storage_;
+        has_texture_storage_ = rhs.has_texture_storage_;
+        max_texture_size_ = rhs.max_texture_size_;
+        stream_vbo_ = rhs.stream_vbo_;
+        stream_mapped_ = rhs.stream_mapped_;
+        stream_region_size_ = rhs.stream_region_size_;
+        for(int i = 0; i < kNumStreamRegions; i++)
+            stream_regions_[i] = rhs.stream_regions_[i];
+        stream_front_ = rhs.stream_front_;
+        stream_ready_ = rhs.stream_ready_;
+        stream_write_ = rhs.stream_write_;
+        stream_acquired_ = rhs.stream_acquired_;
         last_time_ = rhs.last_time_;
         delta_time_ = rhs.delta_time_;
         clr_left_mouse_ = rhs.clr_left_mouse_;
@@ -706,6 +2036,14 @@ private:
         camera_ = rhs.camera_;
         ref_count_ = rhs.ref_count_;
         point_size_ = rhs.point_size_;
+        frame_count_ = rhs.frame_count_;
+        for(int i = 0; i < kNumFrameTimers; i++)
+            frame_timers_[i] = rhs.frame_timers_[i];
+        points_per_second_ = rhs.points_per_second_;
+        last_mvp_ = rhs.last_mvp_;
+        still_frames_ = rhs.still_frames_;
+        point_budget_ = rhs.point_budget_;
+        subsample_ = rhs.subsample_;
         callback_helper_ = rhs.callback_helper_;
         callback_helper_->handle_ = this;
     }
@@ -716,127 +2054,962 @@ private:
             if(*ref_count_ == 0){
                 delete plain_shader_;
                 delete texture_shader_;
+                delete depth_shader_;
                 delete callback_helper_;
                 delete ref_count_;
                 ref_count_ = nullptr;
-                for(auto& e : textures_){
-                    glDeleteTextures(1, e.second);
-                    delete e.second;
+                for(auto& e : gl_textures_){
+                    glDeleteTextures(1, &e.second.tex);
+                    DestroyImageStream(e.second);
                 }
 
-                glDeleteVertexArrays(1, &vao_);
-                glDeleteBuffers(1, &vbo_);
-                glDeleteBuffers(1, &ebo_);                
+                DestroyMesh(mesh_cube_);
+                DestroyMesh(mesh_coordinates_);
+                DestroyMesh(mesh_frustum_);
+                DestroyMesh(mesh_grids_);
+                DestroyMesh(mesh_texture_);
+                glDeleteVertexArrays(1, &pcl_vao_);
+                glDeleteBuffers(1, &pcl_vbo_);
+                glDeleteBuffers(1, &pcl_ebo_);
+                glDeleteVertexArrays(1, &traj_vao_);
+                glDeleteBuffers(1, &traj_vbo_);
+                for(auto& e : gl_chunks_){
+                    glDeleteVertexArrays(1, &e.second.vao);
+                    glDeleteBuffers(1, &e.second.vbo);
+                }
+                for(auto& e : gl_lod_nodes_){
+                    glDeleteVertexArrays(1, &e.vao);
+                    glDeleteBuffers(1, &e.vbo);
+                }
+                for(auto& e : gl_depth_frames_){
+                    glDeleteTextures(1, &e.second.depth_tex);
+                    glDeleteTextures(1, &e.second.color_tex);
+                }
+                glDeleteVertexArrays(1, &depth_vao_);
+                for(auto& e : gl_meshes_)
+                    DestroyTriangleMesh(e.second);
+                DestroyStreamBuffer();
+                for(FrameTimer& timer : frame_timers_)
+                    glDeleteQueries(1, &timer.query);
                 glfwDestroyWindow(window_);
             }
         }
     }
 
-    virtual void CreateTexture(SubWindowPos pos) override{
-        textures_[pos] = new GLuint;
-        glGenTextures(1, textures_[pos]);
-        glBindTexture(GL_TEXTURE_2D, *(textures_[pos]));
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    }
-
-    void BindRenderBuffer(const GLvoid* vert_buff, GLsizeiptr vert_buff_size, bool use_ebo = false,
-                          const GLvoid* indices_buff = nullptr, GLsizeiptr indices_buff_size = 0,
-                          GLenum usage = GL_STATIC_DRAW, GLsizei stride = 6 * sizeof(float),
-                          size_t pos_offset = 0, size_t color_offset = 3 * sizeof(float), bool bind_tex = false){
-        glBindVertexArray(vao_);
-        glBindBuffer(GL_ARRAY_BUFFER, vbo_);
-        glBufferData(GL_ARRAY_BUFFER, vert_buff_size, vert_buff, usage);
-        if(use_ebo){
-            if(indices_buff == nullptr || indices_buff_size == 0){
-                std::cerr<<"ERROR: Null indices buffer or buffer size when binding EBO"<<std::endl;
-                return ;
-            }
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo_);
-            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices_buff_size, indices_buff, usage);
-        }
-        if(bind_tex){
-            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5*sizeof(float), (void*)0);
-            glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5*sizeof(float), (void*)(3*sizeof(float)));
-        }else{
-            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)pos_offset);
-            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)color_offset);
-        }
+    //specify layout of vertices in the buffer bound to GL_ARRAY_BUFFER for the bound VAO,
+    //integer attributes are normalized to [0, 1]; without normals attribute 2 reads as zero
+    void BindVertexAttributes(GLsizei stride = 6 * sizeof(float), size_t pos_offset = 0,
+                              size_t color_offset = 3 * sizeof(float), GLint color_size = 3,
+                              GLenum pos_type = GL_FLOAT, GLenum color_type = GL_FLOAT,
+                              long normal_offset = -1){
+        glVertexAttribPointer(0, 3, pos_type, pos_type != GL_FLOAT, stride, (void*)pos_offset);
+        glVertexAttribPointer(1, color_size, color_type, color_type != GL_FLOAT, stride, (void*)color_offset);
         glEnableVertexAttribArray(0);
         glEnableVertexAttribArray(1);
+        if(normal_offset >= 0){
+            glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void*)normal_offset);
+            glEnableVertexAttribArray(2);
+        }else
+            glDisableVertexAttribArray(2);
+    }
+
+    void BindVertexAttributes(PointFormat format, GLsizei step = 1){
+        GLsizei stride = PointFormatStride(format) * step;
+        switch(format) {
+            case POINT_F32_RGB_F32: BindVertexAttributes(stride); break;
+            case POINT_F32_RGBA8:
+                BindVertexAttributes(stride, 0, 3 * sizeof(float), 3, GL_FLOAT, GL_UNSIGNED_BYTE); break;
+            case POINT_U16_RGBA8:
+                BindVertexAttributes(stride, 0, 4 * sizeof(uint16_t), 3, GL_UNSIGNED_SHORT, GL_UNSIGNED_BYTE); break;
+        }
+    }
+
+    //immutable storage when available, driver may then place it in the fastest memory
+    void CreateImmutableBuffer(GLenum target, GLsizeiptr size, const GLvoid* data){
+        if(has_buffer_storage_)
+            glBufferStorage(target, size, data, 0);
+        else
+            glBufferData(target, size, data, GL_STATIC_DRAW);
+    }
+
+    GLMesh CreateMesh(const GLvoid* vert_buff, GLsizeiptr vert_buff_size, GLsizei count,
+                      const GLvoid* indices_buff = nullptr, GLsizeiptr indices_buff_size = 0,
+                      bool tex_coord = false){
+        GLMesh mesh;
+        mesh.count = count;
+        glGenVertexArrays(1, &mesh.vao);
+        glBindVertexArray(mesh.vao);
+        glGenBuffers(1, &mesh.vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
+        CreateImmutableBuffer(GL_ARRAY_BUFFER, vert_buff_size, vert_buff);
+        if(indices_buff != nullptr && indices_buff_size > 0){
+            glGenBuffers(1, &mesh.ebo);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ebo);
+            CreateImmutableBuffer(GL_ELEMENT_ARRAY_BUFFER, indices_buff_size, indices_buff);
+        }
+        if(tex_coord)
+            BindVertexAttributes(5 * sizeof(float), 0, 3 * sizeof(float), 2);
+        else
+            BindVertexAttributes();
+        glBindVertexArray(0);
+        return mesh;
+    }
+
+    void DestroyMesh(GLMesh& mesh){
+        glDeleteVertexArrays(1, &mesh.vao);
+        glDeleteBuffers(1, &mesh.vbo);
+        if(mesh.ebo != 0)
+            glDeleteBuffers(1, &mesh.ebo);
+        mesh = GLMesh();
     }
 
     void DrawTexture(){
+        if(sub_windows_.empty()) return;
+        texture_shader_->use();
+        glBindVertexArray(mesh_texture_.vao);
         for(auto it = sub_windows_.begin(); it != sub_windows_.end(); ++it){
             SubWindowPos pos = it->first;
             const SubWindow& sub_win = it->second;
             const Image& image = sub_win.image;
-            glBindTexture(GL_TEXTURE_2D, *textures_[pos]);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, image.width, image.height, 0,
-                         GLFormat(image.format), GL_UNSIGNED_BYTE, image.data);
-            glGenerateMipmap(GL_TEXTURE_2D);
+            GLTexture& gl_tex = gl_textures_[pos];
+            if(gl_tex.uploaded_version != image.version)
+                UploadTexture(image, sub_win.w, sub_win.h, gl_tex);
+            else
+                glBindTexture(GL_TEXTURE_2D, gl_tex.tex);
+            if(gl_tex.mapped != nullptr && gl_tex.write < 0 && gl_tex.acquired < 0)
+                gl_tex.write = FindIdleImageRegion(gl_tex);
             glViewport(sub_win.x, sub_win.y, sub_win.w, sub_win.h);
+            glDrawElements(GL_TRIANGLES, mesh_texture_.count, GL_UNSIGNED_SHORT, 0);
+        }
+    }
+
+    //viewport_width x viewport_height is the sub-window the image is drawn into
+    void UploadTexture(const Image& image, int viewport_width, int viewport_height,
+                       GLTexture& gl_tex){
+        double start = glfwGetTime();
+        GLenum internal_format = image.format == RGBA || image.format == BGRA ? GL_RGBA8 : GL_RGB8;
+        //levels halve the image down to the first one no larger than the viewport, a level
+        //smaller than that is never sampled
+        GLsizei levels = 1;
+        if(image.width >= kMipmapMinification * viewport_width ||
+           image.height >= kMipmapMinification * viewport_height){
+            while((image.width >> (levels - 1)) > viewport_width ||
+                  (image.height >> (levels - 1)) > viewport_height)
+                ++levels;
+        }
+        bool mipmaps = levels > 1;
+        if(gl_tex.tex == 0 || gl_tex.width != image.width || gl_tex.height != image.height ||
+           gl_tex.internal_format != internal_format || gl_tex.levels != levels){
+            //immutable storage can't be resized, so a new size takes a new texture
+            if(gl_tex.tex != 0)
+                glDeleteTextures(1, &gl_tex.tex);
+            glGenTextures(1, &gl_tex.tex);
+            glBindTexture(GL_TEXTURE_2D, gl_tex.tex);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                            mipmaps ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+            if(has_texture_storage_)
+                glTexStorage2D(GL_TEXTURE_2D, levels, internal_format, image.width, image.height);
+            else{
+                for(GLsizei i = 0; i < levels; i++)
+                    glTexImage2D(GL_TEXTURE_2D, i, internal_format, std::max(1, image.width >> i),
+                                 std::max(1, image.height >> i), 0, GLFormat(image.format),
+                                 GL_UNSIGNED_BYTE, nullptr);
+            }
+            gl_tex.width = image.width;
+            gl_tex.height = image.height;
+            gl_tex.internal_format = internal_format;
+            gl_tex.levels = levels;
+        }else
+            glBindTexture(GL_TEXTURE_2D, gl_tex.tex);
+        //rows are tightly packed, so of any width when it's odd and the image has 3 channels;
+        //the largest alignment they satisfy lets the driver copy whole words
+        int row_bytes = image.width * (image.format > 1 ? 4 : 3);
+        GLint alignment = row_bytes % 8 == 0 ? 8 : row_bytes % 4 == 0 ? 4 : row_bytes % 2 == 0 ? 2 : 1;
+        glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        if(gl_tex.ready >= 0 && gl_tex.ready_version == image.version){
+            //the copy from the pixel buffer returns at once and runs on GPU
+            int r = gl_tex.ready;
+            gl_tex.ready = -1;
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, gl_tex.pbo);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image.width, image.height, GLFormat(image.format),
+                            GL_UNSIGNED_BYTE, (void*)(r * gl_tex.region_size));
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            gl_tex.fences[r] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            ++stats_.images_streamed;
+        }else{
+            //a region left from an older image is dropped, the image was bound without it since
+            gl_tex.ready = -1;
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image.width, image.height, GLFormat(image.format),
+                            GL_UNSIGNED_BYTE, image.data);
+            //let the producer stream the next images of this size, never unmap memory it's
+            //writing to
+            size_t num_bytes = (size_t)image.width * image.height * (image.format > 1 ? 4 : 3);
+            if(has_buffer_storage_ && stream_images_ && gl_tex.acquired < 0 &&
+               gl_tex.region_size < num_bytes)
+                CreateImageStream(gl_tex, num_bytes);
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        if(mipmaps)
+            glGenerateMipmap(GL_TEXTURE_2D);
+        gl_tex.uploaded_version = image.version;
+        ++stats_.images_uploaded;
+        stats_.image_upload_time += (glfwGetTime() - start) * 1000.0;
+    }
+
+    virtual int MaxImageSize() const override { return max_texture_size_; }
+
+    virtual void* AcquireImageMemory(SubWindowPos pos, size_t num_bytes) override{
+        auto iter = gl_textures_.find(pos);
+        if(iter == gl_textures_.end())
+            return nullptr;
+        GLTexture& gl_tex = iter->second;
+        if(gl_tex.mapped == nullptr || gl_tex.write < 0 || gl_tex.acquired >= 0 ||
+           num_bytes > gl_tex.region_size)
+            return nullptr;
+        gl_tex.acquired = gl_tex.write;
+        gl_tex.write = -1;
+        return gl_tex.mapped + gl_tex.acquired * gl_tex.region_size;
+    }
+
+    virtual void CommitImageMemory(SubWindowPos pos, size_t version) override{
+        GLTexture& gl_tex = gl_textures_[pos];
+        if(version == 0){
+            gl_tex.write = gl_tex.acquired;
+            gl_tex.acquired = -1;
+            return;
+        }
+        //a ready region replaced before being uploaded is not used by GPU, recycle it at once
+        gl_tex.write = gl_tex.ready;
+        gl_tex.ready = gl_tex.acquired;
+        gl_tex.ready_version = version;
+        gl_tex.acquired = -1;
+    }
+
+    void CreateImageStream(GLTexture& gl_tex, size_t region_size){
+        DestroyImageStream(gl_tex);
+        region_size = (region_size + kStreamRegionAlignment - 1) / kStreamRegionAlignment
+                      * kStreamRegionAlignment;
+        size_t num_bytes = region_size * kNumStreamRegions;
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glGenBuffers(1, &gl_tex.pbo);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, gl_tex.pbo);
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, num_bytes, nullptr, flags);
+        gl_tex.mapped = static_cast<byte*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, num_bytes, flags));
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        if(gl_tex.mapped == nullptr){
+            DestroyImageStream(gl_tex);
+            return;
+        }
+        gl_tex.region_size = region_size;
+        gl_tex.write = 0;
+    }
+
+    void DestroyImageStream(GLTexture& gl_tex){
+        for(GLsync& fence : gl_tex.fences){
+            if(fence != nullptr)
+                glDeleteSync(fence);
+            fence = nullptr;
+        }
+        if(gl_tex.pbo != 0){
+            if(gl_tex.mapped != nullptr){
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, gl_tex.pbo);
+                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            }
+            glDeleteBuffers(1, &gl_tex.pbo);
+        }
+        gl_tex.pbo = 0;
+        gl_tex.mapped = nullptr;
+        gl_tex.region_size = 0;
+        gl_tex.ready = gl_tex.write = gl_tex.acquired = -1;
+    }
 
-            texture_shader_->use();
-            BindRenderBuffer(vertices_texture, sizeof(vertices_texture), true, indices_texture,
-                            sizeof(indices_texture), GL_STATIC_DRAW, 0, 0, 0, true);
-            glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0);
+    //poll without blocking for a region neither in use nor still read by GPU
+    int FindIdleImageRegion(GLTexture& gl_tex){
+        for(int r = 0; r < kNumStreamRegions; r++){
+            if(r == gl_tex.ready || r == gl_tex.write || r == gl_tex.acquired)
+                continue;
+            GLsync& fence = gl_tex.fences[r];
+            if(fence != nullptr){
+                GLenum res = glClientWaitSync(fence, 0, 0);
+                if(res != GL_ALREADY_SIGNALED && res != GL_CONDITION_SATISFIED)
+                    continue;
+                glDeleteSync(fence);
+                fence = nullptr;
+            }
+            return r;
         }
+        return -1;
     }
 
     void DrawCube(){
-        BindRenderBuffer(vertices_cube, sizeof(vertices_cube));
+        glBindVertexArray(mesh_cube_.vao);
         plain_shader_->setMat4("model", model_);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        glDrawArrays(GL_TRIANGLES, 0, mesh_cube_.count);
     }
 
     void DrawCoordinateSystem(GLfloat line_width = 1.0f){
-        BindRenderBuffer(vertices_coordinates, sizeof(vertices_coordinates));
+        glBindVertexArray(mesh_coordinates_.vao);
         plain_shader_->setMat4("model", model_);
         glLineWidth(line_width);
-        glDrawArrays(GL_LINES, 0, 6);
+        glDrawArrays(GL_LINES, 0, mesh_coordinates_.count);
         glLineWidth(1.0f);
     }
 
     void DrawFrustum(GLfloat line_width = 1.0f){
         if(traj_.empty()) return;
-        BindRenderBuffer(vertices_frustum, sizeof(vertices_frustum), true,
-                         indices_frustum , sizeof(indices_frustum));
-        plain_shader_->setMat4("model", model_ * frustum_pose_);
+        glBindVertexArray(mesh_frustum_.vao);
         glLineWidth(line_width);
-        glDrawElements(GL_LINES, 16, GL_UNSIGNED_SHORT, 0);
+        if(rig_cameras_.empty()){
+            plain_shader_->setMat4("model", model_ * frustum_pose_);
+            glDrawElements(GL_LINES, mesh_frustum_.count, GL_UNSIGNED_SHORT, 0);
+        }
+        for(const RigCamera& camera : rig_cameras_){
+            plain_shader_->setMat4("model", model_ * frustum_pose_ * camera.extrinsics);
+            glDrawElements(GL_LINES, mesh_frustum_.count, GL_UNSIGNED_SHORT, 0);
+        }
         glLineWidth(1.0f);
     }
 
     void DrawGrids(GLfloat line_width = 1.0f){
-        BindRenderBuffer(vertices_grids, sizeof(vertices_grids), true,
-                         indices_grids , sizeof(indices_grids));
+        glBindVertexArray(mesh_grids_.vao);
         plain_shader_->setMat4("model", model_);
         glLineWidth(line_width);
-        glDrawElements(GL_LINES, sizeof(indices_grids) / sizeof(unsigned short),
-                       GL_UNSIGNED_SHORT, 0);
+        glDrawElements(GL_LINES, mesh_grids_.count, GL_UNSIGNED_SHORT, 0);
         glLineWidth(1.0f);
     }
 
     void DrawTrajectory(GLfloat line_width = 1.0f){
        if(traj_.empty()) return;
-       BindRenderBuffer(traj_.data(), traj_.size() * sizeof(glm::vec3));
+       glBindVertexArray(traj_vao_);
+       glBindBuffer(GL_ARRAY_BUFFER, traj_vbo_);
+       if(uploaded_version_traj_ != version_traj_){
+           glBufferData(GL_ARRAY_BUFFER, traj_.size() * sizeof(glm::vec3), traj_.data(), GL_DYNAMIC_DRAW);
+           BindVertexAttributes();
+           uploaded_version_traj_ = version_traj_;
+       }
        plain_shader_->setMat4("model", model_);
        glLineWidth(line_width);
        glDrawArrays(GL_LINE_STRIP, 0, traj_.size() / 2);// traj_.size() * 3 / 6
        glLineWidth(1.0f);
     }
 
-    void DrawPointCloud(GLfloat point_size = 1.0f){        
-        BindRenderBuffer(array_pcl_, size_pcl_ * stride_pcl_,
-                         false, nullptr, 0, GL_STATIC_DRAW,
-                         stride_pcl_, pos_off_pcl_, col_off_pcl_);
+    //upload only vertices in [uploaded_pcl_, size_pcl_) when the leading part is known unchanged,
+    //the buffer grows geometrically and keeps its resident content by copying on GPU side
+    void UploadPointCloud(){
+        glBindBuffer(GL_ARRAY_BUFFER, pcl_vbo_);
+        if(uploaded_version_pcl_ == version_pcl_)
+            return;
+        uploaded_version_pcl_ = version_pcl_;
+        if(usage_pcl_ != APPEND_DATA){
+            capacity_pcl_ = size_pcl_ * stride_pcl_;
+            glBufferData(GL_ARRAY_BUFFER, capacity_pcl_, array_pcl_, GL_STATIC_DRAW);
+            uploaded_pcl_ = size_pcl_;
+            uploaded_stride_pcl_ = stride_pcl_;
+            dirty_pcl_.clear();
+            //expects pcl_vao_ bound, which keeps the element buffer
+            const std::vector<uint32_t>& order = front_pcl_.order;
+            if(!order.empty()){
+                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pcl_ebo_);
+                glBufferData(GL_ELEMENT_ARRAY_BUFFER, order.size() * sizeof(uint32_t), order.data(),
+                             GL_STATIC_DRAW);
+            }
+            return;
+        }
+
+        size_t first = uploaded_pcl_;
+        if(stride_pcl_ != uploaded_stride_pcl_ || size_pcl_ < uploaded_pcl_)
+            first = 0;
+        const byte* src = static_cast<const byte*>(array_pcl_);
+        for(auto& range : dirty_pcl_){
+            size_t last = std::min(range.second, first);
+            if(range.first < last)
+                glBufferSubData(GL_ARRAY_BUFFER, range.first * stride_pcl_,
+                                (last - range.first) * stride_pcl_, src + range.first * stride_pcl_);
+        }
+        dirty_pcl_.clear();
+        if(first == size_pcl_)
+            return;
+
+        size_t num_bytes = size_pcl_ * stride_pcl_;
+        if(num_bytes > capacity_pcl_){
+            size_t capacity = std::max(num_bytes, capacity_pcl_ * kBufferGrowthFactor);
+            if(first > 0){
+                GLuint vbo;
+                glGenBuffers(1, &vbo);
+                glBindBuffer(GL_COPY_WRITE_BUFFER, vbo);
+                glBufferData(GL_COPY_WRITE_BUFFER, capacity, nullptr, GL_DYNAMIC_DRAW);
+                glBindBuffer(GL_COPY_READ_BUFFER, pcl_vbo_);
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0,
+                                    first * stride_pcl_);
+                glDeleteBuffers(1, &pcl_vbo_);
+                pcl_vbo_ = vbo;
+                glBindBuffer(GL_ARRAY_BUFFER, pcl_vbo_);
+            }else{
+                glBufferData(GL_ARRAY_BUFFER, capacity, nullptr, GL_DYNAMIC_DRAW);
+            }
+            capacity_pcl_ = capacity;
+        }
+        glBufferSubData(GL_ARRAY_BUFFER, first * stride_pcl_, (size_pcl_ - first) * stride_pcl_,
+                        static_cast<const byte*>(array_pcl_) + first * stride_pcl_);
+        uploaded_pcl_ = size_pcl_;
+        uploaded_stride_pcl_ = stride_pcl_;
+    }
+
+    virtual void* AcquireStreamMemory(size_t num_bytes) override{
+        if(stream_mapped_ == nullptr || stream_write_ < 0 || stream_acquired_ >= 0 ||
+           num_bytes > stream_region_size_)
+            return nullptr;
+        stream_acquired_ = stream_write_;
+        stream_write_ = -1;
+        return stream_mapped_ + stream_acquired_ * stream_region_size_;
+    }
+
+    virtual void CommitStreamMemory() override{
+        StreamRegion& region = stream_regions_[stream_acquired_];
+        region.num_vertices = size_pcl_;
+        region.stride = stride_pcl_;
+        region.pos_off = pos_off_pcl_;
+        region.col_off = col_off_pcl_;
+        region.nor_off = nor_off_pcl_;
+        region.version = version_pcl_;
+        //a ready region replaced before being drawn is not used by GPU, recycle it at once
+        stream_write_ = stream_ready_;
+        stream_ready_ = stream_acquired_;
+        stream_acquired_ = -1;
+        uploaded_version_pcl_ = version_pcl_;
+    }
+
+    void CreateStreamBuffer(size_t region_size){
+        DestroyStreamBuffer();
+        region_size = (region_size + kStreamRegionAlignment - 1) / kStreamRegionAlignment
+                      * kStreamRegionAlignment;
+        size_t num_bytes = region_size * kNumStreamRegions;
+        glGenBuffers(1, &stream_vbo_);
+        glBindBuffer(GL_ARRAY_BUFFER, stream_vbo_);
+        if(has_buffer_storage_){
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_ARRAY_BUFFER, num_bytes, nullptr, flags);
+            stream_mapped_ = static_cast<byte*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, num_bytes, flags));
+        }else{
+            glBufferData(GL_ARRAY_BUFFER, num_bytes, nullptr, GL_STREAM_DRAW);
+        }
+        stream_region_size_ = region_size;
+    }
+
+    void DestroyStreamBuffer(){
+        for(int i = 0; i < kNumStreamRegions; i++){
+            if(stream_regions_[i].fence != nullptr)
+                glDeleteSync(stream_regions_[i].fence);
+            stream_regions_[i] = StreamRegion();
+        }
+        if(stream_vbo_ != 0){
+            if(stream_mapped_ != nullptr){
+                glBindBuffer(GL_ARRAY_BUFFER, stream_vbo_);
+                glUnmapBuffer(GL_ARRAY_BUFFER);
+            }
+            glDeleteBuffers(1, &stream_vbo_);
+        }
+        stream_vbo_ = 0;
+        stream_mapped_ = nullptr;
+        stream_region_size_ = 0;
+        stream_front_ = stream_ready_ = stream_write_ = -1;
+    }
+
+    //poll without blocking whether GPU has finished reading the region
+    bool StreamRegionIdle(int r){
+        GLsync& fence = stream_regions_[r].fence;
+        if(fence == nullptr)
+            return true;
+        GLenum res = glClientWaitSync(fence, 0, 0);
+        if(res != GL_ALREADY_SIGNALED && res != GL_CONDITION_SATISFIED)
+            return false;
+        glDeleteSync(fence);
+        fence = nullptr;
+        return true;
+    }
+
+    int FindIdleStreamRegion(){
+        for(int i = 1; i <= kNumStreamRegions; i++){
+            int r = (std::max(stream_front_, 0) + i) % kNumStreamRegions;
+            if(r != stream_front_ && r != stream_ready_ && r != stream_write_ &&
+               r != stream_acquired_ && StreamRegionIdle(r))
+                return r;
+        }
+        return -1;
+    }
+
+    //copy bound vertices into a region on render thread when producer could not do it
+    void UploadStreamRegion(){
+        size_t num_bytes = size_pcl_ * stride_pcl_;
+        if(num_bytes > stream_region_size_){
+            //never unmap memory producer is writing to
+            if(stream_acquired_ >= 0) return;
+            CreateStreamBuffer(std::max(num_bytes, stream_region_size_ * kBufferGrowthFactor));
+        }
+
+        int r = stream_write_;
+        stream_write_ = -1;
+        if(r < 0)
+            r = FindIdleStreamRegion();
+        glBindBuffer(GL_ARRAY_BUFFER, stream_vbo_);
+        if(stream_mapped_ != nullptr){
+            if(r < 0) return; //all regions busy, keep drawing the old one instead of waiting
+            memcpy(stream_mapped_ + r * stream_region_size_, array_pcl_, num_bytes);
+            uploaded_version_pcl_ = version_pcl_;
+        }else{
+            GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+            if(r < 0){
+                //orphan the whole buffer, driver hands out fresh storage without stall
+                r = (std::max(stream_front_, 0) + 1) % kNumStreamRegions;
+                access |= GL_MAP_INVALIDATE_BUFFER_BIT;
+                for(int i = 0; i < kNumStreamRegions; i++){
+                    if(stream_regions_[i].fence != nullptr)
+                        glDeleteSync(stream_regions_[i].fence);
+                    stream_regions_[i].fence = nullptr;
+                }
+            }else{
+                access |= GL_MAP_INVALIDATE_RANGE_BIT;
+            }
+            void* dst = glMapBufferRange(GL_ARRAY_BUFFER, r * stream_region_size_, num_bytes, access);
+            if(dst == nullptr) return;
+            memcpy(dst, array_pcl_, num_bytes);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+            uploaded_version_pcl_ = version_pcl_;
+        }
+
+        StreamRegion& region = stream_regions_[r];
+        region.num_vertices = size_pcl_;
+        region.stride = stride_pcl_;
+        region.pos_off = pos_off_pcl_;
+        region.col_off = col_off_pcl_;
+        region.nor_off = nor_off_pcl_;
+        region.version = version_pcl_;
+        stream_front_ = r;
+    }
+
+    void DrawStreamedPointCloud(GLfloat point_size){
+        //the cloud was rebound without stream memory after the producer filled the ready
+        //region, which is dropped unused so that the bound array is copied this frame while
+        //it's still valid, rather than next frame
+        if(stream_ready_ >= 0 && stream_regions_[stream_ready_].version != version_pcl_)
+            stream_ready_ = -1;
+        if(stream_ready_ >= 0){
+            stream_front_ = stream_ready_;
+            stream_ready_ = -1;
+        }else if(uploaded_version_pcl_ != version_pcl_ && array_pcl_ != nullptr && size_pcl_ > 0){
+            UploadStreamRegion();
+        }
+        if(stream_front_ < 0) return;
+
+        StreamRegion& region = stream_regions_[stream_front_];
+        size_t base = stream_front_ * stream_region_size_;
+        glBindVertexArray(pcl_vao_);
+        glBindBuffer(GL_ARRAY_BUFFER, stream_vbo_);
+        GLsizei step = SubsampleStep(region.stride);
+        BindVertexAttributes(region.stride * step, base + region.pos_off, base + region.col_off, 3,
+                             GL_FLOAT, GL_FLOAT, region.nor_off < 0 ? -1 : long(base + region.nor_off));
+        plain_shader_->setMat4("model", model_);
+        GLsizei count = (region.num_vertices + step - 1) / step;
+        glPointSize(point_size);
+        glDrawArrays(GL_POINTS, 0, count);
+        glPointSize(1.0f);
+        stats_.points_drawn += count;
+
+        if(region.fence != nullptr)
+            glDeleteSync(region.fence);
+        region.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        if(stream_mapped_ != nullptr && stream_write_ < 0 && stream_acquired_ < 0)
+            stream_write_ = FindIdleStreamRegion();
+    }
+
+    void DrawPointChunks(GLfloat point_size = 1.0f){
+        //release GPU buffers of removed chunks
+        for(auto it = gl_chunks_.begin(); it != gl_chunks_.end();){
+            if(chunks_.count(it->first) == 0){
+                glDeleteVertexArrays(1, &it->second.vao);
+                glDeleteBuffers(1, &it->second.vbo);
+                it = gl_chunks_.erase(it);
+            }else
+                ++it;
+        }
+
+        glPointSize(point_size);
+        for(int id : cull_chunks_){
+            const PointChunk& chunk = chunks_.at(id);
+            GLsizei step = SubsampleStep(PointFormatStride(chunk.format));
+            GLChunk& gl_chunk = gl_chunks_[id];
+            if(gl_chunk.vao == 0){
+                glGenVertexArrays(1, &gl_chunk.vao);
+                glGenBuffers(1, &gl_chunk.vbo);
+            }
+            glBindVertexArray(gl_chunk.vao);
+            if(gl_chunk.uploaded_version != chunk.version){
+                glBindBuffer(GL_ARRAY_BUFFER, gl_chunk.vbo);
+                glBufferData(GL_ARRAY_BUFFER, chunk.vertices->size(),
+                             chunk.vertices->data(), GL_STATIC_DRAW);
+                gl_chunk.uploaded_version = chunk.version;
+                gl_chunk.step = 0;
+            }
+            if(gl_chunk.step != step){
+                glBindBuffer(GL_ARRAY_BUFFER, gl_chunk.vbo);
+                BindVertexAttributes(chunk.format, step);
+                gl_chunk.step = step;
+            }
+            plain_shader_->setMat4("model", model_ * chunk.pose * chunk.dequantization);
+            GLsizei count = (chunk.num_vertices + step - 1) / step;
+            glDrawArrays(GL_POINTS, 0, count);
+            stats_.points_drawn += count;
+        }
+        glPointSize(1.0f);
+    }
+
+    void DestroyTriangleMesh(GLTriangleMesh& mesh){
+        glDeleteVertexArrays(1, &mesh.vao);
+        glDeleteBuffers(1, &mesh.vbo);
+        glDeleteBuffers(1, &mesh.ebo);
+        mesh = GLTriangleMesh();
+    }
+
+    void DrawTriangleMeshes(){
+        //release buffers of meshes no longer present
+        for(auto it = gl_meshes_.begin(); it != gl_meshes_.end();){
+            if(meshes_.count(it->first) == 0){
+                DestroyTriangleMesh(it->second);
+                it = gl_meshes_.erase(it);
+            }else
+                ++it;
+        }
+        if(meshes_.empty())
+            return;
+
+        plain_shader_->setMat4("model", model_);
+        Frustum frustum(projection_ * view_ * model_);
+        for(auto it = meshes_.begin(); it != meshes_.end(); ++it){
+            const TriangleMesh& mesh = it->second;
+            ++stats_.blocks_tested;
+            if(!frustum.Intersects(mesh.box))
+                continue;
+            ++stats_.blocks_drawn;
+            GLTriangleMesh& gl_mesh = gl_meshes_[it->first];
+            if(gl_mesh.vao == 0){
+                glGenVertexArrays(1, &gl_mesh.vao);
+                glGenBuffers(1, &gl_mesh.vbo);
+                glGenBuffers(1, &gl_mesh.ebo);
+            }
+            glBindVertexArray(gl_mesh.vao);
+            if(gl_mesh.uploaded_version != mesh.version){
+                glBindBuffer(GL_ARRAY_BUFFER, gl_mesh.vbo);
+                glBufferData(GL_ARRAY_BUFFER, mesh.vertices.size() * sizeof(float),
+                             mesh.vertices.data(), GL_STATIC_DRAW);
+                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gl_mesh.ebo);
+                glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indices.size() * sizeof(uint32_t),
+                             mesh.indices.data(), GL_STATIC_DRAW);
+                BindVertexAttributes();
+                gl_mesh.count = mesh.indices.size();
+                gl_mesh.uploaded_version = mesh.version;
+            }
+            glDrawElements(GL_TRIANGLES, gl_mesh.count, GL_UNSIGNED_INT, 0);
+            stats_.triangles_drawn += gl_mesh.count / 3;
+        }
+    }
+
+    //collect depth frames inside the view frustum, return the number of their valid pixels
+    size_t CullDepthFrames(){
+        cull_depth_frames_.clear();
+        size_t num_points = 0;
+        for(auto it = depth_frames_.begin(); it != depth_frames_.end(); ++it){
+            const DepthFrame& frame = it->second;
+            ++stats_.blocks_tested;
+            if(frame.num_valid == 0 ||
+               !Frustum(projection_ * view_ * model_ * frame.pose).Intersects(frame.box))
+                continue;
+            ++stats_.blocks_drawn;
+            cull_depth_frames_.push_back(it->first);
+            num_points += frame.num_valid;
+        }
+        return num_points;
+    }
+
+    void UploadDepthFrame(DepthFrame& frame, GLDepthFrame& gl_frame){
+        const CameraIntrinsics& K = frame.intrinsics;
+        //rows of 16-bit depth or 3-channel color are not 4-byte aligned in general
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        if(gl_frame.depth_tex == 0)
+            gl_frame.depth_tex = CreateDepthFrameTexture();
+        glBindTexture(GL_TEXTURE_2D, gl_frame.depth_tex);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R16UI, K.width, K.height, 0,
+                     GL_RED_INTEGER, GL_UNSIGNED_SHORT, frame.depth.data());
+        if(frame.has_color){
+            if(gl_frame.color_tex == 0)
+                gl_frame.color_tex = CreateDepthFrameTexture();
+            bool alpha = frame.color_format == RGBA || frame.color_format == BGRA;
+            glBindTexture(GL_TEXTURE_2D, gl_frame.color_tex);
+            glTexImage2D(GL_TEXTURE_2D, 0, alpha ? GL_RGBA8 : GL_RGB8, K.width, K.height, 0,
+                         GLFormat(frame.color_format), GL_UNSIGNED_BYTE, frame.color.data());
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        gl_frame.uploaded_version = frame.version;
+        std::vector<uint16_t>().swap(frame.depth);
+        std::vector<byte>().swap(frame.color);
+    }
+
+    //pixels are fetched exactly, integer textures also require nearest filtering
+    GLuint CreateDepthFrameTexture(){
+        GLuint tex;
+        glGenTextures(1, &tex);
+        glBindTexture(GL_TEXTURE_2D, tex);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        return tex;
+    }
+
+    void DrawDepthFrames(GLfloat point_size = 1.0f){
+        //release textures of removed frames
+        for(auto it = gl_depth_frames_.begin(); it != gl_depth_frames_.end();){
+            if(depth_frames_.count(it->first) == 0){
+                glDeleteTextures(1, &it->second.depth_tex);
+                glDeleteTextures(1, &it->second.color_tex);
+                it = gl_depth_frames_.erase(it);
+            }else
+                ++it;
+        }
+        if(cull_depth_frames_.empty())
+            return;
+
+        depth_shader_->use();
+        depth_shader_->setMat4("view", view_);
+        depth_shader_->setMat4("projection", projection_);
+        depth_shader_->setInt("step", subsample_);
+        glBindVertexArray(depth_vao_);
+        glPointSize(point_size);
+        for(int id : cull_depth_frames_){
+            DepthFrame& frame = depth_frames_.at(id);
+            GLDepthFrame& gl_frame = gl_depth_frames_[id];
+            if(gl_frame.uploaded_version != frame.version)
+                UploadDepthFrame(frame, gl_frame);
+            const CameraIntrinsics& K = frame.intrinsics;
+            depth_shader_->setMat4("model", model_ * frame.pose);
+            depth_shader_->setVec4("intrinsics", glm::vec4(K.fx, K.fy, K.cx, K.cy));
+            depth_shader_->setVec3("depth_range", glm::vec3(1.0f / frame.range.factor,
+                                   frame.range.min_depth, frame.range.max_depth));
+            depth_shader_->setBool("has_color", frame.has_color);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, gl_frame.depth_tex);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, gl_frame.color_tex);
+            size_t num_pixels = (size_t)K.width * K.height;
+            glDrawArrays(GL_POINTS, 0, (num_pixels + subsample_ - 1) / subsample_);
+            stats_.points_drawn += frame.num_valid / subsample_;
+        }
+        glActiveTexture(GL_TEXTURE0);
+        glPointSize(1.0f);
+    }
+
+    //collect chunks inside the view frustum, return the number of their points
+    size_t CullPointChunks(){
+        cull_chunks_.clear();
+        size_t num_points = 0;
+        for(auto it = chunks_.begin(); it != chunks_.end(); ++it){
+            const PointChunk& chunk = it->second;
+            ++stats_.blocks_tested;
+            if(!Frustum(projection_ * view_ * model_ * chunk.pose).Intersects(chunk.box))
+                continue;
+            ++stats_.blocks_drawn;
+            cull_chunks_.push_back(it->first);
+            num_points += chunk.num_vertices;
+        }
+        return num_points;
+    }
+
+    void DrawLevelOfDetail(GLfloat point_size){
+        for(size_t i = front_pcl_.octree.NumNodes(); i < gl_lod_nodes_.size(); i++){
+            glDeleteVertexArrays(1, &gl_lod_nodes_[i].vao);
+            glDeleteBuffers(1, &gl_lod_nodes_[i].vbo);
+        }
+        gl_lod_nodes_.resize(front_pcl_.octree.NumNodes());
+
+        front_pcl_.octree.Select(view_ * model_, projection_, height_,
+                                 std::min(lod_budget_, point_budget_), lod_selection_);
         plain_shader_->setMat4("model", model_);
         glPointSize(point_size);
-        glDrawArrays(GL_POINTS, 0, size_pcl_);
+        for(int id : lod_selection_){
+            const PointOctree::Node& node = front_pcl_.octree.GetNode(id);
+            GLChunk& gl_node = gl_lod_nodes_[id];
+            if(gl_node.vao == 0){
+                glGenVertexArrays(1, &gl_node.vao);
+                glGenBuffers(1, &gl_node.vbo);
+            }
+            glBindVertexArray(gl_node.vao);
+            if(gl_node.uploaded_version != node.version){
+                glBindBuffer(GL_ARRAY_BUFFER, gl_node.vbo);
+                glBufferData(GL_ARRAY_BUFFER, node.vertices.size() * sizeof(float),
+                             node.vertices.data(), GL_DYNAMIC_DRAW);
+                BindVertexAttributes();
+                gl_node.uploaded_version = node.version;
+            }
+            glDrawArrays(GL_POINTS, 0, node.NumVertices());
+            gl_node.last_frame = frame_count_;
+            stats_.points_drawn += node.NumVertices();
+        }
         glPointSize(1.0f);
+
+        //keep GPU memory bounded by nodes in use rather than the whole map
+        for(GLChunk& gl_node : gl_lod_nodes_){
+            if(gl_node.vao != 0 && gl_node.last_frame + kLodEvictFrames < frame_count_){
+                glDeleteVertexArrays(1, &gl_node.vao);
+                glDeleteBuffers(1, &gl_node.vbo);
+                gl_node = GLChunk();
+            }
+        }
+    }
+
+    void DrawPointCloud(GLfloat point_size = 1.0f){
+        if(lod_budget_ > 0){
+            DrawLevelOfDetail(point_size);
+            return;
+        }
+        if(usage_pcl_ == STREAM_DATA){
+            DrawStreamedPointCloud(point_size);
+            return;
+        }
+        if(array_pcl_ == nullptr || size_pcl_ == 0) return;
+        glBindVertexArray(pcl_vao_);
+        UploadPointCloud();
+        if(cull_firsts_.empty())
+            return;
+        plain_shader_->setMat4("model", model_);
+        glPointSize(point_size);
+        if(!front_pcl_.order.empty()){
+            //every block is a shuffled group of vertices in pcl_ebo_, a prefix of it is an
+            //even sample of the block
+            BindVertexAttributes(stride_pcl_, pos_off_pcl_, col_off_pcl_, 3, GL_FLOAT, GL_FLOAT,
+                                 nor_off_pcl_);
+            cull_offsets_.resize(cull_firsts_.size());
+            for(size_t i = 0; i < cull_firsts_.size(); i++){
+                cull_offsets_[i] = (const GLvoid*)(cull_firsts_[i] * sizeof(uint32_t));
+                cull_counts_[i] = GLsizei((cull_counts_[i] + subsample_ - 1) / subsample_);
+                stats_.points_drawn += cull_counts_[i];
+            }
+            glMultiDrawElements(GL_POINTS, cull_counts_.data(), GL_UNSIGNED_INT,
+                                cull_offsets_.data(), cull_counts_.size());
+            glPointSize(1.0f);
+            return;
+        }
+        GLsizei step = SubsampleStep(stride_pcl_);
+        BindVertexAttributes(stride_pcl_ * step, pos_off_pcl_, col_off_pcl_, 3, GL_FLOAT,
+                             GL_FLOAT, nor_off_pcl_);
+
+        //with a widened stride vertex i of a draw is bound vertex i * step, so ranges shrink
+        //to the indices of multiples of step they contain
+        for(size_t i = 0; i < cull_firsts_.size(); i++){
+            GLint last = cull_firsts_[i] + cull_counts_[i];
+            cull_firsts_[i] = (cull_firsts_[i] + step - 1) / step;
+            cull_counts_[i] = (last + step - 1) / step - cull_firsts_[i];
+            stats_.points_drawn += cull_counts_[i];
+        }
+        glMultiDrawArrays(GL_POINTS, cull_firsts_.data(), cull_counts_.data(), cull_firsts_.size());
+        glPointSize(1.0f);
+    }
+
+    //collect ranges of bound vertices, or of their order if grouped, in blocks intersecting
+    //the view frustum, merging adjacent ones into one range unless each block is subsampled on
+    //its own; return the number of points to draw before subsampling
+    size_t CullPointCloud(){
+        cull_firsts_.clear();
+        cull_counts_.clear();
+        if(lod_budget_ > 0)
+            return 0;
+        if(usage_pcl_ == STREAM_DATA)
+            return size_pcl_;
+        if(array_pcl_ == nullptr)
+            return 0;
+        //a cloud bound without culling blocks is drawn whole
+        if(front_pcl_.blocks.empty()){
+            if(size_pcl_ > 0){
+                cull_firsts_.push_back(0);
+                cull_counts_.push_back(size_pcl_);
+            }
+            return size_pcl_;
+        }
+
+        Frustum frustum(projection_ * view_ * model_);
+        size_t num_points = 0;
+        bool grouped = !front_pcl_.order.empty();
+        size_t num_blocks = std::min(front_pcl_.blocks.size(),
+                                     (size_pcl_ + kCullingBlockSize - 1) / kCullingBlockSize);
+        for(size_t b = 0; b < num_blocks; b++){
+            ++stats_.blocks_tested;
+            if(!frustum.Intersects(front_pcl_.blocks[b]))
+                continue;
+            ++stats_.blocks_drawn;
+            GLint first = b * kCullingBlockSize;
+            GLsizei count = std::min(kCullingBlockSize, size_pcl_ - first);
+            if(!grouped && !cull_counts_.empty() &&
+               cull_firsts_.back() + cull_counts_.back() == first)
+                cull_counts_.back() += count;
+            else{
+                cull_firsts_.push_back(first);
+                cull_counts_.push_back(count);
+            }
+            num_points += count;
+        }
+        return num_points;
+    }
+
+    //feed back GPU time of the frame timed kNumFrameTimers frames ago if it has finished
+    void ReadFrameTimer(FrameTimer& timer){
+        if(!timer.pending)
+            return;
+        timer.pending = false;
+        GLint available = 0;
+        glGetQueryObjectiv(timer.query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if(!available || timer.points < kMinTimedPoints)
+            return;
+        GLuint64 gpu_time = 0;
+        glGetQueryObjectui64v(timer.query, GL_QUERY_RESULT, &gpu_time);
+        //software implementations rasterize while commands are issued, so take the larger
+        double cost = std::max(gpu_time * 1e-9, timer.cpu_time);
+        if(cost <= 0)
+            return;
+        double rate = timer.points / cost;
+        points_per_second_ = points_per_second_ > 0 ?
+                    points_per_second_ + kThroughputSmoothing * (rate - points_per_second_) : rate;
+    }
+
+    //choose how many points this frame may draw and the subsampling step reaching it,
+    //all points are drawn once the view has not changed for kSettleFrames frames
+    void UpdatePointBudget(){
+        glm::mat4 mvp = projection_ * view_ * model_;
+        still_frames_ = mvp == last_mvp_ ? still_frames_ + 1 : 0;
+        last_mvp_ = mvp;
+
+        point_budget_ = std::numeric_limits<size_t>::max();
+        if(still_frames_ < kSettleFrames){
+            if(target_frame_time_ > 0 && points_per_second_ > 0)
+                point_budget_ = std::max(kMinPointBudget,
+                                         size_t(points_per_second_ * target_frame_time_));
+            if(max_point_budget_ > 0)
+                point_budget_ = std::min(point_budget_, max_point_budget_);
+        }
+        if(point_budget_ != std::numeric_limits<size_t>::max())
+            stats_.point_budget = point_budget_;
+
+        size_t num_points = CullPointCloud() + CullPointChunks() + CullDepthFrames();
+        subsample_ = num_points > point_budget_ ?
+                    (num_points + point_budget_ - 1) / point_budget_ : 1;
+    }
+
+    //a stride step uniform over the array keeps the same points from frame to frame
+    GLsizei SubsampleStep(GLsizei stride) const{
+        return std::max<GLsizei>(1, std::min<GLsizei>(subsample_, kMaxAttribStride / stride));
     }
 
 };
@@ -932,7 +3105,6 @@ public:
                     const char* frag_shader_src, const char* win_name, GraphicAPI api) :
         ImplDRViewerBase(x, y, z, width, height, api) {}
     virtual bool ShouldExit() const override { return true;}
-    virtual void CreateTexture(SubWindowPos pos) override {}
     void Render() override{}
 
     virtual ~ImplDRViewerVLK(){}
@@ -945,7 +3117,6 @@ public:
                     const char* frag_shader_src, const char* win_name, GraphicAPI api) :
         ImplDRViewerBase(x, y, z, width, height, api) {}
     virtual bool ShouldExit() const override { return true;}
-    virtual void CreateTexture(SubWindowPos pos) override {}
     void Render() override{}
 
     virtual ~ImplDRViewerMTL(){}
@@ -999,18 +3170,103 @@ public:
     bool ShouldExit() const {return impl_->ShouldExit();}
     void Render() {impl_->Render();}
     void BindPoinCloudData(const void* data, size_t num_vertices,
-                           int stride, int pos_off, int col_off){
+                           int stride, int pos_off, int col_off, DataUsage usage, int nor_off){
         impl_->BindPointCloudData(data, num_vertices,stride,
-                                  pos_off, col_off);
+                                  pos_off, col_off, usage, nor_off);
     }
     void BindImageData(const byte *data, int width, int height,
                       ImageFormat format, SubWindowPos sub_win){
         impl_->BindImageData(data, width, height, format, sub_win);
     }
+    void EnableImageStreaming(bool enable){
+        impl_->EnableImageStreaming(enable);
+    }
     void AddCameraPose(glm::quat& rotation, const glm::vec3& position,
                        const glm::vec3& color=glm::vec3(1.0f,1.0f,1.0f)){
         impl_->AddCameraPose(rotation, position, color);
     }
+    void AddPointChunk(int id, const void* data, size_t num_vertices,
+                       int stride, int pos_off, int col_off, PointFormat format){
+        impl_->AddPointChunk(id, data, num_vertices, stride, pos_off, col_off, format);
+    }
+    int AddRigCamera(const CameraIntrinsics& intrinsics, const glm::mat4& extrinsics,
+                     const DepthRange& range){
+        return impl_->AddRigCamera(intrinsics, extrinsics, range);
+    }
+    void SubmitRigFrames(int id, const RigFrame* frames, size_t num_frames,
+                         const glm::mat4& body_pose, PointFormat format){
+        impl_->SubmitRigFrames(id, frames, num_frames, body_pose, format);
+    }
+    void SetChunkPose(int id, const glm::mat4& pose){
+        impl_->SetChunkPose(id, pose);
+    }
+    void RemoveChunk(int id){
+        impl_->RemoveChunk(id);
+    }
+    void UpdateKeyframePoses(const int* ids, const float* poses, size_t count){
+        impl_->UpdateKeyframePoses(ids, poses, count);
+    }
+    size_t ExportPointChunks(float* out, size_t capacity){
+        return impl_->ExportPointChunks(out, capacity);
+    }
+    void BindDepthFrame(int id, const uint16_t* depth, const byte* color, ImageFormat color_format,
+                        const CameraIntrinsics& intrinsics, const glm::mat4& pose,
+                        const DepthRange& range){
+        impl_->BindDepthFrame(id, depth, color, color_format, intrinsics, pose, range);
+    }
+    void SetDepthFramePose(int id, const glm::mat4& pose){
+        impl_->SetDepthFramePose(id, pose);
+    }
+    void RemoveDepthFrame(int id){
+        impl_->RemoveDepthFrame(id);
+    }
+    void EnableFusion(float voxel_size, float truncation){
+        impl_->EnableFusion(voxel_size, truncation);
+    }
+    void EnableSurfelFusion(bool enable){
+        impl_->EnableSurfelFusion(enable);
+    }
+    void FuseDepthFrame(const uint16_t* depth, const byte* color, ImageFormat color_format,
+                        const CameraIntrinsics& intrinsics, const glm::mat4& pose,
+                        const DepthRange& range){
+        impl_->FuseDepthFrame(depth, color, color_format, intrinsics, pose, range);
+    }
+    void EnableLevelOfDetail(size_t point_budget){
+        impl_->EnableLevelOfDetail(point_budget);
+    }
+    void EnableSpatialGrouping(bool enable){
+        impl_->EnableSpatialGrouping(enable);
+    }
+    void EnableCloudCulling(bool enable){
+        impl_->EnableCloudCulling(enable);
+    }
+    void EnableVoxelFilter(float voxel_size){
+        impl_->EnableVoxelFilter(voxel_size);
+    }
+    void EnableOutlierFilter(int min_neighbors){
+        impl_->EnableOutlierFilter(min_neighbors);
+    }
+    void SetTargetFrameRate(float fps){
+        impl_->SetTargetFrameRate(fps);
+    }
+    void EnableSpatialIndex(bool enable){
+        impl_->EnableSpatialIndex(enable);
+    }
+    bool PickPoint(int x, int y, float* point){
+        return impl_->PickPoint(x, y, point);
+    }
+    size_t Nearest(const float* p, size_t k, float* out){
+        return impl_->Nearest(p, k, out);
+    }
+    size_t QueryBox(const float* lower, const float* upper, float* out, size_t capacity){
+        return impl_->QueryBox(lower, upper, out, capacity);
+    }
+    void SetPointBudget(size_t max_points){
+        impl_->SetPointBudget(max_points);
+    }
+    RenderStats GetRenderStats() const{
+        return impl_->GetRenderStats();
+    }
     void Wait(unsigned int milliseconds){
         impl_->Wait(milliseconds);
     }
@@ -1041,8 +3297,9 @@ DRViewer::~DRViewer() = default;
 
 
 void DRViewer::BindPoinCloudData(const void *data, size_t num_vertices,
-                                 int stride, int pos_off, int col_off){
-    impl_->BindPoinCloudData(data, num_vertices, stride, pos_off, col_off);
+                                 int stride, int pos_off, int col_off, DataUsage usage,
+                                 int nor_off){
+    impl_->BindPoinCloudData(data, num_vertices, stride, pos_off, col_off, usage, nor_off);
 }
 
 void DRViewer::BindImageData(const byte *data, int width, int height,
@@ -1050,6 +3307,10 @@ void DRViewer::BindImageData(const byte *data, int width, int height,
     impl_->BindImageData(data, width, height, format, sub_win);
 }
 
+void DRViewer::EnableImageStreaming(bool enable){
+    impl_->EnableImageStreaming(enable);
+}
+
 void DRViewer::AddCameraPose(float qw, float qx, float qy, float qz,
                              float  x, float  y, float z){
     glm::quat r(qw, qx, qy, qz);
@@ -1057,6 +3318,138 @@ void DRViewer::AddCameraPose(float qw, float qx, float qy, float qz,
     impl_->AddCameraPose(r, t);
 }
 
+void DRViewer::AddPointChunk(int id, const void *data, size_t num_vertices,
+                             int stride, int pos_off, int col_off, PointFormat format){
+    impl_->AddPointChunk(id, data, num_vertices, stride, pos_off, col_off, format);
+}
+
+void DRViewer::SetChunkPose(int id, float qw, float qx, float qy, float qz,
+                            float x, float y, float z){
+    glm::mat4 pose = glm::mat4(glm::quat(qw, qx, qy, qz));
+    pose[3] = glm::vec4(x, y, z, 1.0f);
+    impl_->SetChunkPose(id, pose);
+}
+
+void DRViewer::SetChunkPose(int id, const float *pose){
+    glm::mat4 m(1.0f);
+    if(pose != nullptr)
+        memcpy(&m[0][0], pose, 16 * sizeof(float));
+    impl_->SetChunkPose(id, m);
+}
+
+void DRViewer::RemoveChunk(int id){
+    impl_->RemoveChunk(id);
+}
+
+void DRViewer::UpdateKeyframePoses(const int *ids, const float *poses, size_t count){
+    impl_->UpdateKeyframePoses(ids, poses, count);
+}
+
+size_t DRViewer::ExportPointChunks(float *out, size_t capacity){
+    return impl_->ExportPointChunks(out, capacity);
+}
+
+int DRViewer::AddRigCamera(const CameraIntrinsics &intrinsics, const float *extrinsics,
+                           const DepthRange &range){
+    glm::mat4 m(1.0f);
+    if(extrinsics != nullptr)
+        memcpy(&m[0][0], extrinsics, 16 * sizeof(float));
+    return impl_->AddRigCamera(intrinsics, m, range);
+}
+
+void DRViewer::SubmitRigFrames(int id, const RigFrame *frames, size_t num_frames,
+                               const float *body_pose, PointFormat format){
+    glm::mat4 m(1.0f);
+    if(body_pose != nullptr)
+        memcpy(&m[0][0], body_pose, 16 * sizeof(float));
+    impl_->SubmitRigFrames(id, frames, num_frames, m, format);
+}
+
+void DRViewer::BindDepthFrame(int id, const uint16_t *depth, const byte *color,
+                              ImageFormat color_format, const CameraIntrinsics &intrinsics,
+                              const float *pose, const DepthRange &range){
+    glm::mat4 m(1.0f);
+    if(pose != nullptr)
+        memcpy(&m[0][0], pose, 16 * sizeof(float));
+    impl_->BindDepthFrame(id, depth, color, color_format, intrinsics, m, range);
+}
+
+void DRViewer::SetDepthFramePose(int id, const float *pose){
+    glm::mat4 m(1.0f);
+    if(pose != nullptr)
+        memcpy(&m[0][0], pose, 16 * sizeof(float));
+    impl_->SetDepthFramePose(id, m);
+}
+
+void DRViewer::RemoveDepthFrame(int id){
+    impl_->RemoveDepthFrame(id);
+}
+
+void DRViewer::EnableFusion(float voxel_size, float truncation){
+    impl_->EnableFusion(voxel_size, truncation);
+}
+
+void DRViewer::EnableSurfelFusion(bool enable){
+    impl_->EnableSurfelFusion(enable);
+}
+
+void DRViewer::FuseDepthFrame(const uint16_t *depth, const byte *color,
+                              ImageFormat color_format, const CameraIntrinsics &intrinsics,
+                              const float *pose, const DepthRange &range){
+    glm::mat4 m(1.0f);
+    if(pose != nullptr)
+        memcpy(&m[0][0], pose, 16 * sizeof(float));
+    impl_->FuseDepthFrame(depth, color, color_format, intrinsics, m, range);
+}
+
+void DRViewer::EnableLevelOfDetail(size_t point_budget){
+    impl_->EnableLevelOfDetail(point_budget);
+}
+
+void DRViewer::EnableSpatialGrouping(bool enable){
+    impl_->EnableSpatialGrouping(enable);
+}
+
+void DRViewer::EnableCloudCulling(bool enable){
+    impl_->EnableCloudCulling(enable);
+}
+
+void DRViewer::EnableVoxelFilter(float voxel_size){
+    impl_->EnableVoxelFilter(voxel_size);
+}
+
+void DRViewer::EnableOutlierFilter(int min_neighbors){
+    impl_->EnableOutlierFilter(min_neighbors);
+}
+
+void DRViewer::SetTargetFrameRate(float fps){
+    impl_->SetTargetFrameRate(fps);
+}
+
+void DRViewer::SetPointBudget(size_t max_points){
+    impl_->SetPointBudget(max_points);
+}
+
+RenderStats DRViewer::GetRenderStats() const{
+    return impl_->GetRenderStats();
+}
+
+void DRViewer::EnableSpatialIndex(bool enable){
+    impl_->EnableSpatialIndex(enable);
+}
+
+bool DRViewer::PickPoint(int x, int y, float* point){
+    return impl_->PickPoint(x, y, point);
+}
+
+size_t DRViewer::Nearest(const float* p, size_t k, float* out){
+    return impl_->Nearest(p, k, out);
+}
+
+size_t DRViewer::QueryBox(const float* lower, const float* upper, float* out, size_t capacity){
+    return impl_->QueryBox(lower, upper, out, capacity);
+}
+
 void DRViewer::Render(){
     impl_->Render();
 }
@@ -2,6 +2,7 @@
 #define DRVIEWER_H
 
 #include <memory>
+#include <cstdint>
 
 namespace visual_utils{
 
@@ -21,6 +22,21 @@ enum ImageFormat{
     RGB = 0, BGR = 1, RGBA = 3, BGRA = 4
 };
 
+enum DataUsage{
+    STATIC_DATA = 0,    //whole array may change between two bindings, re-upload it entirely
+    APPEND_DATA = 1,    //vertices bound previously stay untouched, only the tail is new
+    STREAM_DATA = 2,    //whole array changes every frame, copied into rotating mapped GPU memory
+    MERGE_DATA = 3      //array holds new vertices only, merged into a copy kept by the viewer,
+                        //so it may be released after binding
+};
+
+enum PointFormat{        //storage of points on GPU, converted from float input on ingest
+    POINT_F32_RGB_F32 = 0, //|x y z r g b| as floats, 24 bytes per point
+    POINT_F32_RGBA8 = 1,   //float position and rgba8 color, 16 bytes per point
+    POINT_U16_RGBA8 = 2    //position as 16-bit fixed point in the chunk's bounding box and
+                           //rgba8 color, 12 bytes per point
+};
+
 enum SubWindowPos{  //---------------------
     TOP_LEFT1,      //|1|2|           |1|2|
     TOP_LEFT2,      //|----           ----|
@@ -32,6 +48,37 @@ enum SubWindowPos{  //---------------------
     DOWN_RIGHT2     //---------------------
 };
 
+//statistics of the last rendered frame
+struct RenderStats{
+    size_t blocks_tested = 0;  //point blocks and chunks tested against the view frustum
+    size_t blocks_drawn = 0;   //those found visible
+    size_t points_drawn = 0;
+    size_t triangles_drawn = 0;
+    size_t point_budget = 0;   //points allowed while the view moves, 0 when all are drawn
+    size_t images_uploaded = 0;   //sub-window images sent to GPU
+    size_t images_streamed = 0;   //those copied by GPU from pixel buffers the producer filled
+    double image_upload_time = 0; //in milliseconds, CPU time spent issuing the uploads
+};
+
+//pinhole camera of a depth map
+struct CameraIntrinsics{
+    int width, height;
+    float fx, fy, cx, cy;
+};
+
+struct DepthRange{
+    float factor = 1.0f;      //raw depth values per meter, e.g. 5000 for TUM, 1000 for Kinect
+    float min_depth = 1e-6f;  //in meters, pixels out of [min_depth, max_depth] are dropped
+    float max_depth = 1e6f;
+};
+
+//frame of one rig camera, frames captured together are passed in the order cameras were added
+struct RigFrame{
+    const uint16_t* depth = nullptr;   //null skips the camera
+    const byte* color = nullptr;       //null for white points
+    ImageFormat color_format = RGB;
+};
+
 class DRViewer{
 public:
     DRViewer(float cam_x = 0,float cam_y = 0, float cam_z = 0,
@@ -53,16 +100,190 @@ public:
 
     //each least indivisible element in the data array must be of float type
     //default layout of data array is like: ...|x y z r g b|x y z r g b|...
+    //with APPEND_DATA only vertices in [last num_vertices, num_vertices) are uploaded, so the
+    //array may be reallocated(e.g. std::vector growing) as long as its leading part is unchanged
+    //normal_offset locates an optional normal(3 floats) per vertex, points with a nonzero
+    //normal are shaded by the default shader under a light at the eye; -1 means no normals;
+    //normals are not kept by MERGE_DATA, the voxel filter or level of detail
     void BindPoinCloudData(const void* data, size_t num_vertices, int stride = 6*sizeof(float),
-                           int position_offset = 0, int color_offset = 3 * sizeof(float));
+                           int position_offset = 0, int color_offset = 3 * sizeof(float),
+                           DataUsage usage = STATIC_DATA, int normal_offset = -1);
+    //show an image in a sub-window; it's copied in parallel without holding the viewer's
+    //lock, so rendering is not blocked meanwhile, and drawn at its own resolution scaled by
+    //GPU; only images beyond the largest texture size are shrunk on CPU first
     void BindImageData(const byte* data, int width, int height, ImageFormat format, SubWindowPos win = DOWN_LEFT1);
+    //copy images of an unchanged size and format straight into pixel buffers the GPU uploads
+    //them from asynchronously, where supported; disabled, Render uploads every image from CPU
+    //memory; on by default
+    void EnableImageStreaming(bool enable = true);
     void AddCameraPose(float qw, float qx, float qy, float qz, float x, float y, float z);
+    //keep bound point cloud in an octree and draw at most point_budget points per frame,
+    //preferring detail close to the camera; 0 disables level of detail
+    void EnableLevelOfDetail(size_t point_budget = 5000000);
+    //draw STATIC_DATA point clouds with vertices grouped by space, so that view frustum culling
+    //skips more of them; every binding then sorts the array on CPU, so it pays off for clouds
+    //bound once and viewed long rather than rebound every frame; off by default
+    void EnableSpatialGrouping(bool enable = true);
+    //test blocks of the bound point cloud against the view frustum and draw only visible ones;
+    //disabled, the cloud is drawn whole and binding skips building the blocks, e.g. for a
+    //cloud rebound every frame that stays in view; on by default
+    void EnableCloudCulling(bool enable = true);
+    //keep one point per voxel of the given size in the viewer's own copy of the point cloud,
+    //colors of points falling into an occupied voxel are averaged; 0 disables deduplication
+    void EnableVoxelFilter(float voxel_size);
+    //with the voxel filter, drop a point opening a voxel when fewer than min_neighbors of
+    //the 26 voxels around it are occupied once its batch is merged, so isolated noise never
+    //reaches the GPU; 0 disables outlier removal
+    void EnableOutlierFilter(int min_neighbors);
+    //while the view is moving draw only as many points as keep frame time below 1/fps,
+    //measured from recent frames; the full set is drawn again once the view stops;
+    //0 disables frame rate control
+    void SetTargetFrameRate(float fps);
+    //upper bound of points drawn per frame while the view is moving, 0 means unbounded
+    void SetPointBudget(size_t max_points);
+    RenderStats GetRenderStats() const;
+
+    //keep a spatial hash over the bound point cloud(chunks and depth frames are left out) for
+    //the queries below, which find nothing while it's disabled; only the tail of APPEND_DATA
+    //and merged clouds is indexed on binding, other bindings rebuild it, and STREAM_DATA
+    //clouds are not indexed; points are reported in the layout |x y z r g b|
+    void EnableSpatialIndex(bool enable = true);
+    //find the bound point drawn closest to the viewer within a few pixels of framebuffer
+    //position (x, y) from the top left corner, as of the last frame; return false if none
+    bool PickPoint(int x, int y, float* point);
+    //write up to k bound points nearest to position p(|x y z|) into out, closest first;
+    //return the number of points found
+    size_t Nearest(const float* p, size_t k, float* out);
+    //return the number of bound points inside the box given by its lower and upper corners,
+    //they are written into out only if it's not null and they don't exceed capacity
+    size_t QueryBox(const float* lower, const float* upper, float* out, size_t capacity);
+
+    //point chunks(e.g. submaps) are copied into the viewer and each drawn with its own rigid
+    //pose, so moving a chunk only changes a uniform instead of re-uploading its points;
+    //adding a chunk with an existing id replaces its points and keeps its pose;
+    //input layout is the same as BindPoinCloudData, format selects how points are kept on GPU
+    void AddPointChunk(int id, const void* data, size_t num_vertices, int stride = 6*sizeof(float),
+                       int position_offset = 0, int color_offset = 3 * sizeof(float),
+                       PointFormat format = POINT_F32_RGB_F32);
+    void SetChunkPose(int id, float qw, float qx, float qy, float qz, float x, float y, float z);
+    //pose is a column-major 4x4 rigid transform from chunk frame to world frame, identity if
+    //null
+    void SetChunkPose(int id, const float* pose);
+    void RemoveChunk(int id);
+    //keyframe-anchored storage: keep the points of each keyframe as a chunk or depth frame in
+    //keyframe coordinates under the keyframe's id, then after a pose graph optimization move
+    //them all at once; poses holds count column-major 4x4 transforms to world frame, applied
+    //to chunks and depth frames of the given ids by the next frame, unknown ids are skipped
+    void UpdateKeyframePoses(const int* ids, const float* poses, size_t count);
+    //write points of all chunks transformed to world frame into out in the default layout
+    //|x y z r g b|, chunks are processed in parallel; return the number of points, nothing is
+    //written when out is null or they exceed capacity; only chunks are exported, depth frames
+    //keep no images on CPU once uploaded, so keyframes meant to be exported must be chunks
+    size_t ExportPointChunks(float* out, size_t capacity);
+
+    //cameras of a multi-camera rig, extrinsics is a column-major 4x4 from camera frame to the
+    //body frame(identity if null) whose pose AddCameraPose sets; once a camera is added a
+    //frustum is drawn per camera instead of one for the body; return index of the camera
+    int AddRigCamera(const CameraIntrinsics& intrinsics, const float* extrinsics,
+                     const DepthRange& range = DepthRange());
+    //back-project a synchronized set of num_frames frames, one per rig camera, in parallel per
+    //camera into point chunk id in body frame, drawn at body_pose(column-major 4x4 from body
+    //frame to world frame, identity if null) and movable by SetChunkPose; cameras beyond
+    //num_frames are skipped; an existing chunk id is replaced
+    void SubmitRigFrames(int id, const RigFrame* frames, size_t num_frames, const float* body_pose,
+                         PointFormat format = POINT_F32_RGB_F32);
+
+    //depth frames(e.g. keyframes) stay on GPU as depth and color textures and are turned into
+    //points by the vertex shader, so binding one uploads 2 bytes of depth per pixel besides
+    //color, and moving one only changes a uniform; the viewer's copy of the images is freed
+    //once they're uploaded; binding an existing id replaces it;
+    //pose is a column-major 4x4 from camera frame to world frame, identity if null
+    void BindDepthFrame(int id, const uint16_t* depth, const byte* color, ImageFormat color_format,
+                        const CameraIntrinsics& intrinsics, const float* pose,
+                        const DepthRange& range = DepthRange());
+    //pose is the same as BindDepthFrame, identity if null
+    void SetDepthFramePose(int id, const float* pose);
+    void RemoveDepthFrame(int id);
+
+    //fuse depth frames into a truncated signed distance field with voxels of given size and
+    //draw its surface as triangles, each frame only remeshes the voxel blocks it touched;
+    //truncation is how far around observed surfaces the field is updated, 0 picks four
+    //voxels; 0 voxel size disables fusion and drops the surface
+    void EnableFusion(float voxel_size, float truncation = 0.0f);
+    //fuse depth frames into surfels shown as the bound point cloud instead of accumulating
+    //all their points: pixels agreeing with a surfel already seen there refine it weighted by
+    //confidence and only uncovered pixels add surfels, so the cloud stops growing on revisits
+    //and only refined parts are re-uploaded; disabling drops the surfels
+    void EnableSurfelFusion(bool enable = true);
+    //arguments are the same as BindDepthFrame, frames go to whichever of surface and surfel
+    //fusion is enabled, integration runs in the calling thread
+    void FuseDepthFrame(const uint16_t* depth, const byte* color, ImageFormat color_format,
+                        const CameraIntrinsics& intrinsics, const float* pose,
+                        const DepthRange& range = DepthRange());
 
 private:
     class Impl;
     std::unique_ptr<Impl> impl_;
 };
 
+//back-project a row-major depth map into points in the viewer's default vertex layout
+//|x y z r g b|, transformed by pose(column-major 4x4 from camera frame to world frame,
+//identity if null); color is an image of the same size in given format, points are white
+//if it's null; out must hold width * height vertices, return number of vertices written
+//in row-major pixel order
+size_t DepthToPointCloud(const uint16_t* depth, const byte* color, ImageFormat color_format,
+                         const CameraIntrinsics& intrinsics, const float* pose, float* out,
+                         const DepthRange& range = DepthRange());
+size_t DepthToPointCloud(const float* depth, const byte* color, ImageFormat color_format,
+                         const CameraIntrinsics& intrinsics, const float* pose, float* out,
+                         const DepthRange& range = DepthRange());
+//same as DepthToPointCloud with a unit normal following every vertex, |x y z r g b nx ny nz|,
+//so out must hold width * height * 9 floats; normals come from neighboring pixels of the
+//depth map and face the camera, they are zero on image borders, next to invalid pixels and
+//across depth discontinuities; bind the result with normal offset 6 * sizeof(float)
+size_t DepthToOrientedPointCloud(const uint16_t* depth, const byte* color, ImageFormat color_format,
+                                 const CameraIntrinsics& intrinsics, const float* pose, float* out,
+                                 const DepthRange& range = DepthRange());
+size_t DepthToOrientedPointCloud(const float* depth, const byte* color, ImageFormat color_format,
+                                 const CameraIntrinsics& intrinsics, const float* pose, float* out,
+                                 const DepthRange& range = DepthRange());
+
+//bilinear resize of an image with interleaved channels(3 or 4) from raw_width x raw_height
+//to width x height, both axes scaled by raw_width / width; vertical then horizontal blends
+//run in fixed point, tables of the columns are kept per thread for the last pair of widths
+void ResizeImage(const byte* src, int raw_width, int raw_height, int channels,
+                 byte* dst, int width, int height);
+
+//stages of DepthFilter, they run in this order
+struct DepthFilterOptions{
+    int median_radius = 1;             //1 for a 3x3 median of valid pixels, 2 for 5x5, 0 skips
+                                       //it; invalid pixels stay invalid
+    float edge_ratio = 0.04f;          //drop pixels whose 4-neighbor differs in depth by more
+                                       //than this fraction, the flying pixels of silhouettes;
+                                       //0 skips it
+    float bilateral_sigma = 0.0f;      //spatial sigma in pixels of edge-preserving smoothing,
+                                       //0 skips it
+    float bilateral_depth_ratio = 0.01f; //depth sigma as a fraction of the pixel's depth
+};
+
+//cleans raw depth maps before back-projection, zero is invalid everywhere; frames are
+//split into row bands filtered in parallel, and scratch buffers are kept between frames,
+//so keep one filter per stream and apply it from one thread at a time
+class DepthFilter{
+public:
+    explicit DepthFilter(const DepthFilterOptions& options = DepthFilterOptions());
+    ~DepthFilter();
+
+    void SetOptions(const DepthFilterOptions& options);
+    //out holds width * height values and may be depth itself
+    void Apply(const uint16_t* depth, int width, int height, uint16_t* out);
+
+private:
+    struct Scratch;
+    DepthFilterOptions options_;
+    std::unique_ptr<Scratch> scratch_;
+};
+
 }
 
 
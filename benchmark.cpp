@@ -0,0 +1,664 @@
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <functional>
+#include <algorithm>
+#include <cmath>
+#include "DRViewer.h"
+#include "point_index.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+#include <cstring>
+#ifdef __SSE4_1__
+#include <smmintrin.h>
+#endif
+
+using namespace std;
+using namespace visual_utils;
+
+constexpr int WIDTH = 640;
+constexpr int HEIGHT = 480;
+constexpr int REPEAT = 100;
+
+//average milliseconds of a call over REPEAT runs, after one warming run
+double TimeIt(const std::function<void()>& fn){
+    fn();
+    auto start = chrono::steady_clock::now();
+    for(int i = 0; i < REPEAT; i++)
+        fn();
+    chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+    return elapsed.count() / REPEAT;
+}
+
+//milliseconds of a single call, for calls too slow or stateful to repeat
+double TimeOnce(const std::function<void()>& fn){
+    auto start = chrono::steady_clock::now();
+    fn();
+    chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+/*----------------------------depth to point cloud----------------------------*/
+
+constexpr float FX = 525.0;
+constexpr float FY = 525.0;
+constexpr float CX = 319.5;
+constexpr float CY = 239.5;
+constexpr float DEPTH_FACTOR = 5000;
+constexpr float MAX_DEPTH = 2.0f;
+
+struct Vertex {
+    glm::vec3 position;
+    glm::vec3 color;
+
+    Vertex(const glm::vec3 pos, const glm::vec3 col):
+        position(pos), color(col) {}
+};
+
+//per-pixel loop the demo used before DepthToPointCloud
+void DemoLoop(const byte* image, const uint16_t* depth, const glm::mat3& R, const glm::vec3 T,
+              std::vector<Vertex>& pcl){
+    for(int y = 0; y < HEIGHT; y++){
+        const byte* row_i = image + y * WIDTH * 3;
+        const uint16_t* row_d = depth + y * WIDTH;
+        for(int x = 0; x < WIDTH; x++){
+             float d = (float)row_d[x] / DEPTH_FACTOR;
+             if(d < 1e-6 || d > MAX_DEPTH) continue;
+             glm::vec3 pos = R * glm::vec3(d * (x - CX) / FX, d * (y - CY) / FY, d) + T;
+             glm::vec3 col((float)row_i[x*3 + 2] / 255., (float)row_i[x*3 + 1] / 255., (float)row_i[x*3] / 255.);
+             pcl.emplace_back(pos, col);
+        }
+    }
+}
+
+//slanted plane with holes and far pixels, like a typical indoor frame
+void SyntheticFrame(std::vector<uint16_t>& depth, std::vector<byte>& image){
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<int> noise(0, 99);
+    depth.resize(WIDTH * HEIGHT);
+    image.resize(WIDTH * HEIGHT * 3);
+    for(int y = 0; y < HEIGHT; y++){
+        for(int x = 0; x < WIDTH; x++){
+            int r = noise(rng);
+            depth[y * WIDTH + x] = r < 10 ? 0 : uint16_t(4000 + 10 * x + 5 * y + r);
+            for(int c = 0; c < 3; c++)
+                image[(y * WIDTH + x) * 3 + c] = byte(x + y + c);
+        }
+    }
+}
+
+constexpr float DISCONTINUITY_RATIO = 0.05f; //the library's, no normal across larger steps
+
+//compare normals of DepthToOrientedPointCloud with the normalized cross product of central
+//differences between back-projected neighbors computed in double, and check they face the
+//camera; return the number of vertices whose normal is missing, unexpected or off by more
+//than 0.1 degree
+size_t CheckNormals(const std::vector<uint16_t>& depth, const glm::mat3& R, const glm::vec3& T,
+                    const std::vector<float>& oriented, size_t n){
+    const float scale = 1.0f / DEPTH_FACTOR;
+    auto depth_at = [&](int x, int y){ return depth[y * WIDTH + x] * scale; };
+    auto valid = [&](float d){ return d >= 1e-6f && d <= MAX_DEPTH; };
+    auto point = [&](int x, int y){
+        double d = depth_at(x, y), p[3] = {d * (x - CX) / FX, d * (y - CY) / FY, d}, w[3];
+        for(int i = 0; i < 3; i++)
+            w[i] = R[0][i] * p[0] + R[1][i] * p[1] + R[2][i] * p[2] + T[i];
+        return std::vector<double>(w, w + 3);
+    };
+    size_t i = 0, mismatches = 0;
+    double max_angle = 0.0;
+    for(int y = 0; y < HEIGHT; y++){
+        for(int x = 0; x < WIDTH; x++){
+            float c = depth_at(x, y);
+            if(!valid(c))
+                continue;
+            const float* normal = &oriented[9 * i++ + 6];
+            bool expected = x > 0 && x + 1 < WIDTH && y > 0 && y + 1 < HEIGHT;
+            if(expected){
+                float l = depth_at(x - 1, y), r = depth_at(x + 1, y);
+                float u = depth_at(x, y - 1), b = depth_at(x, y + 1);
+                expected = valid(l) && valid(r) && valid(u) && valid(b) &&
+                           std::fabs(r - l) <= c * DISCONTINUITY_RATIO &&
+                           std::fabs(b - u) <= c * DISCONTINUITY_RATIO;
+            }
+            if(!expected){
+                mismatches += normal[0] != 0 || normal[1] != 0 || normal[2] != 0;
+                continue;
+            }
+            std::vector<double> h = point(x + 1, y), v = point(x, y + 1), p = point(x, y);
+            std::vector<double> h0 = point(x - 1, y), v0 = point(x, y - 1);
+            for(int k = 0; k < 3; k++){
+                h[k] -= h0[k];
+                v[k] -= v0[k];
+            }
+            double ref[3] = {v[1] * h[2] - v[2] * h[1], v[2] * h[0] - v[0] * h[2],
+                             v[0] * h[1] - v[1] * h[0]};
+            double len = std::sqrt(ref[0] * ref[0] + ref[1] * ref[1] + ref[2] * ref[2]);
+            double dot = 0.0, facing = 0.0;
+            for(int k = 0; k < 3; k++){
+                dot += normal[k] * ref[k] / len;
+                facing += normal[k] * (T[k] - p[k]);
+            }
+            double angle = std::acos(std::min(std::max(dot, -1.0), 1.0)) * 180.0 / M_PI;
+            max_angle = std::max(max_angle, angle);
+            mismatches += !(angle <= 0.1) || !(facing > 0.0);
+        }
+    }
+    cout << "DepthToOrientedPointCloud normals: " << mismatches << "/" << n
+         << " differ from cross products of neighbors, max angle " << max_angle << " degrees"
+         << endl;
+    return mismatches + (i != n);
+}
+
+bool BenchmarkDepthToPointCloud(){
+    std::vector<uint16_t> depth;
+    std::vector<byte> image;
+    SyntheticFrame(depth, image);
+    glm::quat q = glm::normalize(glm::quat(0.9f, 0.1f, -0.3f, 0.2f));
+    glm::mat3 R(q);
+    glm::vec3 T(0.5f, -1.0f, 2.0f);
+    glm::mat4 pose(R);
+    pose[3] = glm::vec4(T, 1.0f);
+
+    std::vector<Vertex> pcl;
+    double demo_ms = TimeIt([&](){
+        pcl.clear();
+        DemoLoop(image.data(), depth.data(), R, T, pcl);
+    });
+
+    CameraIntrinsics intrinsics = {WIDTH, HEIGHT, FX, FY, CX, CY};
+    DepthRange range;
+    range.factor = DEPTH_FACTOR;
+    range.max_depth = MAX_DEPTH;
+    std::vector<float> out(WIDTH * HEIGHT * 6);
+    size_t n = 0;
+    double lib_ms = TimeIt([&](){
+        n = DepthToPointCloud(depth.data(), image.data(), BGR, intrinsics, &pose[0][0],
+                              out.data(), range);
+    });
+
+    std::vector<float> oriented(WIDTH * HEIGHT * 9);
+    double normals_ms = TimeIt([&](){
+        DepthToOrientedPointCloud(depth.data(), image.data(), BGR, intrinsics, &pose[0][0],
+                                  oriented.data(), range);
+    });
+
+    float max_error = 0;
+    for(size_t i = 0; i < n && i < pcl.size(); i++){
+        for(int k = 0; k < 3; k++){
+            max_error = std::max(max_error, std::fabs(out[i * 6 + k] - pcl[i].position[k]));
+            max_error = std::max(max_error, std::fabs(out[i * 6 + 3 + k] - pcl[i].color[k]));
+        }
+    }
+    cout << "DepthToPointCloud " << WIDTH << "x" << HEIGHT << ": demo loop " << demo_ms
+         << " ms, library " << lib_ms << " ms, " << n << "/" << pcl.size()
+         << " points, max difference " << max_error << endl;
+    cout << "DepthToOrientedPointCloud " << WIDTH << "x" << HEIGHT << ": " << normals_ms
+         << " ms" << endl;
+    return CheckNormals(depth, R, T, oriented, n) == 0;
+}
+
+/*--------------------------------depth filter--------------------------------*/
+
+void BenchmarkDepthFilter(){
+    std::vector<uint16_t> depth, filtered(WIDTH * HEIGHT);
+    std::vector<byte> image;
+    SyntheticFrame(depth, image);
+
+    struct Setting{
+        const char* name;
+        int median_radius;
+        float edge_ratio, bilateral_sigma;
+    };
+    const Setting settings[] = {{"median 3x3", 1, 0.0f, 0.0f}, {"median 5x5", 2, 0.0f, 0.0f},
+                                {"edge rejection", 0, 0.04f, 0.0f}, {"bilateral sigma 2", 0, 0.0f, 2.0f},
+                                {"median 3x3 + edge + bilateral", 1, 0.04f, 2.0f}};
+    for(const Setting& setting : settings){
+        DepthFilterOptions options;
+        options.median_radius = setting.median_radius;
+        options.edge_ratio = setting.edge_ratio;
+        options.bilateral_sigma = setting.bilateral_sigma;
+        DepthFilter filter(options);
+        double ms = TimeIt([&](){
+            filter.Apply(depth.data(), WIDTH, HEIGHT, filtered.data());
+        });
+        cout << "DepthFilter " << setting.name << " " << WIDTH << "x" << HEIGHT << ": " << ms
+             << " ms, " << WIDTH * HEIGHT / ms * 1e-3 << " Mpixel/s" << endl;
+    }
+}
+
+//median of the valid pixels around every valid pixel by sorting them, the reference of the
+//median stage of DepthFilter
+void ReferenceMedian(const std::vector<uint16_t>& depth, int width, int height, int r,
+                     std::vector<uint16_t>& out){
+    out.assign(depth.size(), 0);
+    std::vector<uint16_t> valid;
+    for(int y = 0; y < height; y++){
+        for(int x = 0; x < width; x++){
+            if(depth[y * width + x] == 0)
+                continue;
+            valid.clear();
+            for(int v = std::max(y - r, 0); v <= std::min(y + r, height - 1); v++){
+                for(int u = std::max(x - r, 0); u <= std::min(x + r, width - 1); u++){
+                    if(depth[v * width + u] != 0)
+                        valid.push_back(depth[v * width + u]);
+                }
+            }
+            std::sort(valid.begin(), valid.end());
+            out[y * width + x] = valid[valid.size() / 2];
+        }
+    }
+}
+
+//compare the median stage with ReferenceMedian on frames whose widths leave columns to the
+//scalar code after the 8-wide vectorized blocks, with ties, holes and the largest depth
+bool CheckDepthMedian(){
+    const int sizes[][2] = {{WIDTH, HEIGHT}, {643, 37}, {13, 5}, {3, 3}};
+    const float hole_rates[] = {0.0f, 0.3f, 0.9f};
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    size_t num_vector = 0, num_scalar = 0, vector_diffs = 0, scalar_diffs = 0;
+    for(int r = 1; r <= 2; r++){
+        DepthFilterOptions options;
+        options.median_radius = r;
+        options.edge_ratio = 0.0f;
+        options.bilateral_sigma = 0.0f;
+        DepthFilter filter(options);
+        for(const auto& size : sizes){
+            const int width = size[0], height = size[1], vector_width = width / 8 * 8;
+            for(float hole_rate : hole_rates){
+                std::vector<uint16_t> depth(width * height), filtered(depth.size()), expected;
+                for(uint16_t& d : depth){
+                    float u = uniform(rng);
+                    d = u < hole_rate ? 0 : (u < hole_rate + 0.05f ? 65535 : uint16_t(1 + rng() % 500));
+                }
+                filter.Apply(depth.data(), width, height, filtered.data());
+                ReferenceMedian(depth, width, height, r, expected);
+                for(int i = 0; i < width * height; i++){
+                    bool vector = i % width < vector_width;
+                    (vector ? num_vector : num_scalar)++;
+                    (vector ? vector_diffs : scalar_diffs) += filtered[i] != expected[i];
+                }
+            }
+        }
+    }
+    cout << "DepthFilter median check: " << vector_diffs << "/" << num_vector
+         << " pixels of 8-wide blocks and " << scalar_diffs << "/" << num_scalar
+         << " pixels of tail columns differ from sorting valid neighbors" << endl;
+    return vector_diffs == 0 && scalar_diffs == 0;
+}
+
+/*--------------------------------image resize--------------------------------*/
+
+//SSE kernel DRViewer resized sub-window images with before ResizeImage
+void LegacyMapPixels(byte* __restrict__ dst, const byte* __restrict__ src, int width, int height,
+               int raw_width, int raw_height, int channels, float factor){
+#ifdef __SSE4_1__
+    static const __m128i offset_x = _mm_set_epi32(3,2,1,0);
+    const __m128 fs = _mm_set1_ps(factor);
+    const __m128i chs = _mm_set1_epi32(channels);
+    const __m128i widths =_mm_set1_epi32(width * channels);
+    const __m128i strides = _mm_set1_epi32(raw_width * channels);
+
+    const int aligned_stride = width / 4 * 4;
+    int32_t* lxly_buf = (int32_t*)_mm_malloc(sizeof(int32_t) * 4, 16);
+    int32_t* uxly_buf = (int32_t*)_mm_malloc(sizeof(int32_t) * 4, 16);
+    int32_t* lxuy_buf = (int32_t*)_mm_malloc(sizeof(int32_t) * 4, 16);
+    int32_t* uxuy_buf = (int32_t*)_mm_malloc(sizeof(int32_t) * 4, 16);
+    int32_t* xys_buf = (int32_t*)_mm_malloc(sizeof(int32_t) * 4, 16);
+    float* res_buf = (float*)_mm_malloc(sizeof(float) * 4, 16);
+#endif
+    for(int y = 0; y < height; y++){
+        int x = 0;
+#ifdef __SSE4_1__ //accelerate computation using SSE
+        __m128i yss = _mm_set1_epi32(y);
+        __m128 ysd = _mm_mul_ps(_mm_cvtepi32_ps(yss), fs);
+        __m128i ws = _mm_mullo_epi32(yss, widths);
+
+        __m128 ly = _mm_round_ps(ysd, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+        __m128 uy = _mm_add_ps(ly, _mm_set1_ps(1.0f));
+        __m128 ucy = _mm_sub_ps(uy, ysd);
+        __m128 cly = _mm_sub_ps(ysd, ly);
+        __m128i lyi = _mm_cvtps_epi32(ly);
+        __m128i uyi = _mm_cvtps_epi32(uy);
+        __m128i wl = _mm_mullo_epi32(strides, lyi);
+        __m128i wu = _mm_mullo_epi32(strides, uyi);
+        for(; x < aligned_stride; x += 4){
+            __m128i xss = _mm_add_epi32(_mm_set1_epi32(x), offset_x);
+            __m128i xys = _mm_add_epi32(ws, _mm_mullo_epi32(xss, chs));
+            __m128 xsd = _mm_mul_ps(_mm_cvtepi32_ps(xss), fs);
+
+            __m128 lx = _mm_round_ps(xsd, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+            __m128 ux = _mm_add_ps(lx, _mm_set1_ps(1.0f));
+            __m128 ucx = _mm_sub_ps(ux, xsd);
+            __m128 clx = _mm_sub_ps(xsd, lx);
+            __m128i lxi = _mm_cvtps_epi32(lx);
+            __m128i uxi = _mm_cvtps_epi32(ux);
+
+            __m128i lxlyi = _mm_add_epi32(wl, _mm_mullo_epi32(lxi, chs));
+            __m128i uxlyi = _mm_add_epi32(wl, _mm_mullo_epi32(uxi, chs));
+            __m128i lxuyi = _mm_add_epi32(wu, _mm_mullo_epi32(lxi, chs));
+            __m128i uxuyi = _mm_add_epi32(wu, _mm_mullo_epi32(uxi, chs));
+
+            for(int c=0; c < channels; c++){
+                //gather
+                __m128i c4 = _mm_set1_epi32(c);
+                _mm_store_si128((__m128i*)lxly_buf, _mm_add_epi32(lxlyi, c4));
+                _mm_store_si128((__m128i*)uxly_buf, _mm_add_epi32(uxlyi, c4));
+                _mm_store_si128((__m128i*)lxuy_buf, _mm_add_epi32(lxuyi, c4));
+                _mm_store_si128((__m128i*)uxuy_buf, _mm_add_epi32(uxuyi, c4));
+                __m128 intensities_lxly = _mm_set_ps(src[lxly_buf[3]],src[lxly_buf[2]],src[lxly_buf[1]],src[lxly_buf[0]]);
+                __m128 intensities_uxly = _mm_set_ps(src[uxly_buf[3]],src[uxly_buf[2]],src[uxly_buf[1]],src[uxly_buf[0]]);
+                __m128 intensities_lxuy = _mm_set_ps(src[lxuy_buf[3]],src[lxuy_buf[2]],src[lxuy_buf[1]],src[lxuy_buf[0]]);
+                __m128 intensities_uxuy = _mm_set_ps(src[uxuy_buf[3]],src[uxuy_buf[2]],src[uxuy_buf[1]],src[uxuy_buf[0]]);
+
+                __m128 ll = _mm_mul_ps(intensities_lxly, _mm_mul_ps(ucx, ucy));
+                __m128 ul = _mm_mul_ps(intensities_uxly, _mm_mul_ps(clx, ucy));
+                __m128 lu = _mm_mul_ps(intensities_lxuy, _mm_mul_ps(ucx, cly));
+                __m128 uu = _mm_mul_ps(intensities_uxuy, _mm_mul_ps(clx, cly));
+                __m128 res = _mm_add_ps(_mm_add_ps(ll, ul),_mm_add_ps(lu, uu));
+
+                //scatter
+                _mm_store_si128((__m128i*)xys_buf, _mm_add_epi32(xys, c4));
+                _mm_store_ps(res_buf, res);
+                dst[xys_buf[0]] = (byte)res_buf[0];
+                dst[xys_buf[1]] = (byte)res_buf[1];
+                dst[xys_buf[2]] = (byte)res_buf[2];
+                dst[xys_buf[3]] = (byte)res_buf[3];
+            }
+        }
+#endif
+
+        for(; x < width; x++){
+            float px = factor * x;
+            float py = factor * y;
+            int ix = (int)px;
+            int iy = (int)py;
+            float dx = px - (float)ix;
+            float dy = py - (float)iy;
+            for(int c = 0; c < channels; c++)
+                dst[(y * width + x)*channels + c] = (1 - dx)*(1 - dy)*src[(iy*raw_width + ix) * channels + c] +
+                                                    dx*(1 - dy)*src[(iy*raw_width + ix + 1) * channels + c] +
+                                                    dy*(1 - dx)*src[((iy + 1)*raw_width + ix) * channels + c] +
+                                                    dx*dy*src[((iy+1)*raw_width + ix + 1) * channels + c];
+        }
+    }
+
+#ifdef __SSE4_1__
+    _mm_free(lxly_buf);
+    _mm_free(uxly_buf);
+    _mm_free(lxuy_buf);
+    _mm_free(uxuy_buf);
+    _mm_free(xys_buf);
+    _mm_free(res_buf);
+#endif
+}
+
+void BenchmarkResizeImage(){
+    const int sizes[][2] = {{1920, 1080}, {1280, 720}};
+    for(const auto& size : sizes){
+        for(int channels = 3; channels <= 4; channels++){
+            int raw_width = size[0], raw_height = size[1];
+            float factor = (float)raw_width / WIDTH;
+            int height = raw_height / factor;
+            std::vector<byte> src((size_t)raw_width * raw_height * channels);
+            std::mt19937 rng(7);
+            for(byte& b : src)
+                b = byte(rng());
+            std::vector<byte> legacy((size_t)WIDTH * height * channels), out(legacy.size());
+            double legacy_ms = TimeIt([&](){
+                LegacyMapPixels(legacy.data(), src.data(), WIDTH, height, raw_width, raw_height,
+                                channels, factor);
+            });
+            double lib_ms = TimeIt([&](){
+                ResizeImage(src.data(), raw_width, raw_height, channels, out.data(), WIDTH, height);
+            });
+            int max_error = 0;
+            for(size_t i = 0; i < out.size(); i++)
+                max_error = std::max(max_error, std::abs((int)out[i] - (int)legacy[i]));
+            cout << "ResizeImage " << raw_width << "x" << raw_height << "->" << WIDTH << "x" << height
+                 << " " << channels << " channels: old kernel " << legacy_ms << " ms, library "
+                 << lib_ms << " ms, max difference " << max_error << endl;
+        }
+    }
+}
+
+/*--------------------------------spatial index--------------------------------*/
+
+constexpr size_t FRAME_POINTS = WIDTH * HEIGHT;
+constexpr size_t NUM_QUERIES = 200;
+constexpr size_t NEAREST_K = 8;
+
+//rolling terrain of 100x100 m sampled at random, with a few stray points far off it
+void SyntheticTerrain(size_t num, std::vector<glm::vec3>& points){
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> coord(-50.0f, 50.0f), noise(-0.01f, 0.01f);
+    points.resize(num);
+    for(glm::vec3& p : points){
+        float x = coord(rng), y = coord(rng);
+        p = glm::vec3(x, y, 2.0f * std::sin(0.1f * x) * std::cos(0.1f * y) + noise(rng));
+    }
+    for(size_t i = 0; i < 4 && i < num; i++)
+        points[i * (num / 4)] = glm::vec3(i % 2 ? 2e4f : -2e4f, 5e3f * i, 100.0f);
+}
+
+//squared distances of the k points nearest to q, closest first
+std::vector<float> BruteNearest(const std::vector<glm::vec3>& points, const glm::vec3& q, size_t k){
+    std::vector<float> d2(points.size());
+    for(size_t i = 0; i < points.size(); i++){
+        glm::vec3 v = points[i] - q;
+        d2[i] = glm::dot(v, v);
+    }
+    k = std::min(k, d2.size());
+    std::partial_sort(d2.begin(), d2.begin() + k, d2.end());
+    d2.resize(k);
+    return d2;
+}
+
+//compare queries of index over points with brute force on num_checked of them, return the
+//number of mismatching queries
+size_t CheckPointIndex(const PointIndex& index, const std::vector<glm::vec3>& points,
+                       const std::vector<glm::vec3>& queries, const std::vector<AABB>& boxes,
+                       size_t num_checked){
+    const int stride = sizeof(glm::vec3);
+    size_t mismatches = 0;
+    std::vector<uint32_t> indices;
+    for(size_t i = 0; i < num_checked && i < queries.size(); i++){
+        index.Nearest(queries[i], NEAREST_K, points.data(), stride, 0, indices);
+        std::vector<float> d2(indices.size());
+        for(size_t j = 0; j < indices.size(); j++){
+            glm::vec3 v = points[indices[j]] - queries[i];
+            d2[j] = glm::dot(v, v);
+        }
+        mismatches += d2 != BruteNearest(points, queries[i], NEAREST_K);
+    }
+    for(size_t i = 0; i < num_checked && i < boxes.size(); i++){
+        index.QueryBox(boxes[i], points.data(), stride, 0, indices);
+        std::sort(indices.begin(), indices.end());
+        std::vector<uint32_t> expected;
+        for(size_t j = 0; j < points.size(); j++){
+            if(boxes[i].Contains(points[j]))
+                expected.push_back(j);
+        }
+        mismatches += indices != expected;
+    }
+    return mismatches;
+}
+
+//index the terrain in one batch and as frames appended after a single point, the first
+//batch of which used to fix the cell size; time queries and check them against brute force
+bool BenchmarkPointIndex(size_t num_points, size_t num_checked){
+    std::vector<glm::vec3> points;
+    SyntheticTerrain(num_points, points);
+    const int stride = sizeof(glm::vec3);
+
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<float> coord(-60.0f, 60.0f), side(0.5f, 10.0f);
+    std::vector<glm::vec3> queries(NUM_QUERIES);
+    std::vector<AABB> boxes(NUM_QUERIES);
+    for(size_t i = 0; i < NUM_QUERIES; i++){
+        queries[i] = glm::vec3(coord(rng), coord(rng), coord(rng) * 0.1f);
+        glm::vec3 lower(coord(rng), coord(rng), -3.0f);
+        boxes[i] = AABB(lower, lower + glm::vec3(side(rng), side(rng), 6.0f));
+    }
+    queries[0] = glm::vec3(1e6f, -1e6f, 0.0f);
+    boxes[0] = AABB(glm::vec3(-1e30f), glm::vec3(1e30f));
+
+    bool ok = true;
+    for(int appended = 0; appended < 2; appended++){
+        PointIndex index;
+        double insert_ms = TimeOnce([&](){
+            if(!appended){
+                index.Insert(points.data(), points.size(), stride, 0);
+                return;
+            }
+            index.Insert(points.data(), 1, stride, 0);
+            for(size_t n = 1; n < points.size();)
+                index.Insert(points.data(), n = std::min(n + FRAME_POINTS, points.size()), stride, 0);
+        });
+        std::vector<uint32_t> indices;
+        double nearest_ms = TimeOnce([&](){
+            for(const glm::vec3& q : queries)
+                index.Nearest(q, NEAREST_K, points.data(), stride, 0, indices);
+        });
+        size_t num_found = 0;
+        double box_ms = TimeOnce([&](){
+            for(const AABB& box : boxes){
+                index.QueryBox(box, points.data(), stride, 0, indices);
+                num_found += indices.size();
+            }
+        });
+        size_t mismatches = CheckPointIndex(index, points, queries, boxes, num_checked);
+        ok = ok && mismatches == 0;
+        cout << "PointIndex " << num_points << " points " << (appended ? "appended" : "one batch")
+             << ": insert " << insert_ms << " ms, cell " << index.CellSize() << " m, nearest "
+             << NEAREST_K << " " << nearest_ms * 1e3 / NUM_QUERIES << " us, box "
+             << box_ms * 1e3 / NUM_QUERIES << " us(" << num_found / NUM_QUERIES
+             << " points), " << mismatches << "/" << 2 * std::min(num_checked, NUM_QUERIES)
+             << " queries differ from brute force" << endl;
+    }
+    return ok;
+}
+
+/*----------------------------rendering----------------------------*/
+
+//rendering needs a display, it's timed only when the benchmark is run with --gl
+constexpr int NUM_FRAMES = 300;
+constexpr size_t LIVE_POINTS = 1000000;
+
+struct FrameTimes{
+    double bind = 0, frame = 0, worst = 0;
+
+    void Add(double bind_ms, double frame_ms){
+        bind += bind_ms / NUM_FRAMES;
+        frame += frame_ms / NUM_FRAMES;
+        worst = std::max(worst, frame_ms);
+    }
+};
+
+//a cloud changing entirely every frame, like a live scan, bound with usage and drawn;
+//frames are not paced by the display, so the GPU copy shows in frame time
+FrameTimes TimeLiveCloud(DRViewer& viewer, DataUsage usage){
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<float> coord(-2.0f, 2.0f), color(0.0f, 1.0f);
+    std::vector<float> cloud(LIVE_POINTS * 6);
+    for(size_t i = 0; i < LIVE_POINTS; i++){
+        float* v = &cloud[i * 6];
+        v[0] = coord(rng);
+        v[1] = coord(rng);
+        v[2] = 0.2f * std::sin(3.0f * v[0]) * std::cos(3.0f * v[1]);
+        v[3] = color(rng);
+        v[4] = color(rng);
+        v[5] = color(rng);
+    }
+    FrameTimes times;
+    for(int f = -1; f < NUM_FRAMES; f++){
+        float shift = f % 2 ? 0.01f : -0.01f;
+        for(size_t i = 0; i < LIVE_POINTS; i++)
+            cloud[i * 6 + 2] += shift;
+        double bind_ms = TimeOnce([&](){ viewer.BindPoinCloudData(cloud.data(), LIVE_POINTS,
+                                         6 * sizeof(float), 0, 3 * sizeof(float), usage); });
+        double render_ms = TimeOnce([&](){ viewer.Render(); });
+        if(f >= 0)
+            times.Add(bind_ms, bind_ms + render_ms);
+    }
+    return times;
+}
+
+//camera feeds of 1280x720 shown in NUM_FEEDS sub-windows, all replaced every frame; with
+//image streaming disabled Render uploads them from CPU memory, as every image was before
+//pixel buffers
+constexpr int NUM_FEEDS = 4;
+constexpr int FEED_WIDTH = 1280;
+constexpr int FEED_HEIGHT = 720;
+
+FrameTimes TimeCameraFeeds(DRViewer& viewer, bool streamed, double& upload_ms,
+                           size_t& num_streamed){
+    const SubWindowPos windows[NUM_FEEDS] = {TOP_LEFT1, TOP_RIGHT1, DOWN_LEFT1, DOWN_RIGHT1};
+    std::vector<byte> feed((size_t)FEED_WIDTH * FEED_HEIGHT * 3);
+    for(size_t i = 0; i < feed.size(); i++)
+        feed[i] = byte(i * 7 % 251);
+    FrameTimes times;
+    upload_ms = 0;
+    num_streamed = 0;
+    viewer.EnableImageStreaming(streamed);
+    for(int f = -1; f < NUM_FRAMES; f++){
+        double bind_ms = TimeOnce([&](){
+            for(int i = 0; i < NUM_FEEDS; i++)
+                viewer.BindImageData(feed.data(), FEED_WIDTH, FEED_HEIGHT, BGR, windows[i]);
+        });
+        double render_ms = TimeOnce([&](){ viewer.Render(); });
+        if(f < 0)
+            continue;
+        times.Add(bind_ms, bind_ms + render_ms);
+        RenderStats stats = viewer.GetRenderStats();
+        upload_ms += stats.image_upload_time / NUM_FRAMES;
+        num_streamed += stats.images_streamed;
+    }
+    return times;
+}
+
+void BenchmarkRendering(){
+    //without culling blocks a static cloud is re-uploaded whole and drawn as is, the path
+    //STREAM_DATA replaces
+    const char* names[] = {"STATIC_DATA without culling", "STREAM_DATA"};
+    DataUsage usages[] = {STATIC_DATA, STREAM_DATA};
+    //windows are kept until exit, one shows the clouds and another the feeds
+    DRViewer viewer(0, 0, 5, 1280, 720, "benchmark");
+    glfwSwapInterval(0);
+    viewer.EnableCloudCulling(false);
+    for(int i = 0; i < 2; i++){
+        FrameTimes times = TimeLiveCloud(viewer, usages[i]);
+        cout << "Live cloud of " << LIVE_POINTS << " points with " << names[i] << ": frame "
+             << times.frame << " ms(binding " << times.bind << " ms), worst " << times.worst
+             << " ms" << endl;
+    }
+    DRViewer feeds_viewer(0, 0, 5, 1280, 720, "benchmark");
+    glfwSwapInterval(0);
+    for(int streamed = 0; streamed < 2; streamed++){
+        double upload_ms = 0;
+        size_t num_streamed = 0;
+        FrameTimes times = TimeCameraFeeds(feeds_viewer, streamed, upload_ms, num_streamed);
+        cout << NUM_FEEDS << " camera feeds of " << FEED_WIDTH << "x" << FEED_HEIGHT << " "
+             << (streamed ? "streamed" : "uploaded from CPU") << ": frame " << times.frame
+             << " ms(binding " << times.bind << " ms, Render issuing uploads " << upload_ms
+             << " ms), worst " << times.worst << " ms, " << num_streamed << "/"
+             << NUM_FEEDS * NUM_FRAMES << " images streamed" << endl;
+    }
+}
+
+int main(int argc, char** argv){
+    bool ok = true;
+    ok = BenchmarkDepthToPointCloud() && ok;
+    BenchmarkDepthFilter();
+    ok = CheckDepthMedian() && ok;
+    BenchmarkResizeImage();
+    ok = BenchmarkPointIndex(1000000, NUM_QUERIES) && ok;
+    ok = BenchmarkPointIndex(20000000, 10) && ok;
+    if(argc > 1 && strcmp(argv[1], "--gl") == 0)
+        BenchmarkRendering();
+    return ok ? 0 : 1;
+}
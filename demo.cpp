@@ -25,9 +25,6 @@ constexpr float MAX_DEPTH = 2.0f;
 struct Vertex {
     glm::vec3 position;
     glm::vec3 color;
-
-    Vertex(const glm::vec3 pos, const glm::vec3 col):
-        position(pos), color(col) {}
 };
 
 /*pixel in raw depth map is of uint16, convert to proper type before displaying*/
@@ -38,25 +35,29 @@ cv::Mat GetNormalImageFromDepth(const cv::Mat& depth){
     return tmp;
 }
 
+DepthRange GetDepthRange(){
+    DepthRange range;
+    range.factor = DEPTH_FACTOR;
+    range.max_depth = MAX_DEPTH;
+    return range;
+}
+
 /*pose is assumed from camera frame to world frame*/
-void UpdatePointCloud(const cv::Mat& image, const cv::Mat& depth, const glm::mat3& R, const glm::vec3 T,
+void UpdatePointCloud(const cv::Mat& image, const cv::Mat& depth, const glm::mat4& pose,
                       std::vector<Vertex>& pcl, float fx = FX, float fy = FY,float cx = CX, float cy = CY){
-    int width = image.cols;
-    int height = image.rows;
-    for(int y = 0; y < height; y++){
-        const uchar*  row_i = image.ptr<uchar>(y);
-        const ushort* row_d = depth.ptr<ushort>(y);
-        for(int x = 0; x < width; x++){
-             float d = (float)row_d[x] / DEPTH_FACTOR;
-             if(d < 1e-6 || d > MAX_DEPTH) continue;
-             glm::vec3 pos = R * glm::vec3(d * (x - cx) / fx, d * (y - cy) / fy, d) + T;
-             glm::vec3 col((float)row_i[x*3 + 2] / 255., (float)row_i[x*3 + 1] / 255., (float)row_i[x*3] / 255.);
-             pcl.emplace_back(pos, col);
-        }
-    }
+    CameraIntrinsics intrinsics = {depth.cols, depth.rows, fx, fy, cx, cy};
+    DepthRange range = GetDepthRange();
+    pcl.resize(depth.total());
+    size_t n = DepthToPointCloud(depth.ptr<uint16_t>(), image.data, ImageFormat::BGR, intrinsics,
+                                 &pose[0][0], &pcl[0].position[0], range);
+    pcl.resize(n);
 }
 
-int main(){
+int main(int argc, char** argv){
+    //with --fusion frames are fused into a surface, with --surfels into surfels, instead of
+    //accumulated as points
+    string mode = argc > 1 ? string(argv[1]) : string();
+    bool fusion = mode == "--fusion", surfels = mode == "--surfels";
     string assoc_file_path = data_list_path;
     ifstream fin(data_list_path);
     string root = assoc_file_path.substr(0, assoc_file_path.find_last_of("\\/"));
@@ -65,6 +66,16 @@ int main(){
         return -1;
     }
     DRViewer viewer(0.5,0.5,8,800,600);
+    //only points of the current frame are kept here, the viewer merges them into a 5mm grid
+    viewer.EnableVoxelFilter(0.005f);
+    viewer.EnableOutlierFilter(2);
+    viewer.SetTargetFrameRate(30.0f);
+    if(fusion)
+        viewer.EnableFusion(0.01f);
+    else if(surfels)
+        viewer.EnableSurfelFusion();
+    //median and flying pixel removal on raw depth before it's used
+    DepthFilter depth_filter;
     std::vector<Vertex> pcl;    
     while(!viewer.ShouldExit()){
         std::string line,depth_rel_path, img_rel_path;
@@ -73,16 +84,24 @@ int main(){
             iss>>depth_rel_path>>img_rel_path;
             cv::Mat image = cv::imread(root + "/" + img_rel_path, cv::IMREAD_UNCHANGED);
             cv::Mat depth = cv::imread(root + "/" + depth_rel_path, cv::IMREAD_UNCHANGED);
+            depth_filter.Apply(depth.ptr<uint16_t>(), depth.cols, depth.rows, depth.ptr<uint16_t>());
             float tx,ty,tz,qx,qy,qz,qw;
             iss>>tx>>ty>>tz>>qx>>qy>>qz>>qw;
-            glm::mat3 R(glm::quat(qw, qx, qy, qz));
-            glm::vec3 T(tx, ty, tz);
-            UpdatePointCloud(image, depth, R, T, pcl);
+            glm::mat4 pose(glm::quat(qw, qx, qy, qz));
+            pose[3] = glm::vec4(tx, ty, tz, 1.0f);
+            if(fusion || surfels){
+                CameraIntrinsics intrinsics = {depth.cols, depth.rows, FX, FY, CX, CY};
+                viewer.FuseDepthFrame(depth.ptr<uint16_t>(), image.data, ImageFormat::BGR,
+                                      intrinsics, &pose[0][0], GetDepthRange());
+            }else{
+                UpdatePointCloud(image, depth, pose, pcl);
+                viewer.BindPoinCloudData(pcl.data(), pcl.size(), sizeof(Vertex), 0,
+                                         sizeof(glm::vec3), MERGE_DATA);
+            }
 
             viewer.BindImageData(image.data, image.cols, image.rows, ImageFormat::BGR, DOWN_LEFT1);
             viewer.BindImageData(GetNormalImageFromDepth(depth).data, depth.cols, depth.rows,
                                  ImageFormat::BGR, DOWN_LEFT2);
-            viewer.BindPoinCloudData(pcl.data(), pcl.size());
             viewer.AddCameraPose(qw,qx,qy,qz,tx,ty,tz);
             viewer.Wait(200);
         }
@@ -0,0 +1,375 @@
+#include "DRViewer.h"
+#include "thread_pool.h"
+
+#include <vector>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#if defined(__SSE4_1__)
+#include <smmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+namespace visual_utils {
+
+namespace {
+
+constexpr size_t kBandRows = 16;    //rows of a tile handed to one worker
+constexpr int kMaxMedianRadius = 2;
+constexpr int kMaxMedianSize = (2 * kMaxMedianRadius + 1) * (2 * kMaxMedianRadius + 1);
+//range weight of the bilateral filter vanishes beyond this many depth sigmas
+constexpr float kRangeCutoff = 3.0f;
+
+using Network = std::vector<std::pair<int, int>>;
+
+//comparators of Batcher's odd-even merge sort over n values, pruned to those the middle
+//value depends on; every pair is ordered so that the first wire gets the smaller value
+Network BuildMedianNetwork(int n){
+    Network all;
+    for(int p = 1; p < n; p += p){
+        for(int k = p; k > 0; k /= 2){
+            for(int j = k % p; j < n - k; j += 2 * k){
+                for(int i = 0; i < k && i < n - j - k; i++){
+                    if((i + j) / (2 * p) == (i + j + k) / (2 * p))
+                        all.emplace_back(i + j, i + j + k);
+                }
+            }
+        }
+    }
+    std::vector<bool> needed(n, false);
+    needed[n / 2] = true;
+    Network pruned;
+    for(auto iter = all.rbegin(); iter != all.rend(); ++iter){
+        if(needed[iter->first] || needed[iter->second]){
+            pruned.push_back(*iter);
+            needed[iter->first] = needed[iter->second] = true;
+        }
+    }
+    std::reverse(pruned.begin(), pruned.end());
+    return pruned;
+}
+
+const Network& MedianNetwork(int radius){
+    static const Network networks[kMaxMedianRadius] = {BuildMedianNetwork(9), BuildMedianNetwork(25)};
+    return networks[radius - 1];
+}
+
+//copy src into dst with a border of r zero(invalid) pixels on every side
+template<typename T, typename S>
+void Pad(const S* src, int width, int height, int r, std::vector<T>& dst){
+    size_t padded_width = width + 2 * r;
+    dst.resize(padded_width * (height + 2 * r));
+    ThreadPool::Global().ParallelFor(0, height + 2 * r, kBandRows, [&](size_t begin, size_t end){
+        for(size_t y = begin; y < end; y++){
+            T* row = &dst[y * padded_width];
+            int sy = (int)y - r;
+            if(sy < 0 || sy >= height){
+                std::fill(row, row + padded_width, T(0));
+                continue;
+            }
+            const S* line = src + (size_t)sy * width;
+            std::fill(row, row + r, T(0));
+            std::fill(row + r + width, row + padded_width, T(0));
+            for(int x = 0; x < width; x++)
+                row[r + x] = T(line[x]);
+        }
+    });
+}
+
+//median of the valid pixels among the (2r+1)^2 around every valid pixel, the upper one of
+//an even count; invalid pixels stay invalid, input is padded by r invalid pixels.
+//Invalid samples alternately become 0xffff and stay 0, in window order, so that the middle
+//of all samples is the middle of the valid ones and one sorting network serves every count
+void MedianRows(const uint16_t* padded, int width, int r, size_t begin, size_t end, uint16_t* dst){
+    const Network& network = MedianNetwork(r);
+    const int size = 2 * r + 1, n = size * size;
+    const size_t padded_width = width + 2 * r;
+    for(size_t y = begin; y < end; y++){
+        const uint16_t* top = padded + y * padded_width;
+        uint16_t* out = dst + y * width;
+        int x = 0;
+#if defined(__SSE4_1__)
+        __m128i v[kMaxMedianSize];
+        const __m128i zero = _mm_setzero_si128();
+        for(; x + 8 <= width; x += 8){
+            __m128i high = zero;
+            for(int i = 0; i < n; i++){
+                __m128i d = _mm_loadu_si128((const __m128i*)(top + (i / size) * padded_width + x + i % size));
+                __m128i invalid = _mm_cmpeq_epi16(d, zero);
+                high = _mm_xor_si128(high, invalid);
+                v[i] = _mm_or_si128(d, _mm_and_si128(invalid, high));
+            }
+            for(const auto& c : network){
+                __m128i a = v[c.first];
+                v[c.first] = _mm_min_epu16(a, v[c.second]);
+                v[c.second] = _mm_max_epu16(a, v[c.second]);
+            }
+            __m128i center = _mm_loadu_si128((const __m128i*)(top + r * padded_width + x + r));
+            _mm_storeu_si128((__m128i*)(out + x),
+                             _mm_andnot_si128(_mm_cmpeq_epi16(center, zero), v[n / 2]));
+        }
+#endif
+        uint16_t s[kMaxMedianSize];
+        for(; x < width; x++){
+            if(top[r * padded_width + x + r] == 0){
+                out[x] = 0;
+                continue;
+            }
+            bool high = false;
+            for(int i = 0; i < n; i++){
+                s[i] = top[(i / size) * padded_width + x + i % size];
+                if(s[i] == 0){
+                    high = !high;
+                    s[i] = high ? 0xffff : 0;
+                }
+            }
+            for(const auto& c : network){
+                uint16_t a = s[c.first];
+                s[c.first] = std::min(a, s[c.second]);
+                s[c.second] = std::max(a, s[c.second]);
+            }
+            out[x] = s[n / 2];
+        }
+    }
+}
+
+//zero pixels whose valid 4-neighbor differs in depth by more than ratio(in 1/65536) of
+//their own depth, input is padded by one invalid pixel
+void EdgeRows(const uint16_t* padded, int width, uint16_t ratio, size_t begin, size_t end,
+              uint16_t* dst){
+    const size_t padded_width = width + 2;
+    for(size_t y = begin; y < end; y++){
+        const uint16_t* row = padded + (y + 1) * padded_width + 1;
+        const uint16_t* neighbors[4] = {row - 1, row + 1, row - padded_width, row + padded_width};
+        uint16_t* out = dst + y * width;
+        int x = 0;
+#if defined(__SSE2__)
+        const __m128i q = _mm_set1_epi16((short)ratio), zero = _mm_setzero_si128();
+        for(; x + 8 <= width; x += 8){
+            __m128i c = _mm_loadu_si128((const __m128i*)(row + x));
+            __m128i limit = _mm_mulhi_epu16(c, q);
+            __m128i edge = zero;
+            for(const uint16_t* neighbor : neighbors){
+                __m128i d = _mm_loadu_si128((const __m128i*)(neighbor + x));
+                //unsigned saturation gives |c - d| and whether it exceeds the limit
+                __m128i diff = _mm_or_si128(_mm_subs_epu16(c, d), _mm_subs_epu16(d, c));
+                __m128i within = _mm_cmpeq_epi16(_mm_subs_epu16(diff, limit), zero);
+                __m128i invalid = _mm_cmpeq_epi16(d, zero);
+                edge = _mm_or_si128(edge, _mm_andnot_si128(_mm_or_si128(within, invalid),
+                                                           _mm_set1_epi16(-1)));
+            }
+            _mm_storeu_si128((__m128i*)(out + x), _mm_andnot_si128(edge, c));
+        }
+#endif
+        for(; x < width; x++){
+            uint16_t c = row[x];
+            uint16_t limit = uint16_t(((uint32_t)c * ratio) >> 16);
+            bool edge = false;
+            for(const uint16_t* neighbor : neighbors){
+                uint16_t d = neighbor[x];
+                edge = edge || (d != 0 && (c > d ? c - d : d - c) > limit);
+            }
+            out[x] = edge ? 0 : c;
+        }
+    }
+}
+
+//one direction of the separable bilateral filter: every valid pixel becomes the average
+//of its valid neighbors at offsets k * step for k in [-r, r], weighted by spatial weights
+//and a biweight of their depth difference scaled by the pixel's depth sigma; invalid
+//pixels are zero and stay zero
+void BilateralRows(const float* src, size_t src_stride, size_t step, int width, int r,
+                   const float* spatial, float ratio, size_t begin, size_t end,
+                   float* dst, size_t dst_stride){
+    const float inv_ratio = 1.0f / (kRangeCutoff * ratio);
+    for(size_t y = begin; y < end; y++){
+        const float* center = src + y * src_stride;
+        float* out = dst + y * dst_stride;
+        int x = 0;
+#if defined(__AVX__)
+        {
+            const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+            for(; x + 8 <= width; x += 8){
+                __m256 c = _mm256_loadu_ps(center + x);
+                __m256 valid = _mm256_cmp_ps(c, zero, _CMP_GT_OQ);
+                if(_mm256_movemask_ps(valid) == 0){
+                    _mm256_storeu_ps(out + x, zero);
+                    continue;
+                }
+                __m256 inv = _mm256_div_ps(_mm256_set1_ps(inv_ratio), c);
+                __m256 num = zero, den = zero;
+                for(int k = -r; k <= r; k++){
+                    __m256 d = _mm256_loadu_ps(center + x + k * (ptrdiff_t)step);
+                    __m256 t = _mm256_mul_ps(_mm256_sub_ps(d, c), inv);
+                    __m256 w = _mm256_max_ps(_mm256_sub_ps(one, _mm256_mul_ps(t, t)), zero);
+                    w = _mm256_mul_ps(_mm256_mul_ps(w, w), _mm256_set1_ps(spatial[k + r]));
+                    w = _mm256_and_ps(w, _mm256_cmp_ps(d, zero, _CMP_GT_OQ));
+                    num = _mm256_add_ps(num, _mm256_mul_ps(w, d));
+                    den = _mm256_add_ps(den, w);
+                }
+                _mm256_storeu_ps(out + x, _mm256_and_ps(valid, _mm256_div_ps(num, den)));
+            }
+        }
+#endif
+#if defined(__SSE2__)
+        {
+            const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+            for(; x + 4 <= width; x += 4){
+                __m128 c = _mm_loadu_ps(center + x);
+                __m128 valid = _mm_cmpgt_ps(c, zero);
+                if(_mm_movemask_ps(valid) == 0){
+                    _mm_storeu_ps(out + x, zero);
+                    continue;
+                }
+                __m128 inv = _mm_div_ps(_mm_set1_ps(inv_ratio), c);
+                __m128 num = zero, den = zero;
+                for(int k = -r; k <= r; k++){
+                    __m128 d = _mm_loadu_ps(center + x + k * (ptrdiff_t)step);
+                    __m128 t = _mm_mul_ps(_mm_sub_ps(d, c), inv);
+                    __m128 w = _mm_max_ps(_mm_sub_ps(one, _mm_mul_ps(t, t)), zero);
+                    w = _mm_mul_ps(_mm_mul_ps(w, w), _mm_set1_ps(spatial[k + r]));
+                    w = _mm_and_ps(w, _mm_cmpgt_ps(d, zero));
+                    num = _mm_add_ps(num, _mm_mul_ps(w, d));
+                    den = _mm_add_ps(den, w);
+                }
+                _mm_storeu_ps(out + x, _mm_and_ps(valid, _mm_div_ps(num, den)));
+            }
+        }
+#endif
+        for(; x < width; x++){
+            float c = center[x];
+            if(!(c > 0.0f)){
+                out[x] = 0.0f;
+                continue;
+            }
+            float inv = inv_ratio / c, num = 0.0f, den = 0.0f;
+            for(int k = -r; k <= r; k++){
+                float d = center[x + k * (ptrdiff_t)step];
+                if(!(d > 0.0f))
+                    continue;
+                float t = (d - c) * inv;
+                float w = std::max(1.0f - t * t, 0.0f);
+                w = w * w * spatial[k + r];
+                num += w * d;
+                den += w;
+            }
+            out[x] = num / den;
+        }
+    }
+}
+
+//round filtered depth back to raw values
+void StoreRows(const float* src, size_t src_stride, int width, size_t begin, size_t end,
+               uint16_t* dst){
+    for(size_t y = begin; y < end; y++){
+        const float* row = src + y * src_stride;
+        uint16_t* out = dst + y * width;
+        int x = 0;
+#if defined(__SSE4_1__)
+        for(; x + 8 <= width; x += 8){
+            __m128i lower = _mm_cvtps_epi32(_mm_loadu_ps(row + x));
+            __m128i upper = _mm_cvtps_epi32(_mm_loadu_ps(row + x + 4));
+            _mm_storeu_si128((__m128i*)(out + x), _mm_packus_epi32(lower, upper));
+        }
+#endif
+        for(; x < width; x++)
+            out[x] = (uint16_t)std::min(std::nearbyint(row[x]), 65535.0f);
+    }
+}
+
+}
+
+//buffers sized by the last frame, kept to avoid reallocating every frame
+struct DepthFilter::Scratch{
+    std::vector<uint16_t> padded;
+    std::vector<uint16_t> stages[2];
+    std::vector<float> float_padded;
+    std::vector<float> horizontal;
+    std::vector<float> spatial;
+};
+
+DepthFilter::DepthFilter(const DepthFilterOptions& options) :
+    options_(options), scratch_(new Scratch) {}
+
+DepthFilter::~DepthFilter() = default;
+
+void DepthFilter::SetOptions(const DepthFilterOptions& options){
+    options_ = options;
+}
+
+void DepthFilter::Apply(const uint16_t* depth, int width, int height, uint16_t* out){
+    if(depth == nullptr || out == nullptr || width <= 0 || height <= 0)
+        return;
+    const size_t num_pixels = (size_t)width * height;
+    const int median_radius = std::min(std::max(options_.median_radius, 0), kMaxMedianRadius);
+    const bool edge = options_.edge_ratio > 0.0f;
+    const bool bilateral = options_.bilateral_sigma > 0.0f && options_.bilateral_depth_ratio > 0.0f;
+    const int num_stages = (median_radius > 0) + edge + bilateral;
+    if(num_stages == 0){
+        if(out != depth)
+            memcpy(out, depth, num_pixels * sizeof(uint16_t));
+        return;
+    }
+
+    //stages ping-pong between scratch buffers, the last one writes into out
+    Scratch& s = *scratch_;
+    ThreadPool& pool = ThreadPool::Global();
+    const uint16_t* src = depth;
+    int stage = 0;
+    auto target = [&](){
+        if(++stage == num_stages)
+            return out;
+        std::vector<uint16_t>& buffer = s.stages[stage % 2];
+        buffer.resize(num_pixels);
+        return buffer.data();
+    };
+
+    if(median_radius > 0){
+        uint16_t* dst = target();
+        Pad(src, width, height, median_radius, s.padded);
+        pool.ParallelFor(0, height, kBandRows, [&](size_t begin, size_t end){
+            MedianRows(s.padded.data(), width, median_radius, begin, end, dst);
+        });
+        src = dst;
+    }
+    if(edge){
+        uint16_t* dst = target();
+        uint16_t ratio = (uint16_t)std::min(options_.edge_ratio * 65536.0f, 65535.0f);
+        Pad(src, width, height, 1, s.padded);
+        pool.ParallelFor(0, height, kBandRows, [&](size_t begin, size_t end){
+            EdgeRows(s.padded.data(), width, ratio, begin, end, dst);
+        });
+        src = dst;
+    }
+    if(bilateral){
+        uint16_t* dst = target();
+        const float sigma = options_.bilateral_sigma;
+        const int r = std::max(1, (int)std::ceil(2.0f * sigma));
+        s.spatial.resize(2 * r + 1);
+        for(int k = -r; k <= r; k++)
+            s.spatial[k + r] = std::exp(-0.5f * k * k / (sigma * sigma));
+        //horizontal pass reads rows padded by r invalid pixels and writes into rows padded
+        //above and below by r invalid rows for the vertical pass
+        Pad(src, width, height, r, s.float_padded);
+        const size_t padded_width = width + 2 * r;
+        s.horizontal.assign((size_t)width * (height + 2 * r), 0.0f);
+        float* horizontal = s.horizontal.data() + (size_t)r * width;
+        pool.ParallelFor(0, height, kBandRows, [&](size_t begin, size_t end){
+            BilateralRows(s.float_padded.data() + r * padded_width + r, padded_width, 1, width, r,
+                          s.spatial.data(), options_.bilateral_depth_ratio, begin, end,
+                          horizontal, width);
+        });
+        //the vertical pass writes its result over the padded input, which is free by now
+        pool.ParallelFor(0, height, kBandRows, [&](size_t begin, size_t end){
+            BilateralRows(horizontal, width, width, width, r, s.spatial.data(),
+                          options_.bilateral_depth_ratio, begin, end, s.float_padded.data(), width);
+            StoreRows(s.float_padded.data(), width, width, begin, end, dst);
+        });
+    }
+}
+
+}
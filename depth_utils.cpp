@@ -0,0 +1,399 @@
+#include "DRViewer.h"
+#include "thread_pool.h"
+#include "grid_utils.h"
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#if defined(__SSE4_1__)
+#include <smmintrin.h>
+#endif
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+namespace visual_utils {
+
+namespace {
+
+constexpr float kColorScale = 1.0f / 255.0f;
+//neighbors whose depths differ by more than this fraction of the center depth lie across
+//an occluding edge, no normal is estimated there
+constexpr float kDiscontinuityRatio = 0.05f;
+
+//everything needed to back-project a pixel, shared by all rows
+struct Projection{
+    //ray through pixel(x, y) is (rays_x[x], rays_y[y], 1), a pinhole camera's table is
+    //separable into one entry per column and one per row
+    std::vector<float> rays_x, rays_y;
+    //pose columns, a point at depth d goes to d * (axis_x * rx + axis_y * ry + axis_z) + origin
+    float axis_x[3] = {1, 0, 0}, axis_y[3] = {0, 1, 0}, axis_z[3] = {0, 0, 1};
+    float origin[3] = {0, 0, 0};
+    float scale, min_depth, max_depth;
+    const byte* color;
+    int width, height, channels, red, green, blue;
+    int stride;  //floats per output vertex, 9 when a normal follows the color
+
+    Projection(const CameraIntrinsics& intrinsics, const float* pose, const byte* color,
+               ImageFormat color_format, const DepthRange& range, bool with_normals) :
+        rays_x(intrinsics.width), rays_y(intrinsics.height), scale(1.0f / range.factor),
+        min_depth(range.min_depth), max_depth(range.max_depth), color(color),
+        width(intrinsics.width), height(intrinsics.height), stride(with_normals ? 9 : 6){
+        for(int x = 0; x < intrinsics.width; x++)
+            rays_x[x] = (x - intrinsics.cx) / intrinsics.fx;
+        for(int y = 0; y < intrinsics.height; y++)
+            rays_y[y] = (y - intrinsics.cy) / intrinsics.fy;
+        if(pose != nullptr){
+            for(int i = 0; i < 3; i++){
+                axis_x[i] = pose[i];
+                axis_y[i] = pose[4 + i];
+                axis_z[i] = pose[8 + i];
+                origin[i] = pose[12 + i];
+            }
+        }
+        ChannelOrder order(color_format);
+        channels = order.channels;
+        red = order.rgb[0];
+        green = order.rgb[1];
+        blue = order.rgb[2];
+    }
+
+    void WriteVertex(float* v, float x, float y, float z, const byte* pixel) const{
+        v[0] = x;
+        v[1] = y;
+        v[2] = z;
+        if(pixel != nullptr){
+            v[3] = pixel[red] * kColorScale;
+            v[4] = pixel[green] * kColorScale;
+            v[5] = pixel[blue] * kColorScale;
+        }else
+            v[3] = v[4] = v[5] = 1.0f;
+    }
+
+    //normals of a row are stored as all x components, then all y, then all z
+    void WriteNormal(float* v, const float* normals, int x) const{
+        v[6] = normals[x];
+        v[7] = normals[width + x];
+        v[8] = normals[2 * width + x];
+    }
+};
+
+#if defined(__SSE4_1__)
+inline __m128 LoadDepth4(const uint16_t* depth){
+    return _mm_cvtepi32_ps(_mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i*)depth)));
+}
+inline __m128 LoadDepth4(const float* depth){
+    return _mm_loadu_ps(depth);
+}
+#endif
+
+#if defined(__AVX__)
+inline __m256 LoadDepth8(const uint16_t* depth){
+    __m128i raw = _mm_loadu_si128((const __m128i*)depth);
+    __m128i lower = _mm_cvtepu16_epi32(raw);
+    __m128i upper = _mm_cvtepu16_epi32(_mm_srli_si128(raw, 8));
+    return _mm256_cvtepi32_ps(_mm256_insertf128_si256(_mm256_castsi128_si256(lower), upper, 1));
+}
+inline __m256 LoadDepth8(const float* depth){
+    return _mm256_loadu_ps(depth);
+}
+#endif
+
+//back-project valid pixels of row y into out, or only count them if out is null; normals
+//of the row from NormalRow are appended to the vertices when given
+template<typename T>
+size_t ProjectRow(const T* depth, int y, const Projection& p, float* out,
+                  const float* normals = nullptr){
+    const float* rays_x = p.rays_x.data();
+    const byte* color = p.color == nullptr ? nullptr : p.color + (size_t)y * p.width * p.channels;
+    //direction of the ray through column x is axis_x * rays_x[x] + base
+    float ry = p.rays_y[y];
+    float base[3];
+    for(int i = 0; i < 3; i++)
+        base[i] = p.axis_y[i] * ry + p.axis_z[i];
+
+    size_t n = 0;
+    int x = 0;
+#if defined(__AVX__)
+    {
+        const __m256 scale = _mm256_set1_ps(p.scale);
+        const __m256 lower = _mm256_set1_ps(p.min_depth), upper = _mm256_set1_ps(p.max_depth);
+        alignas(32) float px[8], py[8], pz[8];
+        for(; x + 8 <= p.width; x += 8){
+            __m256 d = _mm256_mul_ps(LoadDepth8(depth + x), scale);
+            //nan depth fails both comparisons
+            int mask = _mm256_movemask_ps(_mm256_and_ps(_mm256_cmp_ps(d, lower, _CMP_GE_OQ),
+                                                        _mm256_cmp_ps(d, upper, _CMP_LE_OQ)));
+            if(mask == 0)
+                continue;
+            if(out == nullptr){
+                for(; mask != 0; mask &= mask - 1)
+                    ++n;
+                continue;
+            }
+            __m256 rx = _mm256_loadu_ps(rays_x + x);
+            __m256 dir[3];
+            for(int i = 0; i < 3; i++)
+                dir[i] = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(p.axis_x[i]), rx),
+                                       _mm256_set1_ps(base[i]));
+            _mm256_store_ps(px, _mm256_add_ps(_mm256_mul_ps(d, dir[0]), _mm256_set1_ps(p.origin[0])));
+            _mm256_store_ps(py, _mm256_add_ps(_mm256_mul_ps(d, dir[1]), _mm256_set1_ps(p.origin[1])));
+            _mm256_store_ps(pz, _mm256_add_ps(_mm256_mul_ps(d, dir[2]), _mm256_set1_ps(p.origin[2])));
+            for(int i = 0; i < 8; i++){
+                if(!(mask & (1 << i)))
+                    continue;
+                float* v = out + p.stride * n++;
+                p.WriteVertex(v, px[i], py[i], pz[i],
+                              color == nullptr ? nullptr : color + (x + i) * p.channels);
+                if(normals != nullptr)
+                    p.WriteNormal(v, normals, x + i);
+            }
+        }
+    }
+#endif
+#if defined(__SSE4_1__)
+    {
+        const __m128 scale = _mm_set1_ps(p.scale);
+        const __m128 lower = _mm_set1_ps(p.min_depth), upper = _mm_set1_ps(p.max_depth);
+        alignas(16) float px[4], py[4], pz[4];
+        for(; x + 4 <= p.width; x += 4){
+            __m128 d = _mm_mul_ps(LoadDepth4(depth + x), scale);
+            int mask = _mm_movemask_ps(_mm_and_ps(_mm_cmpge_ps(d, lower), _mm_cmple_ps(d, upper)));
+            if(mask == 0)
+                continue;
+            if(out == nullptr){
+                for(; mask != 0; mask &= mask - 1)
+                    ++n;
+                continue;
+            }
+            __m128 rx = _mm_loadu_ps(rays_x + x);
+            __m128 dir[3];
+            for(int i = 0; i < 3; i++)
+                dir[i] = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(p.axis_x[i]), rx), _mm_set1_ps(base[i]));
+            _mm_store_ps(px, _mm_add_ps(_mm_mul_ps(d, dir[0]), _mm_set1_ps(p.origin[0])));
+            _mm_store_ps(py, _mm_add_ps(_mm_mul_ps(d, dir[1]), _mm_set1_ps(p.origin[1])));
+            _mm_store_ps(pz, _mm_add_ps(_mm_mul_ps(d, dir[2]), _mm_set1_ps(p.origin[2])));
+            for(int i = 0; i < 4; i++){
+                if(!(mask & (1 << i)))
+                    continue;
+                float* v = out + p.stride * n++;
+                p.WriteVertex(v, px[i], py[i], pz[i],
+                              color == nullptr ? nullptr : color + (x + i) * p.channels);
+                if(normals != nullptr)
+                    p.WriteNormal(v, normals, x + i);
+            }
+        }
+    }
+#endif
+    for(; x < p.width; x++){
+        float d = depth[x] * p.scale;
+        if(!(d >= p.min_depth && d <= p.max_depth))
+            continue;
+        if(out != nullptr){
+            float dir[3];
+            for(int i = 0; i < 3; i++)
+                dir[i] = p.axis_x[i] * rays_x[x] + base[i];
+            float* v = out + p.stride * n;
+            p.WriteVertex(v, d * dir[0] + p.origin[0], d * dir[1] + p.origin[1],
+                          d * dir[2] + p.origin[2],
+                          color == nullptr ? nullptr : color + x * p.channels);
+            if(normals != nullptr)
+                p.WriteNormal(v, normals, x);
+        }
+        ++n;
+    }
+    return n;
+}
+
+//world frame normal at every pixel of row y, the cross product of central differences
+//between back-projected neighbors, facing the camera; zero on image borders, next to
+//invalid pixels and across depth discontinuities
+template<typename T>
+void NormalRow(const T* depth, int y, const Projection& p, float* normals){
+    float* nx = normals;
+    float* ny = normals + p.width;
+    float* nz = normals + 2 * p.width;
+    std::fill(normals, normals + 3 * p.width, 0.0f);
+    if(y <= 0 || y + 1 >= p.height)
+        return;
+    const T* row = depth + (size_t)y * p.width;
+    const T* up = row - p.width;
+    const T* down = row + p.width;
+    const float* rays_x = p.rays_x.data();
+    const float ry = p.rays_y[y], ry_up = p.rays_y[y - 1], ry_down = p.rays_y[y + 1];
+
+    int x = 1;
+#if defined(__AVX__)
+    {
+        const __m256 scale = _mm256_set1_ps(p.scale), ratio = _mm256_set1_ps(kDiscontinuityRatio);
+        const __m256 lower = _mm256_set1_ps(p.min_depth), upper = _mm256_set1_ps(p.max_depth);
+        const __m256 sign = _mm256_set1_ps(-0.0f), zero = _mm256_setzero_ps();
+        auto in_range = [&](__m256 d){
+            return _mm256_and_ps(_mm256_cmp_ps(d, lower, _CMP_GE_OQ), _mm256_cmp_ps(d, upper, _CMP_LE_OQ));
+        };
+        for(; x + 9 <= p.width; x += 8){
+            __m256 c = _mm256_mul_ps(LoadDepth8(row + x), scale);
+            __m256 l = _mm256_mul_ps(LoadDepth8(row + x - 1), scale);
+            __m256 r = _mm256_mul_ps(LoadDepth8(row + x + 1), scale);
+            __m256 u = _mm256_mul_ps(LoadDepth8(up + x), scale);
+            __m256 b = _mm256_mul_ps(LoadDepth8(down + x), scale);
+            __m256 dh = _mm256_sub_ps(r, l), dv = _mm256_sub_ps(b, u);
+            __m256 limit = _mm256_mul_ps(c, ratio);
+            __m256 valid = _mm256_and_ps(_mm256_and_ps(in_range(c), in_range(l)),
+                                         _mm256_and_ps(in_range(r), _mm256_and_ps(in_range(u), in_range(b))));
+            valid = _mm256_and_ps(valid, _mm256_cmp_ps(_mm256_andnot_ps(sign, dh), limit, _CMP_LE_OQ));
+            valid = _mm256_and_ps(valid, _mm256_cmp_ps(_mm256_andnot_ps(sign, dv), limit, _CMP_LE_OQ));
+            if(_mm256_movemask_ps(valid) == 0)
+                continue;
+            //horizontal and vertical differences in camera frame
+            __m256 hx = _mm256_sub_ps(_mm256_mul_ps(r, _mm256_loadu_ps(rays_x + x + 1)),
+                                      _mm256_mul_ps(l, _mm256_loadu_ps(rays_x + x - 1)));
+            __m256 hy = _mm256_mul_ps(dh, _mm256_set1_ps(ry));
+            __m256 vx = _mm256_mul_ps(dv, _mm256_loadu_ps(rays_x + x));
+            __m256 vy = _mm256_sub_ps(_mm256_mul_ps(b, _mm256_set1_ps(ry_down)),
+                                      _mm256_mul_ps(u, _mm256_set1_ps(ry_up)));
+            __m256 n[3] = {_mm256_sub_ps(_mm256_mul_ps(vy, dh), _mm256_mul_ps(dv, hy)),
+                           _mm256_sub_ps(_mm256_mul_ps(dv, hx), _mm256_mul_ps(vx, dh)),
+                           _mm256_sub_ps(_mm256_mul_ps(vx, hy), _mm256_mul_ps(vy, hx))};
+            __m256 w[3];
+            for(int i = 0; i < 3; i++)
+                w[i] = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(p.axis_x[i]), n[0]),
+                                                   _mm256_mul_ps(_mm256_set1_ps(p.axis_y[i]), n[1])),
+                                     _mm256_mul_ps(_mm256_set1_ps(p.axis_z[i]), n[2]));
+            __m256 len2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(w[0], w[0]), _mm256_mul_ps(w[1], w[1])),
+                                        _mm256_mul_ps(w[2], w[2]));
+            valid = _mm256_and_ps(valid, _mm256_cmp_ps(len2, zero, _CMP_GT_OQ));
+            __m256 inv = _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_sqrt_ps(len2));
+            _mm256_storeu_ps(nx + x, _mm256_and_ps(valid, _mm256_mul_ps(w[0], inv)));
+            _mm256_storeu_ps(ny + x, _mm256_and_ps(valid, _mm256_mul_ps(w[1], inv)));
+            _mm256_storeu_ps(nz + x, _mm256_and_ps(valid, _mm256_mul_ps(w[2], inv)));
+        }
+    }
+#endif
+#if defined(__SSE4_1__)
+    {
+        const __m128 scale = _mm_set1_ps(p.scale), ratio = _mm_set1_ps(kDiscontinuityRatio);
+        const __m128 lower = _mm_set1_ps(p.min_depth), upper = _mm_set1_ps(p.max_depth);
+        const __m128 sign = _mm_set1_ps(-0.0f), zero = _mm_setzero_ps();
+        auto in_range = [&](__m128 d){
+            return _mm_and_ps(_mm_cmpge_ps(d, lower), _mm_cmple_ps(d, upper));
+        };
+        for(; x + 5 <= p.width; x += 4){
+            __m128 c = _mm_mul_ps(LoadDepth4(row + x), scale);
+            __m128 l = _mm_mul_ps(LoadDepth4(row + x - 1), scale);
+            __m128 r = _mm_mul_ps(LoadDepth4(row + x + 1), scale);
+            __m128 u = _mm_mul_ps(LoadDepth4(up + x), scale);
+            __m128 b = _mm_mul_ps(LoadDepth4(down + x), scale);
+            __m128 dh = _mm_sub_ps(r, l), dv = _mm_sub_ps(b, u);
+            __m128 limit = _mm_mul_ps(c, ratio);
+            __m128 valid = _mm_and_ps(_mm_and_ps(in_range(c), in_range(l)),
+                                      _mm_and_ps(in_range(r), _mm_and_ps(in_range(u), in_range(b))));
+            valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_andnot_ps(sign, dh), limit));
+            valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_andnot_ps(sign, dv), limit));
+            if(_mm_movemask_ps(valid) == 0)
+                continue;
+            __m128 hx = _mm_sub_ps(_mm_mul_ps(r, _mm_loadu_ps(rays_x + x + 1)),
+                                   _mm_mul_ps(l, _mm_loadu_ps(rays_x + x - 1)));
+            __m128 hy = _mm_mul_ps(dh, _mm_set1_ps(ry));
+            __m128 vx = _mm_mul_ps(dv, _mm_loadu_ps(rays_x + x));
+            __m128 vy = _mm_sub_ps(_mm_mul_ps(b, _mm_set1_ps(ry_down)), _mm_mul_ps(u, _mm_set1_ps(ry_up)));
+            __m128 n[3] = {_mm_sub_ps(_mm_mul_ps(vy, dh), _mm_mul_ps(dv, hy)),
+                           _mm_sub_ps(_mm_mul_ps(dv, hx), _mm_mul_ps(vx, dh)),
+                           _mm_sub_ps(_mm_mul_ps(vx, hy), _mm_mul_ps(vy, hx))};
+            __m128 w[3];
+            for(int i = 0; i < 3; i++)
+                w[i] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(p.axis_x[i]), n[0]),
+                                             _mm_mul_ps(_mm_set1_ps(p.axis_y[i]), n[1])),
+                                  _mm_mul_ps(_mm_set1_ps(p.axis_z[i]), n[2]));
+            __m128 len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(w[0], w[0]), _mm_mul_ps(w[1], w[1])),
+                                     _mm_mul_ps(w[2], w[2]));
+            valid = _mm_and_ps(valid, _mm_cmpgt_ps(len2, zero));
+            __m128 inv = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(len2));
+            _mm_storeu_ps(nx + x, _mm_and_ps(valid, _mm_mul_ps(w[0], inv)));
+            _mm_storeu_ps(ny + x, _mm_and_ps(valid, _mm_mul_ps(w[1], inv)));
+            _mm_storeu_ps(nz + x, _mm_and_ps(valid, _mm_mul_ps(w[2], inv)));
+        }
+    }
+#endif
+    auto in_range = [&](float d){ return d >= p.min_depth && d <= p.max_depth; };
+    for(; x + 1 < p.width; x++){
+        float c = row[x] * p.scale, l = row[x - 1] * p.scale, r = row[x + 1] * p.scale;
+        float u = up[x] * p.scale, b = down[x] * p.scale;
+        float dh = r - l, dv = b - u, limit = c * kDiscontinuityRatio;
+        if(!(in_range(c) && in_range(l) && in_range(r) && in_range(u) && in_range(b) &&
+             std::fabs(dh) <= limit && std::fabs(dv) <= limit))
+            continue;
+        float hx = r * rays_x[x + 1] - l * rays_x[x - 1], hy = dh * ry;
+        float vx = dv * rays_x[x], vy = b * ry_down - u * ry_up;
+        float n[3] = {vy * dh - dv * hy, dv * hx - vx * dh, vx * hy - vy * hx};
+        float w[3];
+        for(int i = 0; i < 3; i++)
+            w[i] = p.axis_x[i] * n[0] + p.axis_y[i] * n[1] + p.axis_z[i] * n[2];
+        float len2 = w[0] * w[0] + w[1] * w[1] + w[2] * w[2];
+        if(!(len2 > 0.0f))
+            continue;
+        float inv = 1.0f / std::sqrt(len2);
+        nx[x] = w[0] * inv;
+        ny[x] = w[1] * inv;
+        nz[x] = w[2] * inv;
+    }
+}
+
+//rows are counted first so that every row knows where its vertices start, then written
+//in parallel straight into the output
+template<typename T>
+size_t Project(const T* depth, const byte* color, ImageFormat color_format,
+               const CameraIntrinsics& intrinsics, const float* pose, float* out,
+               const DepthRange& range, bool with_normals){
+    if(depth == nullptr || out == nullptr || intrinsics.width <= 0 ||
+       intrinsics.height <= 0 || range.factor <= 0)
+        return 0;
+    Projection p(intrinsics, pose, color, color_format, range, with_normals);
+    size_t width = intrinsics.width, height = intrinsics.height;
+    std::vector<size_t> offsets(height + 1, 0);
+    ThreadPool& pool = ThreadPool::Global();
+    pool.ParallelFor(0, height, kRowGrain, [&](size_t begin, size_t end){
+        for(size_t y = begin; y < end; y++)
+            offsets[y + 1] = ProjectRow(depth + y * width, y, p, nullptr);
+    });
+    for(size_t y = 0; y < height; y++)
+        offsets[y + 1] += offsets[y];
+    pool.ParallelFor(0, height, kRowGrain, [&](size_t begin, size_t end){
+        std::vector<float> normals(with_normals ? 3 * width : 0);
+        for(size_t y = begin; y < end; y++){
+            if(with_normals)
+                NormalRow(depth, y, p, normals.data());
+            ProjectRow(depth + y * width, y, p, out + p.stride * offsets[y],
+                       with_normals ? normals.data() : nullptr);
+        }
+    });
+    return offsets[height];
+}
+
+}
+
+size_t DepthToPointCloud(const uint16_t* depth, const byte* color, ImageFormat color_format,
+                         const CameraIntrinsics& intrinsics, const float* pose, float* out,
+                         const DepthRange& range){
+    return Project(depth, color, color_format, intrinsics, pose, out, range, false);
+}
+
+size_t DepthToPointCloud(const float* depth, const byte* color, ImageFormat color_format,
+                         const CameraIntrinsics& intrinsics, const float* pose, float* out,
+                         const DepthRange& range){
+    return Project(depth, color, color_format, intrinsics, pose, out, range, false);
+}
+
+size_t DepthToOrientedPointCloud(const uint16_t* depth, const byte* color, ImageFormat color_format,
+                                 const CameraIntrinsics& intrinsics, const float* pose, float* out,
+                                 const DepthRange& range){
+    return Project(depth, color, color_format, intrinsics, pose, out, range, true);
+}
+
+size_t DepthToOrientedPointCloud(const float* depth, const byte* color, ImageFormat color_format,
+                                 const CameraIntrinsics& intrinsics, const float* pose, float* out,
+                                 const DepthRange& range){
+    return Project(depth, color, color_format, intrinsics, pose, out, range, true);
+}
+
+}
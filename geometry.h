@@ -0,0 +1,67 @@
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+#include <glm/glm.hpp>
+#include <limits>
+
+namespace visual_utils {
+
+//axis aligned bounding box, empty until extended by a point
+struct AABB{
+    glm::vec3 lower = glm::vec3(std::numeric_limits<float>::max());
+    glm::vec3 upper = glm::vec3(-std::numeric_limits<float>::max());
+
+    AABB() = default;
+    AABB(const glm::vec3& _lower, const glm::vec3& _upper) : lower(_lower), upper(_upper) {}
+
+    bool Empty() const { return lower.x > upper.x; }
+
+    void Extend(const glm::vec3& p){
+        lower = glm::min(lower, p);
+        upper = glm::max(upper, p);
+    }
+
+    void Extend(const AABB& rhs){
+        lower = glm::min(lower, rhs.lower);
+        upper = glm::max(upper, rhs.upper);
+    }
+
+    bool Contains(const glm::vec3& p) const{
+        return p.x >= lower.x && p.y >= lower.y && p.z >= lower.z &&
+               p.x <= upper.x && p.y <= upper.y && p.z <= upper.z;
+    }
+
+    glm::vec3 Center() const { return 0.5f * (lower + upper); }
+    glm::vec3 Extent() const { return upper - lower; }
+};
+
+//six clipping planes extracted from a (projection * view * model) matrix, pointing inwards
+struct Frustum{
+    glm::vec4 planes[6];
+
+    explicit Frustum(const glm::mat4& m){
+        glm::vec4 row[4];
+        for(int i = 0; i < 4; i++)
+            row[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+        for(int i = 0; i < 3; i++){
+            planes[2 * i]     = row[3] + row[i];
+            planes[2 * i + 1] = row[3] - row[i];
+        }
+    }
+
+    //conservative test, boxes near frustum corners may be reported as visible
+    bool Intersects(const AABB& box) const{
+        for(int i = 0; i < 6; i++){
+            const glm::vec4& p = planes[i];
+            glm::vec3 v(p.x > 0 ? box.upper.x : box.lower.x,
+                        p.y > 0 ? box.upper.y : box.lower.y,
+                        p.z > 0 ? box.upper.z : box.lower.z);
+            if(p.x * v.x + p.y * v.y + p.z * v.z + p.w < 0)
+                return false;
+        }
+        return true;
+    }
+};
+
+}
+#endif // GEOMETRY_H
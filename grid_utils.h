@@ -0,0 +1,59 @@
+#ifndef GRID_UTILS_H
+#define GRID_UTILS_H
+
+#include "DRViewer.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace visual_utils {
+
+//helpers shared by the library's sources, not part of the installed interface
+
+//rows of an image handed to a task of ThreadPool::ParallelFor
+constexpr size_t kRowGrain = 16;
+
+//cells of sparse grids are keyed by their integer coordinates, kKeyBits per axis
+constexpr int kKeyBits = 21;
+constexpr int64_t kKeyOffset = int64_t(1) << (kKeyBits - 1);
+constexpr uint64_t kKeyMask = (uint64_t(1) << kKeyBits) - 1;
+//coordinates outside [kMinKeyCoord, kMaxKeyCoord] wrap around to the keys of other cells
+constexpr int64_t kMinKeyCoord = -kKeyOffset;
+constexpr int64_t kMaxKeyCoord = kKeyOffset - 1;
+
+inline uint64_t PackKey(int64_t x, int64_t y, int64_t z){
+    return ((uint64_t)(x + kKeyOffset) & kKeyMask) |
+           (((uint64_t)(y + kKeyOffset) & kKeyMask) << kKeyBits) |
+           (((uint64_t)(z + kKeyOffset) & kKeyMask) << (2 * kKeyBits));
+}
+
+inline void UnpackKey(uint64_t key, int64_t* coord){
+    for(int i = 0; i < 3; i++)
+        coord[i] = (int64_t)((key >> (i * kKeyBits)) & kKeyMask) - kKeyOffset;
+}
+
+//keys of neighboring cells differ in few bits, mix them before picking a shard
+inline size_t ShardOf(uint64_t key, size_t num_shards){
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return key % num_shards;
+}
+
+//bytes per pixel of a color image and where its red, green and blue bytes are
+struct ChannelOrder{
+    int channels;
+    int rgb[3];
+
+    explicit ChannelOrder(ImageFormat format){
+        bool bgr = format == BGR || format == BGRA;
+        channels = format == RGBA || format == BGRA ? 4 : 3;
+        rgb[0] = bgr ? 2 : 0;
+        rgb[1] = 1;
+        rgb[2] = bgr ? 0 : 2;
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,222 @@
+#include "DRViewer.h"
+#include "thread_pool.h"
+#include "grid_utils.h"
+
+#include <vector>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#if defined(__SSE4_1__)
+#include <smmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace visual_utils {
+
+namespace {
+
+//interpolation weights are fixed point with this many fractional bits in each direction, a
+//vertically blended channel then stays below 2^15 and fits the 16-bit lanes of pmaddwd
+constexpr int kWeightBits = 7;
+constexpr int kWeightOne = 1 << kWeightBits;
+constexpr int kRound = 1 << (2 * kWeightBits - 1);
+//a 16-byte load at the left neighbor of the last column reads past the blended row
+constexpr size_t kRowPadding = 8;
+
+//source of every output column, built once per pair of widths: the left neighbor's offset
+//into a row of 16-bit channels and (1 - w, w) repeated for 4 channels, so a pixel's weights
+//load as one vector and those of 2 adjacent columns as one AVX2 vector
+struct ColumnTable{
+    int raw_width = 0, width = 0, channels = 0;
+    float factor = 0;
+    std::vector<int> offsets;
+    std::vector<int16_t> weights;
+
+    void Build(int _raw_width, int _width, int _channels, float _factor){
+        raw_width = _raw_width;
+        width = _width;
+        channels = _channels;
+        factor = _factor;
+        offsets.resize(width);
+        weights.resize((size_t)width * 8);
+        for(int x = 0; x < width; x++){
+            float px = factor * x;
+            int ix = (int)px;
+            int w = (int)std::lround((px - ix) * kWeightOne);
+            if(w == kWeightOne){
+                ix++;
+                w = 0;
+            }
+            //keep the right neighbor inside the row
+            if(ix >= raw_width - 1){
+                ix = std::max(raw_width - 2, 0);
+                w = raw_width > 1 ? kWeightOne : 0;
+            }
+            offsets[x] = ix * channels;
+            for(int k = 0; k < 4; k++){
+                weights[x * 8 + 2 * k] = int16_t(kWeightOne - w);
+                weights[x * 8 + 2 * k + 1] = int16_t(w);
+            }
+        }
+    }
+};
+
+//blend rows top and bottom into 16-bit channels, top * (1 - w) + bottom * w
+void BlendRows(const byte* top, const byte* bottom, int w, size_t n, int16_t* out){
+    size_t i = 0;
+#if defined(__AVX2__)
+    {
+        const __m256i weight = _mm256_set1_epi16((int16_t)w);
+        for(; i + 16 <= n; i += 16){
+            __m256i t = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(top + i)));
+            __m256i b = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(bottom + i)));
+            __m256i v = _mm256_add_epi16(_mm256_slli_epi16(t, kWeightBits),
+                                         _mm256_mullo_epi16(_mm256_sub_epi16(b, t), weight));
+            _mm256_storeu_si256((__m256i*)(out + i), v);
+        }
+    }
+#endif
+#if defined(__SSE4_1__)
+    {
+        const __m128i weight = _mm_set1_epi16((int16_t)w);
+        for(; i + 8 <= n; i += 8){
+            __m128i t = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(top + i)));
+            __m128i b = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(bottom + i)));
+            __m128i v = _mm_add_epi16(_mm_slli_epi16(t, kWeightBits),
+                                      _mm_mullo_epi16(_mm_sub_epi16(b, t), weight));
+            _mm_storeu_si128((__m128i*)(out + i), v);
+        }
+    }
+#endif
+    for(; i < n; i++)
+        out[i] = int16_t((top[i] << kWeightBits) + (bottom[i] - top[i]) * w);
+}
+
+//blend neighbors of every output column of a vertically blended row
+void BlendColumns(const int16_t* row, const ColumnTable& table, byte* out){
+    const int channels = table.channels;
+    const int* offsets = table.offsets.data();
+    const int16_t* weights = table.weights.data();
+    int x = 0;
+#if defined(__SSE4_1__)
+    //bytes of the 16-bit channels of the left and right neighbors are interleaved into
+    //(left, right) pairs for pmaddwd, for 3 channels the fourth pair is zero; packed output
+    //pixels of 3 channels drop the fourth byte
+    const __m128i pairs = channels == 4 ?
+        _mm_setr_epi8(0, 1, 8, 9, 2, 3, 10, 11, 4, 5, 12, 13, 6, 7, 14, 15) :
+        _mm_setr_epi8(0, 1, 6, 7, 2, 3, 8, 9, 4, 5, 10, 11, -1, -1, -1, -1);
+    const __m128i compact = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+#endif
+#if defined(__AVX2__)
+    {
+        const __m256i pairs2 = _mm256_broadcastsi128_si256(pairs);
+        const __m256i compact2 = _mm256_broadcastsi128_si256(compact);
+        const __m256i round = _mm256_set1_epi32(kRound);
+        const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+        for(; x + 8 <= table.width; x += 8){
+            //lanes hold columns x + 2k and x + 2k + 1
+            __m256i r[4];
+            for(int k = 0; k < 4; k++){
+                int c = x + 2 * k;
+                __m256i v = _mm256_inserti128_si256(
+                            _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(row + offsets[c]))),
+                            _mm_loadu_si128((const __m128i*)(row + offsets[c + 1])), 1);
+                v = _mm256_madd_epi16(_mm256_shuffle_epi8(v, pairs2),
+                                      _mm256_loadu_si256((const __m256i*)(weights + c * 8)));
+                r[k] = _mm256_srai_epi32(_mm256_add_epi32(v, round), 2 * kWeightBits);
+            }
+            //packing works within lanes, a permutation restores column order
+            __m256i p = _mm256_packus_epi16(_mm256_packs_epi32(r[0], r[1]),
+                                            _mm256_packs_epi32(r[2], r[3]));
+            p = _mm256_permutevar8x32_epi32(p, order);
+            if(channels == 4){
+                _mm256_storeu_si256((__m256i*)(out + x * 4), p);
+            }else{
+                p = _mm256_shuffle_epi8(p, compact2);
+                __m128i lower = _mm256_castsi256_si128(p), upper = _mm256_extracti128_si256(p, 1);
+                byte* d = out + x * 3;
+                _mm_storel_epi64((__m128i*)d, lower);
+                int32_t tail = _mm_extract_epi32(lower, 2);
+                memcpy(d + 8, &tail, sizeof(tail));
+                _mm_storel_epi64((__m128i*)(d + 12), upper);
+                tail = _mm_extract_epi32(upper, 2);
+                memcpy(d + 20, &tail, sizeof(tail));
+            }
+        }
+    }
+#endif
+#if defined(__SSE4_1__)
+    {
+        const __m128i round = _mm_set1_epi32(kRound);
+        for(; x + 4 <= table.width; x += 4){
+            __m128i r[4];
+            for(int k = 0; k < 4; k++){
+                __m128i v = _mm_loadu_si128((const __m128i*)(row + offsets[x + k]));
+                v = _mm_madd_epi16(_mm_shuffle_epi8(v, pairs),
+                                   _mm_loadu_si128((const __m128i*)(weights + (x + k) * 8)));
+                r[k] = _mm_srai_epi32(_mm_add_epi32(v, round), 2 * kWeightBits);
+            }
+            __m128i p = _mm_packus_epi16(_mm_packs_epi32(r[0], r[1]), _mm_packs_epi32(r[2], r[3]));
+            if(channels == 4){
+                _mm_storeu_si128((__m128i*)(out + x * 4), p);
+            }else{
+                p = _mm_shuffle_epi8(p, compact);
+                byte* d = out + x * 3;
+                _mm_storel_epi64((__m128i*)d, p);
+                int32_t tail = _mm_extract_epi32(p, 2);
+                memcpy(d + 8, &tail, sizeof(tail));
+            }
+        }
+    }
+#endif
+    for(; x < table.width; x++){
+        const int16_t* left = row + offsets[x];
+        int wl = weights[x * 8], wr = weights[x * 8 + 1];
+        for(int c = 0; c < channels; c++)
+            out[x * channels + c] = byte((left[c] * wl + left[channels + c] * wr + kRound)
+                                         >> (2 * kWeightBits));
+    }
+}
+
+}
+
+void ResizeImage(const byte* src, int raw_width, int raw_height, int channels,
+                 byte* dst, int width, int height){
+    if(src == nullptr || dst == nullptr || raw_width <= 0 || raw_height <= 0 || width <= 0 ||
+       height <= 0 || (channels != 3 && channels != 4))
+        return;
+    const float factor = (float)raw_width / width;
+    //streams keep their sizes, so the tables of the last pair of widths are reused
+    thread_local ColumnTable table;
+    if(table.raw_width != raw_width || table.width != width || table.channels != channels ||
+       table.factor != factor)
+        table.Build(raw_width, width, channels, factor);
+    const ColumnTable& columns = table;
+    const size_t raw_stride = (size_t)raw_width * channels;
+
+    //bands of rows are resized in parallel, each worker blends rows into its own buffer
+    ThreadPool::Global().ParallelFor(0, height, kRowGrain, [&](size_t begin, size_t end){
+        thread_local std::vector<int16_t> row;
+        row.resize(raw_stride + kRowPadding);
+        for(size_t y = begin; y < end; y++){
+            float py = factor * y;
+            int iy = (int)py;
+            int w = (int)std::lround((py - iy) * kWeightOne);
+            if(w == kWeightOne){
+                iy++;
+                w = 0;
+            }
+            if(iy >= raw_height - 1){
+                iy = raw_height - 1;
+                w = 0;
+            }
+            int iy1 = std::min(iy + 1, raw_height - 1);
+            BlendRows(src + iy * raw_stride, src + iy1 * raw_stride, w, raw_stride, row.data());
+            BlendColumns(row.data(), columns, dst + y * width * channels);
+        }
+    });
+}
+
+}
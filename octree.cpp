@@ -0,0 +1,175 @@
+#include "octree.h"
+
+#include <queue>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <string.h>
+
+namespace visual_utils {
+
+namespace {
+
+constexpr float kInitialHalfSize = 8.0f;
+constexpr float kMinHalfSize = 0.01f;  //nodes this small accept points without splitting
+constexpr float kMinCellPixels = 1.0f;
+
+//node versions are drawn from one counter for all octrees, so that nodes of different octrees
+//or of one octree before and after Clear never share a version
+std::atomic<size_t> version_counter(0);
+
+inline int Octant(const glm::vec3& p, const glm::vec3& center){
+    return (p.x >= center.x ? 1 : 0) | (p.y >= center.y ? 2 : 0) | (p.z >= center.z ? 4 : 0);
+}
+
+inline AABB OctantBox(const AABB& box, int octant){
+    glm::vec3 center = box.Center();
+    AABB child = box;
+    for(int k = 0; k < 3; k++){
+        if(octant & (1 << k)) child.lower[k] = center[k];
+        else child.upper[k] = center[k];
+    }
+    return child;
+}
+
+}
+
+int PointOctree::CreateNode(const AABB& box){
+    Node node;
+    node.box = box;
+    node.version = ++version_counter;
+    std::fill(node.children, node.children + 8, -1);
+    node.occupied.assign(kGridSize * kGridSize * kGridSize / 32, 0);
+    nodes_.push_back(std::move(node));
+    return (int)nodes_.size() - 1;
+}
+
+//double the root towards p until p is inside, the old root becomes an octant of the new one
+void PointOctree::GrowRoot(const glm::vec3& p){
+    while(!nodes_[root_].box.Contains(p)){
+        AABB box = nodes_[root_].box;
+        glm::vec3 size = box.Extent();
+        glm::vec3 center = box.Center();
+        AABB grown;
+        for(int k = 0; k < 3; k++){
+            if(p[k] >= center[k]){
+                grown.lower[k] = box.lower[k];
+                grown.upper[k] = box.upper[k] + size[k];
+            }else{
+                grown.lower[k] = box.lower[k] - size[k];
+                grown.upper[k] = box.upper[k];
+            }
+        }
+        int old_root = root_;
+        root_ = CreateNode(grown);
+        nodes_[root_].children[Octant(center, grown.Center())] = old_root;
+    }
+}
+
+void PointOctree::InsertPoint(const float* pos, const float* col){
+    glm::vec3 p(pos[0], pos[1], pos[2]);
+    //an infinite coordinate would grow the root until its extent overflows
+    if(!(std::isfinite(p.x) && std::isfinite(p.y) && std::isfinite(p.z)))
+        return;
+    if(root_ < 0)
+        root_ = CreateNode(AABB(p - glm::vec3(kInitialHalfSize), p + glm::vec3(kInitialHalfSize)));
+    GrowRoot(p);
+
+    int id = root_;
+    while(true){
+        Node& node = nodes_[id];
+        glm::vec3 rel = (p - node.box.lower) / node.box.Extent() * (float)kGridSize;
+        int cx = std::min(std::max((int)rel.x, 0), kGridSize - 1);
+        int cy = std::min(std::max((int)rel.y, 0), kGridSize - 1);
+        int cz = std::min(std::max((int)rel.z, 0), kGridSize - 1);
+        int cell = (cz * kGridSize + cy) * kGridSize + cx;
+        uint32_t& word = node.occupied[cell >> 5];
+        uint32_t bit = 1u << (cell & 31);
+        if(!(word & bit) || node.box.Extent().x * 0.5f < kMinHalfSize){
+            word |= bit;
+            node.vertices.insert(node.vertices.end(), pos, pos + 3);
+            node.vertices.insert(node.vertices.end(), col, col + 3);
+            node.version = ++version_counter;
+            return;
+        }
+        int octant = Octant(p, node.box.Center());
+        int child = node.children[octant];
+        if(child < 0){
+            AABB box = OctantBox(node.box, octant);
+            child = CreateNode(box); //invalidates node
+            nodes_[id].children[octant] = child;
+        }
+        id = child;
+    }
+}
+
+void PointOctree::Insert(const void* data, size_t num_vertices, int stride, int pos_off, int col_off){
+    const unsigned char* src = static_cast<const unsigned char*>(data);
+    float pos[3], col[3];
+    for(size_t i = 0; i < num_vertices; i++, src += stride){
+        memcpy(pos, src + pos_off, sizeof(pos));
+        memcpy(col, src + col_off, sizeof(col));
+        InsertPoint(pos, col);
+    }
+    num_vertices_ += num_vertices;
+}
+
+void PointOctree::Clear(){
+    nodes_.clear();
+    root_ = -1;
+    num_vertices_ = 0;
+}
+
+void PointOctree::CopyChanged(const PointOctree& rhs){
+    nodes_.resize(rhs.nodes_.size());
+    for(size_t i = 0; i < nodes_.size(); i++){
+        const Node& node = rhs.nodes_[i];
+        if(nodes_[i].version != node.version ||
+           !std::equal(node.children, node.children + 8, nodes_[i].children))
+            nodes_[i] = node;
+    }
+    root_ = rhs.root_;
+    num_vertices_ = rhs.num_vertices_;
+}
+
+void PointOctree::Select(const glm::mat4& model_view, const glm::mat4& projection, int viewport_height,
+                         size_t point_budget, std::vector<int>& nodes) const{
+    nodes.clear();
+    if(root_ < 0)
+        return;
+    Frustum frustum(projection * model_view);
+    const float pixels_per_unit = projection[1][1] * viewport_height * 0.5f;
+    //diameter of the node on screen in pixels
+    auto projected_size = [&](const Node& node){
+        glm::vec3 center = glm::vec3(model_view * glm::vec4(node.box.Center(), 1.0f));
+        float radius = 0.5f * glm::length(node.box.Extent());
+        float distance = std::max(glm::length(center) - radius, 1e-3f);
+        return 2.0f * radius * pixels_per_unit / distance;
+    };
+
+    std::priority_queue<std::pair<float, int>> queue;
+    if(frustum.Intersects(nodes_[root_].box))
+        queue.push(std::make_pair(projected_size(nodes_[root_]), root_));
+    size_t num_selected = 0;
+    while(!queue.empty()){
+        float size = queue.top().first;
+        int id = queue.top().second;
+        queue.pop();
+        const Node& node = nodes_[id];
+        if(num_selected + node.NumVertices() > point_budget)
+            break;
+        if(node.NumVertices() > 0){
+            nodes.push_back(id);
+            num_selected += node.NumVertices();
+        }
+        if(size / kGridSize < kMinCellPixels)
+            continue;
+        for(int i = 0; i < 8; i++){
+            int child = node.children[i];
+            if(child >= 0 && frustum.Intersects(nodes_[child].box))
+                queue.push(std::make_pair(projected_size(nodes_[child]), child));
+        }
+    }
+}
+
+}
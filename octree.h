@@ -0,0 +1,58 @@
+#ifndef OCTREE_H
+#define OCTREE_H
+
+#include "geometry.h"
+
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+namespace visual_utils {
+
+//incrementally built octree for level-of-detail rendering of large point clouds.
+//every node keeps at most one point per cell of a kGridSize^3 grid spread over its cube,
+//points hitting an occupied cell are passed down to children, so each node holds an evenly
+//subsampled representation of everything below it and the nodes drawn for a view never
+//duplicate a point.
+class PointOctree{
+public:
+    static constexpr int kGridSize = 32;
+
+    struct Node{
+        AABB box;                       //cube
+        int children[8];                //-1 if absent
+        std::vector<float> vertices;    //|x y z r g b|
+        std::vector<uint32_t> occupied; //bitset over grid cells
+        size_t version = 0;             //changes whenever vertices change, unique among octrees
+
+        size_t NumVertices() const { return vertices.size() / 6; }
+    };
+
+    //input layout is the same as DRViewer::BindPoinCloudData
+    void Insert(const void* data, size_t num_vertices, int stride, int pos_off, int col_off);
+    void Clear();
+    //make this a copy of rhs, copying only nodes whose version or children differ; cheap
+    //when this was a copy of rhs before rhs had points inserted
+    void CopyChanged(const PointOctree& rhs);
+
+    //pick nodes visible under model_view/projection by descending projected size until
+    //point_budget is exhausted, nodes whose grid cells are smaller than a pixel are not refined
+    void Select(const glm::mat4& model_view, const glm::mat4& projection, int viewport_height,
+                size_t point_budget, std::vector<int>& nodes) const;
+
+    const Node& GetNode(int i) const { return nodes_[i]; }
+    size_t NumNodes() const { return nodes_.size(); }
+    size_t NumVertices() const { return num_vertices_; }
+
+private:
+    std::vector<Node> nodes_;
+    int root_ = -1;
+    size_t num_vertices_ = 0;
+
+    int CreateNode(const AABB& box);
+    void GrowRoot(const glm::vec3& p);
+    void InsertPoint(const float* pos, const float* col);
+};
+
+}
+#endif // OCTREE_H
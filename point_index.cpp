@@ -0,0 +1,501 @@
+#include "point_index.h"
+#include "thread_pool.h"
+#include "grid_utils.h"
+
+#include <cmath>
+#include <algorithm>
+#include <queue>
+#include <mutex>
+#include <string.h>
+
+namespace visual_utils {
+
+namespace {
+
+constexpr size_t kInsertGrain = 16384;
+//a scanned surface spanning the largest extent of the indexed vertices gets about this many
+//vertices per cell, volumes get fewer
+constexpr float kVerticesPerCell = 16.0f;
+//the extent is judged from this many vertices, leaving out this fraction of them on both
+//ends of every axis, so that a few stray vertices don't blow up the cells
+constexpr size_t kExtentSamples = 4096;
+constexpr float kOutlierFraction = 0.01f;
+constexpr float kMinCellSize = 1e-4f;
+constexpr float kRegridRatio = 2.0f;  //cells are rebuilt once their size is off by this factor
+//cell coordinates of vertices stay this far inside the key range, so that neighbors of
+//their cells and of cells a picking ray is clipped to have keys of their own
+constexpr int64_t kKeyMargin = 4;
+constexpr int kBlockBits = 3;   //blocks group 8^3 cells
+constexpr uint64_t kNoKey = ~uint64_t(0);  //of non-finite positions, never a cell key
+
+//cell coordinate of x, clamped to the key range, so far coordinates of queries neither
+//overflow nor wrap around to keys of other cells
+inline int64_t CellOf(float x, float inv_size){
+    float c = std::floor(x * inv_size);
+    if(!(c >= (float)kMinKeyCoord))
+        return kMinKeyCoord;
+    return c > (float)kMaxKeyCoord ? kMaxKeyCoord : (int64_t)c;
+}
+
+//floor division of cell coordinates, blocks have keys of their own coordinates
+inline int64_t BlockOf(int64_t cell){
+    return cell >= 0 ? cell >> kBlockBits : -((-cell - 1) >> kBlockBits) - 1;
+}
+
+//squared distance from p to the box of cells [lower, lower + size) along every axis
+inline float DistanceSquared(const glm::vec3& p, const int64_t* lower, float size, float cell){
+    float d2 = 0.0f;
+    for(int k = 0; k < 3; k++){
+        float lo = lower[k] * cell, hi = lo + size;
+        float d = p[k] < lo ? lo - p[k] : (p[k] > hi ? p[k] - hi : 0.0f);
+        d2 += d * d;
+    }
+    return d2;
+}
+
+//group items by the shard of their key and sort each group, offsets gets the bounds of
+//the groups in items
+template<typename T>
+void BucketByShard(std::vector<std::pair<uint64_t, T>>& items, size_t num_shards,
+                   std::vector<size_t>& offsets){
+    offsets.assign(num_shards + 1, 0);
+    for(const auto& item : items)
+        offsets[ShardOf(item.first, num_shards) + 1]++;
+    for(size_t s = 0; s < num_shards; s++)
+        offsets[s + 1] += offsets[s];
+    std::vector<std::pair<uint64_t, T>> bucketed(items.size());
+    std::vector<size_t> cursor(offsets.begin(), offsets.end() - 1);
+    for(const auto& item : items)
+        bucketed[cursor[ShardOf(item.first, num_shards)]++] = item;
+    items.swap(bucketed);
+    ThreadPool::Global().ParallelFor(0, num_shards, 1, [&](size_t begin, size_t end){
+        for(size_t s = begin; s < end; s++)
+            std::sort(items.begin() + offsets[s], items.begin() + offsets[s + 1]);
+    });
+}
+
+inline glm::vec3 Position(const unsigned char* src, size_t i, int stride, int pos_off){
+    glm::vec3 p;
+    memcpy(&p[0], src + i * stride + pos_off, sizeof(p));
+    return p;
+}
+
+inline bool Finite(const glm::vec3& p){
+    return std::isfinite(p.x) && std::isfinite(p.y) && std::isfinite(p.z);
+}
+
+//largest extent of the bulk of num_vertices vertices along an axis
+float BulkExtent(const unsigned char* src, size_t num_vertices, int stride, int pos_off){
+    std::vector<float> axes[3];
+    size_t step = std::max<size_t>(num_vertices / kExtentSamples, 1);
+    for(size_t i = 0; i < num_vertices; i += step){
+        glm::vec3 p = Position(src, i, stride, pos_off);
+        for(int k = 0; Finite(p) && k < 3; k++)
+            axes[k].push_back(p[k]);
+    }
+    float extent = 0.0f;
+    for(std::vector<float>& axis : axes){
+        if(axis.empty())
+            break;
+        size_t lo = (size_t)(axis.size() * kOutlierFraction), hi = axis.size() - 1 - lo;
+        std::nth_element(axis.begin(), axis.begin() + lo, axis.end());
+        float lower = axis[lo];
+        std::nth_element(axis.begin(), axis.begin() + hi, axis.end());
+        extent = std::max(extent, axis[hi] - lower);
+    }
+    return extent;
+}
+
+}
+
+void PointIndex::Clear(){
+    for(auto& shard : shards_){
+        shard.cells.clear();
+        shard.blocks.clear();
+    }
+    cell_size_ = 0.0f;
+    bounds_ = AABB();
+    num_vertices_ = 0;
+    num_blocks_ = 0;
+}
+
+void PointIndex::Insert(const void* data, size_t num_vertices, int stride, int pos_off){
+    if(data == nullptr || num_vertices <= num_vertices_)
+        return;
+    const unsigned char* src = static_cast<const unsigned char*>(data);
+    size_t first = num_vertices_;
+    std::mutex bounds_mtx;
+    AABB box = bounds_;
+    ThreadPool::Global().ParallelFor(first, num_vertices, kInsertGrain, [&](size_t begin, size_t end){
+        AABB local;
+        for(size_t i = begin; i < end; i++){
+            glm::vec3 p = Position(src, i, stride, pos_off);
+            if(Finite(p))
+                local.Extend(p);
+        }
+        std::lock_guard<std::mutex> lck(bounds_mtx);
+        box.Extend(local);
+    });
+    num_vertices_ = num_vertices;
+    if(box.Empty())
+        return;
+    bounds_ = box;
+
+    //a surface spanning the bulk of the vertices gets kVerticesPerCell vertices per cell,
+    //unless the cells have to be larger to keep coordinates inside the key range
+    float size = BulkExtent(src, num_vertices, stride, pos_off);
+    float reach = 0.0f;
+    for(int k = 0; k < 3; k++)
+        reach = std::max(reach, std::max(std::fabs(box.lower[k]), std::fabs(box.upper[k])));
+    const float least = reach / (float)(kMaxKeyCoord - kKeyMargin);
+    size = std::max(std::max(size * std::sqrt(kVerticesPerCell / num_vertices), kMinCellSize), least);
+    if(cell_size_ < least || cell_size_ * kRegridRatio < size || cell_size_ > size * kRegridRatio){
+        for(auto& shard : shards_){
+            shard.cells.clear();
+            shard.blocks.clear();
+        }
+        cell_size_ = size;
+        first = 0;
+    }
+    Fill(src, first, num_vertices, stride, pos_off);
+}
+
+void PointIndex::Fill(const unsigned char* src, size_t first, size_t last, int stride, int pos_off){
+    ThreadPool& pool = ThreadPool::Global();
+    const float inv_size = 1.0f / cell_size_;
+    std::vector<std::pair<uint64_t, uint32_t>> items(last - first);
+    pool.ParallelFor(0, items.size(), kInsertGrain, [&](size_t begin, size_t end){
+        for(size_t i = begin; i < end; i++){
+            glm::vec3 p = Position(src, first + i, stride, pos_off);
+            uint64_t key = kNoKey;
+            if(Finite(p))
+                key = PackKey(CellOf(p.x, inv_size), CellOf(p.y, inv_size), CellOf(p.z, inv_size));
+            items[i] = std::make_pair(key, (uint32_t)(first + i));
+        }
+    });
+    items.erase(std::remove_if(items.begin(), items.end(), [](const std::pair<uint64_t, uint32_t>& item){
+        return item.first == kNoKey;
+    }), items.end());
+
+    //every shard is filled by one task, cells opened here are then added to their blocks,
+    //which may live in other shards
+    std::vector<size_t> offsets;
+    BucketByShard(items, kNumShards, offsets);
+    std::vector<std::vector<std::pair<uint64_t, uint64_t>>> fresh(kNumShards);
+    pool.ParallelFor(0, kNumShards, 1, [&](size_t begin, size_t end){
+        for(size_t s = begin; s < end; s++){
+            auto& cells = shards_[s].cells;
+            for(size_t i = offsets[s]; i < offsets[s + 1];){
+                uint64_t key = items[i].first;
+                std::vector<uint32_t>& cell = cells[key];
+                if(cell.empty()){
+                    int64_t c[3];
+                    UnpackKey(key, c);
+                    fresh[s].emplace_back(PackKey(BlockOf(c[0]), BlockOf(c[1]), BlockOf(c[2])), key);
+                }
+                for(; i < offsets[s + 1] && items[i].first == key; i++)
+                    cell.push_back(items[i].second);
+            }
+        }
+    });
+    std::vector<std::pair<uint64_t, uint64_t>> opened;
+    for(auto& list : fresh)
+        opened.insert(opened.end(), list.begin(), list.end());
+    BucketByShard(opened, kNumShards, offsets);
+    pool.ParallelFor(0, kNumShards, 1, [&](size_t begin, size_t end){
+        for(size_t s = begin; s < end; s++){
+            for(size_t i = offsets[s]; i < offsets[s + 1]; i++)
+                shards_[s].blocks[opened[i].first].push_back(opened[i].second);
+        }
+    });
+    num_blocks_ = 0;
+    for(auto& shard : shards_)
+        num_blocks_ += shard.blocks.size();
+}
+
+const std::vector<uint32_t>* PointIndex::Cell(int64_t x, int64_t y, int64_t z) const{
+    uint64_t key = PackKey(x, y, z);
+    const Shard& shard = shards_[ShardOf(key, kNumShards)];
+    auto iter = shard.cells.find(key);
+    return iter == shard.cells.end() ? nullptr : &iter->second;
+}
+
+const std::vector<uint64_t>* PointIndex::Block(int64_t x, int64_t y, int64_t z) const{
+    uint64_t key = PackKey(x, y, z);
+    const Shard& shard = shards_[ShardOf(key, kNumShards)];
+    auto iter = shard.blocks.find(key);
+    return iter == shard.blocks.end() ? nullptr : &iter->second;
+}
+
+void PointIndex::BlockBounds(int64_t* lower, int64_t* upper) const{
+    const float inv_size = 1.0f / cell_size_;
+    for(int k = 0; k < 3; k++){
+        lower[k] = BlockOf(CellOf(bounds_.lower[k], inv_size));
+        upper[k] = BlockOf(CellOf(bounds_.upper[k], inv_size));
+    }
+}
+
+int64_t PointIndex::Pick(const glm::vec3& origin, const glm::vec3& dir, float slope,
+                         const void* data, int stride, int pos_off) const{
+    if(data == nullptr || bounds_.Empty())
+        return -1;
+    const unsigned char* src = static_cast<const unsigned char*>(data);
+    const float cell = cell_size_, inv_size = 1.0f / cell_size_;
+
+    //clip the ray to the bounds grown by a cell, since neighbors of visited cells are searched
+    glm::vec3 lower = bounds_.lower - glm::vec3(cell), upper = bounds_.upper + glm::vec3(cell);
+    float t0 = 0.0f, t1 = std::numeric_limits<float>::max();
+    for(int k = 0; k < 3; k++){
+        if(dir[k] == 0.0f){
+            if(origin[k] < lower[k] || origin[k] > upper[k])
+                return -1;
+            continue;
+        }
+        float a = (lower[k] - origin[k]) / dir[k], b = (upper[k] - origin[k]) / dir[k];
+        t0 = std::max(t0, std::min(a, b));
+        t1 = std::min(t1, std::max(a, b));
+    }
+    if(t0 > t1)
+        return -1;
+
+    //walk cells along the ray(Amanatides and Woo) and search each one's 26 neighbors too
+    glm::vec3 q = origin + dir * t0;
+    int64_t c[3];
+    int step[3];
+    float t_max[3], t_delta[3];
+    for(int k = 0; k < 3; k++){
+        c[k] = CellOf(q[k], inv_size);
+        if(dir[k] > 0.0f){
+            step[k] = 1;
+            t_max[k] = t0 + ((c[k] + 1) * cell - q[k]) / dir[k];
+            t_delta[k] = cell / dir[k];
+        }else if(dir[k] < 0.0f){
+            step[k] = -1;
+            t_max[k] = t0 + (c[k] * cell - q[k]) / dir[k];
+            t_delta[k] = -cell / dir[k];
+        }else{
+            step[k] = 0;
+            t_max[k] = t_delta[k] = std::numeric_limits<float>::max();
+        }
+    }
+
+    int64_t best = -1;
+    float best_t = std::numeric_limits<float>::max();
+    auto visit = [&](int64_t x, int64_t y, int64_t z){
+        const std::vector<uint32_t>* indices = Cell(x, y, z);
+        if(indices == nullptr)
+            return;
+        for(uint32_t i : *indices){
+            glm::vec3 v = Position(src, i, stride, pos_off) - origin;
+            float t = glm::dot(v, dir);
+            if(t <= 0.0f || t >= best_t)
+                continue;
+            float radius = slope * t;
+            if(glm::dot(v, v) - t * t <= radius * radius){
+                best_t = t;
+                best = i;
+            }
+        }
+    };
+    for(int n = 0; n < 27; n++)
+        visit(c[0] + n % 3 - 1, c[1] + n / 3 % 3 - 1, c[2] + n / 9 - 1);
+
+    //vertices around a cell lie at most this far before the ray enters it
+    const float reach = 2.0f * std::sqrt(3.0f) * cell;
+    while(true){
+        int a = t_max[0] < t_max[1] ? (t_max[0] < t_max[2] ? 0 : 2) : (t_max[1] < t_max[2] ? 1 : 2);
+        if(t_max[a] > t1 || t_max[a] - reach > best_t)
+            break;
+        c[a] += step[a];
+        t_max[a] += t_delta[a];
+        //only the slab of neighbors ahead along the stepped axis is new
+        int b = (a + 1) % 3, d = (a + 2) % 3;
+        int64_t n[3];
+        n[a] = c[a] + step[a];
+        for(int i = -1; i <= 1; i++){
+            for(int j = -1; j <= 1; j++){
+                n[b] = c[b] + i;
+                n[d] = c[d] + j;
+                visit(n[0], n[1], n[2]);
+            }
+        }
+    }
+    return best;
+}
+
+void PointIndex::Nearest(const glm::vec3& p, size_t k, const void* data, int stride, int pos_off,
+                         std::vector<uint32_t>& indices) const{
+    indices.clear();
+    if(data == nullptr || k == 0 || bounds_.Empty() || !Finite(p))
+        return;
+    const unsigned char* src = static_cast<const unsigned char*>(data);
+    const float cell = cell_size_, block_size = cell_size_ * (1 << kBlockBits);
+    const float inv_block = 1.0f / block_size;
+    int64_t lower[3], upper[3], b[3];
+    BlockBounds(lower, upper);
+    //vertices beyond ring r of blocks around p's block are at least r * block_size + margin
+    //away; rings closer than the bounds are empty, and so are those beyond them. A p far
+    //outside the bounds starts from the block next to them, which only makes margin 0
+    float margin = block_size;
+    int64_t r = 0, r_max = 0;
+    for(int i = 0; i < 3; i++){
+        float f = std::floor(p[i] * inv_block);
+        b[i] = f < lower[i] - 1 ? lower[i] - 1 : (f > upper[i] + 1 ? upper[i] + 1 : (int64_t)f);
+        margin = std::min(margin, std::min(p[i] - b[i] * block_size, (b[i] + 1) * block_size - p[i]));
+        r = std::max(r, std::max(lower[i] - b[i], b[i] - upper[i]));
+        r_max = std::max(r_max, std::max(b[i] - lower[i], upper[i] - b[i]));
+    }
+    margin = std::max(margin, 0.0f);
+
+    std::priority_queue<std::pair<float, uint32_t>> heap;  //farthest of the best k on top
+    auto visit = [&](const std::vector<uint64_t>& cells){
+        for(uint64_t key : cells){
+            int64_t c[3];
+            UnpackKey(key, c);
+            if(heap.size() == k && DistanceSquared(p, c, cell, cell) >= heap.top().first)
+                continue;
+            for(uint32_t i : *Cell(c[0], c[1], c[2])){
+                glm::vec3 v = Position(src, i, stride, pos_off) - p;
+                float d2 = glm::dot(v, v);
+                if(heap.size() < k)
+                    heap.emplace(d2, i);
+                else if(d2 < heap.top().first){
+                    heap.pop();
+                    heap.emplace(d2, i);
+                }
+            }
+        }
+    };
+    auto visit_block = [&](int64_t x, int64_t y, int64_t z){
+        const std::vector<uint64_t>* cells = Block(x, y, z);
+        if(cells != nullptr)
+            visit(*cells);
+    };
+    //rings are searched while they hold fewer blocks than are occupied, which they stop
+    //doing when the vertices are sparse for the cells(e.g. few vertices far apart)
+    size_t num_looked_up = 0;
+    bool done = false;
+    for(; r <= r_max && !done; r++){
+        size_t side = 2 * r + 1, inner = r == 0 ? 0 : side - 2;
+        size_t num_shell = side * side * side - inner * inner * inner;
+        if(num_looked_up + num_shell > num_blocks_)
+            break;
+        num_looked_up += num_shell;
+        //shell of blocks at Chebyshev distance r, clipped to the bounds
+        for(int64_t z = std::max(b[2] - r, lower[2]); z <= std::min(b[2] + r, upper[2]); z++){
+            for(int64_t y = std::max(b[1] - r, lower[1]); y <= std::min(b[1] + r, upper[1]); y++){
+                if(std::abs(z - b[2]) == r || std::abs(y - b[1]) == r){
+                    for(int64_t x = std::max(b[0] - r, lower[0]); x <= std::min(b[0] + r, upper[0]); x++)
+                        visit_block(x, y, z);
+                    continue;
+                }
+                if(b[0] - r >= lower[0])
+                    visit_block(b[0] - r, y, z);
+                if(b[0] + r <= upper[0])
+                    visit_block(b[0] + r, y, z);
+            }
+        }
+        float bound = r * block_size + margin;
+        done = heap.size() == k && heap.top().first <= bound * bound;
+    }
+
+    //then the occupied blocks beyond the searched rings are visited closest first
+    if(!done && r <= r_max){
+        std::vector<std::pair<float, const std::vector<uint64_t>*>> ranked;
+        for(const Shard& shard : shards_){
+            for(const auto& item : shard.blocks){
+                int64_t c[3];
+                UnpackKey(item.first, c);
+                int64_t d = 0;
+                for(int i = 0; i < 3; i++)
+                    d = std::max(d, std::abs(c[i] - b[i]));
+                if(d >= r)
+                    ranked.emplace_back(DistanceSquared(p, c, block_size, block_size), &item.second);
+            }
+        }
+        std::sort(ranked.begin(), ranked.end(),
+                  [](const std::pair<float, const std::vector<uint64_t>*>& lhs,
+                     const std::pair<float, const std::vector<uint64_t>*>& rhs){
+            return lhs.first < rhs.first;
+        });
+        for(const auto& item : ranked){
+            if(heap.size() == k && item.first >= heap.top().first)
+                break;
+            visit(*item.second);
+        }
+    }
+
+    indices.resize(heap.size());
+    for(size_t i = indices.size(); i-- > 0; heap.pop())
+        indices[i] = heap.top().second;
+}
+
+void PointIndex::QueryBox(const AABB& box, const void* data, int stride, int pos_off,
+                          std::vector<uint32_t>& indices) const{
+    indices.clear();
+    if(data == nullptr || box.Empty() || bounds_.Empty())
+        return;
+    const unsigned char* src = static_cast<const unsigned char*>(data);
+    const float cell = cell_size_, inv_size = 1.0f / cell_size_;
+    int64_t lower[3], upper[3];
+    BlockBounds(lower, upper);
+    double num_covered = 1.0;
+    for(int k = 0; k < 3; k++){
+        lower[k] = std::max(lower[k], BlockOf(CellOf(box.lower[k], inv_size)));
+        upper[k] = std::min(upper[k], BlockOf(CellOf(box.upper[k], inv_size)));
+        if(lower[k] > upper[k])
+            return;
+        num_covered *= upper[k] - lower[k] + 1;
+    }
+
+    //cells inside the box are taken whole, the rest vertex by vertex
+    auto visit = [&](const std::vector<uint64_t>& cells){
+        for(uint64_t key : cells){
+            int64_t c[3];
+            UnpackKey(key, c);
+            bool inner = true, outer = false;
+            for(int k = 0; k < 3; k++){
+                float lo = c[k] * cell, hi = lo + cell;
+                inner = inner && box.lower[k] < lo && hi < box.upper[k];
+                outer = outer || hi < box.lower[k] || box.upper[k] < lo;
+            }
+            if(outer)
+                continue;
+            const std::vector<uint32_t>& cell_indices = *Cell(c[0], c[1], c[2]);
+            if(inner){
+                indices.insert(indices.end(), cell_indices.begin(), cell_indices.end());
+                continue;
+            }
+            for(uint32_t i : cell_indices){
+                if(box.Contains(Position(src, i, stride, pos_off)))
+                    indices.push_back(i);
+            }
+        }
+    };
+    //a large box covers more blocks than are occupied, then walk the occupied ones instead
+    if(num_covered > num_blocks_){
+        for(const Shard& shard : shards_){
+            for(const auto& item : shard.blocks){
+                int64_t coord[3];
+                UnpackKey(item.first, coord);
+                bool inside = true;
+                for(int k = 0; k < 3; k++)
+                    inside = inside && coord[k] >= lower[k] && coord[k] <= upper[k];
+                if(inside)
+                    visit(item.second);
+            }
+        }
+        return;
+    }
+    for(int64_t z = lower[2]; z <= upper[2]; z++){
+        for(int64_t y = lower[1]; y <= upper[1]; y++){
+            for(int64_t x = lower[0]; x <= upper[0]; x++){
+                const std::vector<uint64_t>* cells = Block(x, y, z);
+                if(cells != nullptr)
+                    visit(*cells);
+            }
+        }
+    }
+}
+
+}
@@ -0,0 +1,70 @@
+#ifndef POINT_INDEX_H
+#define POINT_INDEX_H
+
+#include "geometry.h"
+
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+#include <stddef.h>
+
+namespace visual_utils {
+
+//spatial hash over the positions of a vertex array, keeping indices of the vertices falling
+//into every cell and the occupied cells of every block of 8^3 cells, so that searches skip
+//empty space a block at a time. Vertices are only ever appended, so indexing follows ingest
+//of a growing cloud; insertion groups vertices by shard and fills the shards in parallel.
+//The cell size is picked to hold a few vertices of a scanned surface per cell and to keep
+//the cell coordinates of every vertex inside the key range; cells are rebuilt from the
+//indexed array once the size picked for its grown bounds is off by more than a factor of 2.
+//Queries read positions from the indexed array, which must not move them.
+class PointIndex{
+public:
+    PointIndex() : shards_(kNumShards) {}
+
+    //index vertices [NumVertices(), num_vertices) of an array in the layout of
+    //DRViewer::BindPoinCloudData, whose leading vertices are the ones indexed before; they
+    //are read again when the cells are rebuilt
+    void Insert(const void* data, size_t num_vertices, int stride, int pos_off);
+    void Clear();
+
+    //queries take the indexed array, the same pointer as the calls to Insert or a copy
+
+    //vertex closest to origin among those within slope * t of the ray origin + t * dir(dir
+    //has unit length), i.e. within a cone around the ray; -1 if there is none
+    int64_t Pick(const glm::vec3& origin, const glm::vec3& dir, float slope,
+                 const void* data, int stride, int pos_off) const;
+    //up to k vertices nearest to p, closest first
+    void Nearest(const glm::vec3& p, size_t k, const void* data, int stride, int pos_off,
+                 std::vector<uint32_t>& indices) const;
+    //vertices inside box, in no particular order
+    void QueryBox(const AABB& box, const void* data, int stride, int pos_off,
+                  std::vector<uint32_t>& indices) const;
+
+    size_t NumVertices() const { return num_vertices_; }
+    float CellSize() const { return cell_size_; }
+
+private:
+    static constexpr size_t kNumShards = 64;
+
+    struct Shard{
+        std::unordered_map<uint64_t, std::vector<uint32_t>> cells;  //vertex indices
+        std::unordered_map<uint64_t, std::vector<uint64_t>> blocks; //keys of occupied cells
+    };
+
+    float cell_size_ = 0.0f;  //picked by Insert
+    AABB bounds_;             //of indexed vertices
+    std::vector<Shard> shards_;
+    size_t num_vertices_ = 0;
+    size_t num_blocks_ = 0;
+
+    //add vertices [first, last) of an array to the cells, bounds_ must contain them
+    void Fill(const unsigned char* src, size_t first, size_t last, int stride, int pos_off);
+    const std::vector<uint32_t>* Cell(int64_t x, int64_t y, int64_t z) const;
+    const std::vector<uint64_t>* Block(int64_t x, int64_t y, int64_t z) const;
+    //block coordinates of the blocks overlapping bounds_
+    void BlockBounds(int64_t* lower, int64_t* upper) const;
+};
+
+}
+#endif // POINT_INDEX_H
@@ -0,0 +1,180 @@
+#include "surfel_map.h"
+#include "thread_pool.h"
+#include "grid_utils.h"
+
+#include <cmath>
+#include <cstring>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <algorithm>
+
+namespace visual_utils {
+
+namespace {
+
+constexpr size_t kProjectGrain = 16384;
+constexpr uint64_t kEmptyPixel = ~uint64_t(0);
+constexpr float kColorScale = 1.0f / 255.0f;
+//a pixel matches the surfel seen through it when their depths differ by less than this
+//fraction of the measured depth, noise of consumer depth sensors grows with depth
+constexpr float kMatchRatio = 0.02f;
+//confidence falls off with distance from the image center, where lens distortion and
+//depth noise are smallest
+constexpr float kRadialSigma = 0.6f;
+constexpr float kMaxConfidence = 64.0f;
+
+//positive floats order the same as their bits, so the nearest surfel of a pixel is the
+//one with the smallest key; the lower half keeps the surfel index
+inline uint64_t PixelKey(float depth, size_t index){
+    uint32_t bits;
+    memcpy(&bits, &depth, sizeof(bits));
+    return (uint64_t(bits) << 32) | uint64_t(index);
+}
+
+inline float KeyDepth(uint64_t key){
+    uint32_t bits = uint32_t(key >> 32);
+    float depth;
+    memcpy(&depth, &bits, sizeof(depth));
+    return depth;
+}
+
+}
+
+void SurfelMap::Clear(){
+    vertices_.clear();
+    confidences_.clear();
+}
+
+void SurfelMap::Fuse(const uint16_t* depth, const byte* color, ImageFormat color_format,
+                     const CameraIntrinsics& intrinsics, const glm::mat4& pose,
+                     const DepthRange& range, std::vector<std::pair<size_t, size_t>>& updated){
+    if(depth == nullptr || intrinsics.width <= 0 || intrinsics.height <= 0 || range.factor <= 0)
+        return;
+    const size_t width = intrinsics.width, height = intrinsics.height;
+    const size_t num_old = NumVertices();
+    const float scale = 1.0f / range.factor;
+
+    //index map: nearest surfel projecting into every pixel
+    std::unique_ptr<std::atomic<uint64_t>[]> index_map(new std::atomic<uint64_t>[width * height]);
+    ThreadPool& pool = ThreadPool::Global();
+    pool.ParallelFor(0, height, kRowGrain, [&](size_t begin, size_t end){
+        for(size_t i = begin * width; i < end * width; i++)
+            index_map[i].store(kEmptyPixel, std::memory_order_relaxed);
+    });
+    glm::mat4 world_to_camera = glm::inverse(pose);
+    pool.ParallelFor(0, num_old, kProjectGrain, [&](size_t begin, size_t end){
+        for(size_t i = begin; i < end; i++){
+            const float* v = &vertices_[i * 6];
+            glm::vec3 pc = glm::vec3(world_to_camera * glm::vec4(v[0], v[1], v[2], 1.0f));
+            if(pc.z <= 0.0f)
+                continue;
+            int u = (int)std::lround(intrinsics.fx * pc.x / pc.z + intrinsics.cx);
+            int r = (int)std::lround(intrinsics.fy * pc.y / pc.z + intrinsics.cy);
+            if(u < 0 || r < 0 || u >= intrinsics.width || r >= intrinsics.height)
+                continue;
+            uint64_t key = PixelKey(pc.z, i);
+            std::atomic<uint64_t>& pixel = index_map[(size_t)r * width + u];
+            uint64_t current = pixel.load(std::memory_order_relaxed);
+            while(key < current && !pixel.compare_exchange_weak(current, key, std::memory_order_relaxed));
+        }
+    });
+
+    const ChannelOrder order(color_format);
+    float inv_radius2 = 1.0f / (intrinsics.cx * intrinsics.cx + intrinsics.cy * intrinsics.cy);
+
+    //a surfel is kept by at most one pixel of the index map, so rows merge into distinct
+    //surfels and run in parallel; new surfels are collected per row to keep pixel order
+    std::vector<std::vector<float>> fresh(height);
+    std::vector<size_t> pages;
+    std::mutex pages_mtx;
+    pool.ParallelFor(0, height, kRowGrain, [&](size_t begin, size_t end){
+        std::vector<size_t> local_pages;
+        for(size_t y = begin; y < end; y++){
+            float ry = (y - intrinsics.cy) / intrinsics.fy;
+            for(size_t x = 0; x < width; x++){
+                size_t pixel = y * width + x;
+                float d = depth[pixel] * scale;
+                if(d < range.min_depth || d > range.max_depth)
+                    continue;
+                float tolerance = kMatchRatio * d;
+                uint64_t key = index_map[pixel].load(std::memory_order_relaxed);
+                bool matched = key != kEmptyPixel && std::fabs(KeyDepth(key) - d) < tolerance;
+                if(!matched){
+                    //pixels between the surfels of a surface seen from a slightly different
+                    //pose are covered by a neighbor and add nothing
+                    bool covered = false;
+                    for(int dy = -1; dy <= 1 && !covered; dy++){
+                        for(int dx = -1; dx <= 1 && !covered; dx++){
+                            int nx = (int)x + dx, ny = (int)y + dy;
+                            if(nx < 0 || ny < 0 || nx >= intrinsics.width || ny >= intrinsics.height)
+                                continue;
+                            uint64_t k = index_map[(size_t)ny * width + nx].load(std::memory_order_relaxed);
+                            covered = k != kEmptyPixel && std::fabs(KeyDepth(k) - d) < tolerance;
+                        }
+                    }
+                    if(covered)
+                        continue;
+                }
+
+                float rx = (x - intrinsics.cx) / intrinsics.fx;
+                glm::vec3 p = glm::vec3(pose * glm::vec4(d * rx, d * ry, d, 1.0f));
+                float c[3] = {1.0f, 1.0f, 1.0f};
+                if(color != nullptr){
+                    const byte* src = color + pixel * order.channels;
+                    for(int k = 0; k < 3; k++)
+                        c[k] = src[order.rgb[k]] * kColorScale;
+                }
+                float du = x - intrinsics.cx, dv = y - intrinsics.cy;
+                float radial2 = (du * du + dv * dv) * inv_radius2;
+                float confidence = std::exp(-radial2 / (2.0f * kRadialSigma * kRadialSigma));
+
+                if(!matched){
+                    std::vector<float>& row = fresh[y];
+                    row.insert(row.end(), {p.x, p.y, p.z, c[0], c[1], c[2], confidence});
+                    continue;
+                }
+                size_t idx = key & 0xffffffffULL;
+                float* v = &vertices_[idx * 6];
+                float& w = confidences_[idx];
+                float sum = w + confidence;
+                for(int k = 0; k < 3; k++){
+                    v[k] = (v[k] * w + p[k] * confidence) / sum;
+                    v[3 + k] = (v[3 + k] * w + c[k] * confidence) / sum;
+                }
+                w = std::min(sum, kMaxConfidence);
+                size_t page = idx / kPageSize;
+                if(local_pages.empty() || local_pages.back() != page)
+                    local_pages.push_back(page);
+            }
+        }
+        std::lock_guard<std::mutex> lck(pages_mtx);
+        pages.insert(pages.end(), local_pages.begin(), local_pages.end());
+    });
+
+    size_t num_new = 0;
+    for(auto& row : fresh)
+        num_new += row.size() / 7;
+    vertices_.resize((num_old + num_new) * 6);
+    confidences_.resize(num_old + num_new);
+    size_t next = num_old;
+    for(auto& row : fresh){
+        for(size_t i = 0; i < row.size(); i += 7, next++){
+            memcpy(&vertices_[next * 6], &row[i], 6 * sizeof(float));
+            confidences_[next] = row[i + 6];
+        }
+    }
+
+    std::sort(pages.begin(), pages.end());
+    pages.erase(std::unique(pages.begin(), pages.end()), pages.end());
+    for(size_t page : pages){
+        size_t first = page * kPageSize;
+        size_t last = std::min(first + kPageSize, num_old);
+        if(!updated.empty() && updated.back().second == first)
+            updated.back().second = last;
+        else
+            updated.emplace_back(first, last);
+    }
+}
+
+}
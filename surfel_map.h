@@ -0,0 +1,38 @@
+#ifndef SURFEL_MAP_H
+#define SURFEL_MAP_H
+
+#include "DRViewer.h"
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+namespace visual_utils {
+
+//point cloud fused from depth frames. The map is projected into every new frame as an
+//index map, a pixel whose depth agrees with the surfel seen through it moves that surfel
+//towards the measurement weighted by confidence, and only pixels not covered by any surfel
+//add new ones, so revisiting a place refines the map instead of growing it.
+class SurfelMap{
+public:
+    static constexpr size_t kPageSize = 4096; //granularity of reported updates
+
+    //pose is from camera frame to world frame, color is optional; ranges [first, last) of
+    //existing surfels that moved or changed color are appended to updated, new surfels are
+    //always appended behind the existing ones
+    void Fuse(const uint16_t* depth, const byte* color, ImageFormat color_format,
+              const CameraIntrinsics& intrinsics, const glm::mat4& pose, const DepthRange& range,
+              std::vector<std::pair<size_t, size_t>>& updated);
+    void Clear();
+
+    const float* Vertices() const { return vertices_.data(); } //|x y z r g b|
+    size_t NumVertices() const { return confidences_.size(); }
+
+private:
+    std::vector<float> vertices_;
+    std::vector<float> confidences_;
+};
+
+}
+#endif // SURFEL_MAP_H
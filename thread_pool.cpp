@@ -0,0 +1,98 @@
+#include "thread_pool.h"
+
+#include <atomic>
+#include <memory>
+#include <algorithm>
+
+namespace visual_utils {
+
+ThreadPool::ThreadPool(size_t num_threads){
+    for(size_t i = 0; i < num_threads; i++)
+        workers_.emplace_back(&ThreadPool::WorkerLoop, this);
+}
+
+ThreadPool::~ThreadPool(){
+    {
+        std::lock_guard<std::mutex> lck(mtx_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    for(auto& worker : workers_)
+        worker.join();
+}
+
+ThreadPool& ThreadPool::Global(){
+    //the calling thread takes part in ParallelFor, so one worker less than cores
+    static ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+    return pool;
+}
+
+void ThreadPool::WorkerLoop(){
+    while(true){
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lck(mtx_);
+            cv_.wait(lck, [this]{ return stop_ || !tasks_.empty(); });
+            if(stop_ && tasks_.empty())
+                return;
+            task = std::move(tasks_.front());
+            tasks_.pop_front();
+        }
+        task();
+    }
+}
+
+void ThreadPool::Submit(std::function<void()> task){
+    {
+        std::lock_guard<std::mutex> lck(mtx_);
+        tasks_.push_back(std::move(task));
+    }
+    cv_.notify_one();
+}
+
+void ThreadPool::ParallelFor(size_t begin, size_t end, size_t grain,
+                             const std::function<void(size_t, size_t)>& fn){
+    if(end <= begin)
+        return;
+    grain = std::max<size_t>(grain, 1);
+    size_t num_ranges = std::min((end - begin + grain - 1) / grain, workers_.size() + 1);
+    if(num_ranges <= 1){
+        fn(begin, end);
+        return;
+    }
+    size_t step = (end - begin + num_ranges - 1) / num_ranges;
+
+    //ranges are claimed through a shared counter, helpers scheduled after everything is
+    //done find nothing to claim and never touch fn, which may be gone by then
+    struct Job{
+        std::atomic<size_t> next{0};
+        size_t done = 0;
+        std::mutex mtx;
+        std::condition_variable cv;
+    };
+    std::shared_ptr<Job> job = std::make_shared<Job>();
+    const std::function<void(size_t, size_t)>* task = &fn;
+    auto run = [job, task, begin, end, step, num_ranges]{
+        size_t i;
+        while((i = job->next++) < num_ranges){
+            size_t b = begin + i * step;
+            if(b < end)
+                (*task)(b, std::min(b + step, end));
+            std::lock_guard<std::mutex> lck(job->mtx);
+            if(++job->done == num_ranges)
+                job->cv.notify_all();
+        }
+    };
+
+    {
+        std::lock_guard<std::mutex> lck(mtx_);
+        for(size_t i = 1; i < num_ranges; i++)
+            tasks_.push_back(run);
+    }
+    cv_.notify_all();
+    run();
+    std::unique_lock<std::mutex> lck(job->mtx);
+    job->cv.wait(lck, [&]{ return job->done == num_ranges; });
+}
+
+}
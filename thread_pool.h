@@ -0,0 +1,46 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+namespace visual_utils {
+
+//fixed set of worker threads shared by the whole library
+class ThreadPool{
+public:
+    explicit ThreadPool(size_t num_threads);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    //pool sized to the hardware, created on first use
+    static ThreadPool& Global();
+
+    size_t NumThreads() const { return workers_.size(); }
+
+    //split [begin, end) into ranges of at least grain elements and run fn(range_begin, range_end)
+    //on workers and the calling thread, return when all ranges are done; the caller takes part
+    //in the work, so it's safe to call from inside a task
+    void ParallelFor(size_t begin, size_t end, size_t grain,
+                     const std::function<void(size_t, size_t)>& fn);
+
+    //run task asynchronously on a worker
+    void Submit(std::function<void()> task);
+
+private:
+    std::vector<std::thread> workers_;
+    std::deque<std::function<void()>> tasks_;
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    bool stop_ = false;
+
+    void WorkerLoop();
+};
+
+}
+#endif // THREAD_POOL_H
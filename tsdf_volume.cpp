@@ -0,0 +1,479 @@
+#include "tsdf_volume.h"
+#include "thread_pool.h"
+#include "grid_utils.h"
+
+#include <cmath>
+#include <algorithm>
+#include <mutex>
+
+namespace visual_utils {
+
+namespace {
+
+constexpr size_t kBlockGrain = 4;
+constexpr float kMaxWeight = 64.0f;
+//cube corners and edges follow Paul Bourke's "Polygonising a scalar field"
+constexpr int kCorners[8][3] = {{0, 0, 0}, {1, 0, 0}, {1, 1, 0}, {0, 1, 0},
+                                {0, 0, 1}, {1, 0, 1}, {1, 1, 1}, {0, 1, 1}};
+constexpr int kEdges[12][2] = {{0, 1}, {1, 2}, {2, 3}, {3, 0}, {4, 5}, {5, 6},
+                               {6, 7}, {7, 4}, {0, 4}, {1, 5}, {2, 6}, {3, 7}};
+//edges crossed by triangles for every combination of corners inside the surface,
+//terminated by -1
+constexpr int8_t kTriangleTable[256][16] = {
+    {-1},
+    {0, 8, 3, -1},
+    {0, 1, 9, -1},
+    {1, 8, 3, 9, 8, 1, -1},
+    {1, 2, 10, -1},
+    {0, 8, 3, 1, 2, 10, -1},
+    {9, 2, 10, 0, 2, 9, -1},
+    {2, 8, 3, 2, 10, 8, 10, 9, 8, -1},
+    {3, 11, 2, -1},
+    {0, 11, 2, 8, 11, 0, -1},
+    {1, 9, 0, 2, 3, 11, -1},
+    {1, 11, 2, 1, 9, 11, 9, 8, 11, -1},
+    {3, 10, 1, 11, 10, 3, -1},
+    {0, 10, 1, 0, 8, 10, 8, 11, 10, -1},
+    {3, 9, 0, 3, 11, 9, 11, 10, 9, -1},
+    {9, 8, 10, 10, 8, 11, -1},
+    {4, 7, 8, -1},
+    {4, 3, 0, 7, 3, 4, -1},
+    {0, 1, 9, 8, 4, 7, -1},
+    {4, 1, 9, 4, 7, 1, 7, 3, 1, -1},
+    {1, 2, 10, 8, 4, 7, -1},
+    {3, 4, 7, 3, 0, 4, 1, 2, 10, -1},
+    {9, 2, 10, 9, 0, 2, 8, 4, 7, -1},
+    {2, 10, 9, 2, 9, 7, 2, 7, 3, 7, 9, 4, -1},
+    {8, 4, 7, 3, 11, 2, -1},
+    {11, 4, 7, 11, 2, 4, 2, 0, 4, -1},
+    {9, 0, 1, 8, 4, 7, 2, 3, 11, -1},
+    {4, 7, 11, 9, 4, 11, 9, 11, 2, 9, 2, 1, -1},
+    {3, 10, 1, 3, 11, 10, 7, 8, 4, -1},
+    {1, 11, 10, 1, 4, 11, 1, 0, 4, 7, 11, 4, -1},
+    {4, 7, 8, 9, 0, 11, 9, 11, 10, 11, 0, 3, -1},
+    {4, 7, 11, 4, 11, 9, 9, 11, 10, -1},
+    {9, 5, 4, -1},
+    {9, 5, 4, 0, 8, 3, -1},
+    {0, 5, 4, 1, 5, 0, -1},
+    {8, 5, 4, 8, 3, 5, 3, 1, 5, -1},
+    {1, 2, 10, 9, 5, 4, -1},
+    {3, 0, 8, 1, 2, 10, 4, 9, 5, -1},
+    {5, 2, 10, 5, 4, 2, 4, 0, 2, -1},
+    {2, 10, 5, 3, 2, 5, 3, 5, 4, 3, 4, 8, -1},
+    {9, 5, 4, 2, 3, 11, -1},
+    {0, 11, 2, 0, 8, 11, 4, 9, 5, -1},
+    {0, 5, 4, 0, 1, 5, 2, 3, 11, -1},
+    {2, 1, 5, 2, 5, 8, 2, 8, 11, 4, 8, 5, -1},
+    {10, 3, 11, 10, 1, 3, 9, 5, 4, -1},
+    {4, 9, 5, 0, 8, 1, 8, 10, 1, 8, 11, 10, -1},
+    {5, 4, 0, 5, 0, 11, 5, 11, 10, 11, 0, 3, -1},
+    {5, 4, 8, 5, 8, 10, 10, 8, 11, -1},
+    {9, 7, 8, 5, 7, 9, -1},
+    {9, 3, 0, 9, 5, 3, 5, 7, 3, -1},
+    {0, 7, 8, 0, 1, 7, 1, 5, 7, -1},
+    {1, 5, 3, 3, 5, 7, -1},
+    {9, 7, 8, 9, 5, 7, 10, 1, 2, -1},
+    {10, 1, 2, 9, 5, 0, 5, 3, 0, 5, 7, 3, -1},
+    {8, 0, 2, 8, 2, 5, 8, 5, 7, 10, 5, 2, -1},
+    {2, 10, 5, 2, 5, 3, 3, 5, 7, -1},
+    {7, 9, 5, 7, 8, 9, 3, 11, 2, -1},
+    {9, 5, 7, 9, 7, 2, 9, 2, 0, 2, 7, 11, -1},
+    {2, 3, 11, 0, 1, 8, 1, 7, 8, 1, 5, 7, -1},
+    {11, 2, 1, 11, 1, 7, 7, 1, 5, -1},
+    {9, 5, 8, 8, 5, 7, 10, 1, 3, 10, 3, 11, -1},
+    {5, 7, 0, 5, 0, 9, 7, 11, 0, 1, 0, 10, 11, 10, 0, -1},
+    {11, 10, 0, 11, 0, 3, 10, 5, 0, 8, 0, 7, 5, 7, 0, -1},
+    {11, 10, 5, 7, 11, 5, -1},
+    {10, 6, 5, -1},
+    {0, 8, 3, 5, 10, 6, -1},
+    {9, 0, 1, 5, 10, 6, -1},
+    {1, 8, 3, 1, 9, 8, 5, 10, 6, -1},
+    {1, 6, 5, 2, 6, 1, -1},
+    {1, 6, 5, 1, 2, 6, 3, 0, 8, -1},
+    {9, 6, 5, 9, 0, 6, 0, 2, 6, -1},
+    {5, 9, 8, 5, 8, 2, 5, 2, 6, 3, 2, 8, -1},
+    {2, 3, 11, 10, 6, 5, -1},
+    {11, 0, 8, 11, 2, 0, 10, 6, 5, -1},
+    {0, 1, 9, 2, 3, 11, 5, 10, 6, -1},
+    {5, 10, 6, 1, 9, 2, 9, 11, 2, 9, 8, 11, -1},
+    {6, 3, 11, 6, 5, 3, 5, 1, 3, -1},
+    {0, 8, 11, 0, 11, 5, 0, 5, 1, 5, 11, 6, -1},
+    {3, 11, 6, 0, 3, 6, 0, 6, 5, 0, 5, 9, -1},
+    {6, 5, 9, 6, 9, 11, 11, 9, 8, -1},
+    {5, 10, 6, 4, 7, 8, -1},
+    {4, 3, 0, 4, 7, 3, 6, 5, 10, -1},
+    {1, 9, 0, 5, 10, 6, 8, 4, 7, -1},
+    {10, 6, 5, 1, 9, 7, 1, 7, 3, 7, 9, 4, -1},
+    {6, 1, 2, 6, 5, 1, 4, 7, 8, -1},
+    {1, 2, 5, 5, 2, 6, 3, 0, 4, 3, 4, 7, -1},
+    {8, 4, 7, 9, 0, 5, 0, 6, 5, 0, 2, 6, -1},
+    {7, 3, 9, 7, 9, 4, 3, 2, 9, 5, 9, 6, 2, 6, 9, -1},
+    {3, 11, 2, 7, 8, 4, 10, 6, 5, -1},
+    {5, 10, 6, 4, 7, 2, 4, 2, 0, 2, 7, 11, -1},
+    {0, 1, 9, 4, 7, 8, 2, 3, 11, 5, 10, 6, -1},
+    {9, 2, 1, 9, 11, 2, 9, 4, 11, 7, 11, 4, 5, 10, 6, -1},
+    {8, 4, 7, 3, 11, 5, 3, 5, 1, 5, 11, 6, -1},
+    {5, 1, 11, 5, 11, 6, 1, 0, 11, 7, 11, 4, 0, 4, 11, -1},
+    {0, 5, 9, 0, 6, 5, 0, 3, 6, 11, 6, 3, 8, 4, 7, -1},
+    {6, 5, 9, 6, 9, 11, 4, 7, 9, 7, 11, 9, -1},
+    {10, 4, 9, 6, 4, 10, -1},
+    {4, 10, 6, 4, 9, 10, 0, 8, 3, -1},
+    {10, 0, 1, 10, 6, 0, 6, 4, 0, -1},
+    {8, 3, 1, 8, 1, 6, 8, 6, 4, 6, 1, 10, -1},
+    {1, 4, 9, 1, 2, 4, 2, 6, 4, -1},
+    {3, 0, 8, 1, 2, 9, 2, 4, 9, 2, 6, 4, -1},
+    {0, 2, 4, 4, 2, 6, -1},
+    {8, 3, 2, 8, 2, 4, 4, 2, 6, -1},
+    {10, 4, 9, 10, 6, 4, 11, 2, 3, -1},
+    {0, 8, 2, 2, 8, 11, 4, 9, 10, 4, 10, 6, -1},
+    {3, 11, 2, 0, 1, 6, 0, 6, 4, 6, 1, 10, -1},
+    {6, 4, 1, 6, 1, 10, 4, 8, 1, 2, 1, 11, 8, 11, 1, -1},
+    {9, 6, 4, 9, 3, 6, 9, 1, 3, 11, 6, 3, -1},
+    {8, 11, 1, 8, 1, 0, 11, 6, 1, 9, 1, 4, 6, 4, 1, -1},
+    {3, 11, 6, 3, 6, 0, 0, 6, 4, -1},
+    {6, 4, 8, 11, 6, 8, -1},
+    {7, 10, 6, 7, 8, 10, 8, 9, 10, -1},
+    {0, 7, 3, 0, 10, 7, 0, 9, 10, 6, 7, 10, -1},
+    {10, 6, 7, 1, 10, 7, 1, 7, 8, 1, 8, 0, -1},
+    {10, 6, 7, 10, 7, 1, 1, 7, 3, -1},
+    {1, 2, 6, 1, 6, 8, 1, 8, 9, 8, 6, 7, -1},
+    {2, 6, 9, 2, 9, 1, 6, 7, 9, 0, 9, 3, 7, 3, 9, -1},
+    {7, 8, 0, 7, 0, 6, 6, 0, 2, -1},
+    {7, 3, 2, 6, 7, 2, -1},
+    {2, 3, 11, 10, 6, 8, 10, 8, 9, 8, 6, 7, -1},
+    {2, 0, 7, 2, 7, 11, 0, 9, 7, 6, 7, 10, 9, 10, 7, -1},
+    {1, 8, 0, 1, 7, 8, 1, 10, 7, 6, 7, 10, 2, 3, 11, -1},
+    {11, 2, 1, 11, 1, 7, 10, 6, 1, 6, 7, 1, -1},
+    {8, 9, 6, 8, 6, 7, 9, 1, 6, 11, 6, 3, 1, 3, 6, -1},
+    {0, 9, 1, 11, 6, 7, -1},
+    {7, 8, 0, 7, 0, 6, 3, 11, 0, 11, 6, 0, -1},
+    {7, 11, 6, -1},
+    {7, 6, 11, -1},
+    {3, 0, 8, 11, 7, 6, -1},
+    {0, 1, 9, 11, 7, 6, -1},
+    {8, 1, 9, 8, 3, 1, 11, 7, 6, -1},
+    {10, 1, 2, 6, 11, 7, -1},
+    {1, 2, 10, 3, 0, 8, 6, 11, 7, -1},
+    {2, 9, 0, 2, 10, 9, 6, 11, 7, -1},
+    {6, 11, 7, 2, 10, 3, 10, 8, 3, 10, 9, 8, -1},
+    {7, 2, 3, 6, 2, 7, -1},
+    {7, 0, 8, 7, 6, 0, 6, 2, 0, -1},
+    {2, 7, 6, 2, 3, 7, 0, 1, 9, -1},
+    {1, 6, 2, 1, 8, 6, 1, 9, 8, 8, 7, 6, -1},
+    {10, 7, 6, 10, 1, 7, 1, 3, 7, -1},
+    {10, 7, 6, 1, 7, 10, 1, 8, 7, 1, 0, 8, -1},
+    {0, 3, 7, 0, 7, 10, 0, 10, 9, 6, 10, 7, -1},
+    {7, 6, 10, 7, 10, 8, 8, 10, 9, -1},
+    {6, 8, 4, 11, 8, 6, -1},
+    {3, 6, 11, 3, 0, 6, 0, 4, 6, -1},
+    {8, 6, 11, 8, 4, 6, 9, 0, 1, -1},
+    {9, 4, 6, 9, 6, 3, 9, 3, 1, 11, 3, 6, -1},
+    {6, 8, 4, 6, 11, 8, 2, 10, 1, -1},
+    {1, 2, 10, 3, 0, 11, 0, 6, 11, 0, 4, 6, -1},
+    {4, 11, 8, 4, 6, 11, 0, 2, 9, 2, 10, 9, -1},
+    {10, 9, 3, 10, 3, 2, 9, 4, 3, 11, 3, 6, 4, 6, 3, -1},
+    {8, 2, 3, 8, 4, 2, 4, 6, 2, -1},
+    {0, 4, 2, 4, 6, 2, -1},
+    {1, 9, 0, 2, 3, 4, 2, 4, 6, 4, 3, 8, -1},
+    {1, 9, 4, 1, 4, 2, 2, 4, 6, -1},
+    {8, 1, 3, 8, 6, 1, 8, 4, 6, 6, 10, 1, -1},
+    {10, 1, 0, 10, 0, 6, 6, 0, 4, -1},
+    {4, 6, 3, 4, 3, 8, 6, 10, 3, 0, 3, 9, 10, 9, 3, -1},
+    {10, 9, 4, 6, 10, 4, -1},
+    {4, 9, 5, 7, 6, 11, -1},
+    {0, 8, 3, 4, 9, 5, 11, 7, 6, -1},
+    {5, 0, 1, 5, 4, 0, 7, 6, 11, -1},
+    {11, 7, 6, 8, 3, 4, 3, 5, 4, 3, 1, 5, -1},
+    {9, 5, 4, 10, 1, 2, 7, 6, 11, -1},
+    {6, 11, 7, 1, 2, 10, 0, 8, 3, 4, 9, 5, -1},
+    {7, 6, 11, 5, 4, 10, 4, 2, 10, 4, 0, 2, -1},
+    {3, 4, 8, 3, 5, 4, 3, 2, 5, 10, 5, 2, 11, 7, 6, -1},
+    {7, 2, 3, 7, 6, 2, 5, 4, 9, -1},
+    {9, 5, 4, 0, 8, 6, 0, 6, 2, 6, 8, 7, -1},
+    {3, 6, 2, 3, 7, 6, 1, 5, 0, 5, 4, 0, -1},
+    {6, 2, 8, 6, 8, 7, 2, 1, 8, 4, 8, 5, 1, 5, 8, -1},
+    {9, 5, 4, 10, 1, 6, 1, 7, 6, 1, 3, 7, -1},
+    {1, 6, 10, 1, 7, 6, 1, 0, 7, 8, 7, 0, 9, 5, 4, -1},
+    {4, 0, 10, 4, 10, 5, 0, 3, 10, 6, 10, 7, 3, 7, 10, -1},
+    {7, 6, 10, 7, 10, 8, 5, 4, 10, 4, 8, 10, -1},
+    {6, 9, 5, 6, 11, 9, 11, 8, 9, -1},
+    {3, 6, 11, 0, 6, 3, 0, 5, 6, 0, 9, 5, -1},
+    {0, 11, 8, 0, 5, 11, 0, 1, 5, 5, 6, 11, -1},
+    {6, 11, 3, 6, 3, 5, 5, 3, 1, -1},
+    {1, 2, 10, 9, 5, 11, 9, 11, 8, 11, 5, 6, -1},
+    {0, 11, 3, 0, 6, 11, 0, 9, 6, 5, 6, 9, 1, 2, 10, -1},
+    {11, 8, 5, 11, 5, 6, 8, 0, 5, 10, 5, 2, 0, 2, 5, -1},
+    {6, 11, 3, 6, 3, 5, 2, 10, 3, 10, 5, 3, -1},
+    {5, 8, 9, 5, 2, 8, 5, 6, 2, 3, 8, 2, -1},
+    {9, 5, 6, 9, 6, 0, 0, 6, 2, -1},
+    {1, 5, 8, 1, 8, 0, 5, 6, 8, 3, 8, 2, 6, 2, 8, -1},
+    {1, 5, 6, 2, 1, 6, -1},
+    {1, 3, 6, 1, 6, 10, 3, 8, 6, 5, 6, 9, 8, 9, 6, -1},
+    {10, 1, 0, 10, 0, 6, 9, 5, 0, 5, 6, 0, -1},
+    {0, 3, 8, 5, 6, 10, -1},
+    {10, 5, 6, -1},
+    {11, 5, 10, 7, 5, 11, -1},
+    {11, 5, 10, 11, 7, 5, 8, 3, 0, -1},
+    {5, 11, 7, 5, 10, 11, 1, 9, 0, -1},
+    {10, 7, 5, 10, 11, 7, 9, 8, 1, 8, 3, 1, -1},
+    {11, 1, 2, 11, 7, 1, 7, 5, 1, -1},
+    {0, 8, 3, 1, 2, 7, 1, 7, 5, 7, 2, 11, -1},
+    {9, 7, 5, 9, 2, 7, 9, 0, 2, 2, 11, 7, -1},
+    {7, 5, 2, 7, 2, 11, 5, 9, 2, 3, 2, 8, 9, 8, 2, -1},
+    {2, 5, 10, 2, 3, 5, 3, 7, 5, -1},
+    {8, 2, 0, 8, 5, 2, 8, 7, 5, 10, 2, 5, -1},
+    {9, 0, 1, 5, 10, 3, 5, 3, 7, 3, 10, 2, -1},
+    {9, 8, 2, 9, 2, 1, 8, 7, 2, 10, 2, 5, 7, 5, 2, -1},
+    {1, 3, 5, 3, 7, 5, -1},
+    {0, 8, 7, 0, 7, 1, 1, 7, 5, -1},
+    {9, 0, 3, 9, 3, 5, 5, 3, 7, -1},
+    {9, 8, 7, 5, 9, 7, -1},
+    {5, 8, 4, 5, 10, 8, 10, 11, 8, -1},
+    {5, 0, 4, 5, 11, 0, 5, 10, 11, 11, 3, 0, -1},
+    {0, 1, 9, 8, 4, 10, 8, 10, 11, 10, 4, 5, -1},
+    {10, 11, 4, 10, 4, 5, 11, 3, 4, 9, 4, 1, 3, 1, 4, -1},
+    {2, 5, 1, 2, 8, 5, 2, 11, 8, 4, 5, 8, -1},
+    {0, 4, 11, 0, 11, 3, 4, 5, 11, 2, 11, 1, 5, 1, 11, -1},
+    {0, 2, 5, 0, 5, 9, 2, 11, 5, 4, 5, 8, 11, 8, 5, -1},
+    {9, 4, 5, 2, 11, 3, -1},
+    {2, 5, 10, 3, 5, 2, 3, 4, 5, 3, 8, 4, -1},
+    {5, 10, 2, 5, 2, 4, 4, 2, 0, -1},
+    {3, 10, 2, 3, 5, 10, 3, 8, 5, 4, 5, 8, 0, 1, 9, -1},
+    {5, 10, 2, 5, 2, 4, 1, 9, 2, 9, 4, 2, -1},
+    {8, 4, 5, 8, 5, 3, 3, 5, 1, -1},
+    {0, 4, 5, 1, 0, 5, -1},
+    {8, 4, 5, 8, 5, 3, 9, 0, 5, 0, 3, 5, -1},
+    {9, 4, 5, -1},
+    {4, 11, 7, 4, 9, 11, 9, 10, 11, -1},
+    {0, 8, 3, 4, 9, 7, 9, 11, 7, 9, 10, 11, -1},
+    {1, 10, 11, 1, 11, 4, 1, 4, 0, 7, 4, 11, -1},
+    {3, 1, 4, 3, 4, 8, 1, 10, 4, 7, 4, 11, 10, 11, 4, -1},
+    {4, 11, 7, 9, 11, 4, 9, 2, 11, 9, 1, 2, -1},
+    {9, 7, 4, 9, 11, 7, 9, 1, 11, 2, 11, 1, 0, 8, 3, -1},
+    {11, 7, 4, 11, 4, 2, 2, 4, 0, -1},
+    {11, 7, 4, 11, 4, 2, 8, 3, 4, 3, 2, 4, -1},
+    {2, 9, 10, 2, 7, 9, 2, 3, 7, 7, 4, 9, -1},
+    {9, 10, 7, 9, 7, 4, 10, 2, 7, 8, 7, 0, 2, 0, 7, -1},
+    {3, 7, 10, 3, 10, 2, 7, 4, 10, 1, 10, 0, 4, 0, 10, -1},
+    {1, 10, 2, 8, 7, 4, -1},
+    {4, 9, 1, 4, 1, 7, 7, 1, 3, -1},
+    {4, 9, 1, 4, 1, 7, 0, 8, 1, 8, 7, 1, -1},
+    {4, 0, 3, 7, 4, 3, -1},
+    {4, 8, 7, -1},
+    {9, 10, 8, 10, 11, 8, -1},
+    {3, 0, 9, 3, 9, 11, 11, 9, 10, -1},
+    {0, 1, 10, 0, 10, 8, 8, 10, 11, -1},
+    {3, 1, 10, 11, 3, 10, -1},
+    {1, 2, 11, 1, 11, 9, 9, 11, 8, -1},
+    {3, 0, 9, 3, 9, 11, 1, 2, 9, 2, 11, 9, -1},
+    {0, 2, 11, 8, 0, 11, -1},
+    {3, 2, 11, -1},
+    {2, 3, 8, 2, 8, 10, 10, 8, 9, -1},
+    {9, 10, 2, 0, 9, 2, -1},
+    {2, 3, 8, 2, 8, 10, 0, 1, 8, 1, 10, 8, -1},
+    {1, 10, 2, -1},
+    {1, 3, 8, 9, 1, 8, -1},
+    {0, 9, 1, -1},
+    {0, 3, 8, -1},
+    {-1}
+};
+
+}
+
+void TSDFVolume::Reset(float voxel_size, float truncation){
+    blocks_.clear();
+    dirty_.clear();
+    voxel_size_ = voxel_size;
+    truncation_ = truncation;
+}
+
+void TSDFVolume::Integrate(const uint16_t* depth, const byte* color, ImageFormat color_format,
+                           const CameraIntrinsics& intrinsics, const glm::mat4& pose,
+                           const DepthRange& range){
+    if(depth == nullptr || voxel_size_ <= 0.0f || intrinsics.width <= 0 || intrinsics.height <= 0)
+        return;
+    const float scale = 1.0f / range.factor;
+    const float block_length = voxel_size_ * kBlockSize;
+    const float inv_block_length = 1.0f / block_length;
+    const size_t width = intrinsics.width;
+
+    //allocate blocks met by the truncation band around every observed point
+    std::unordered_set<uint64_t> touched;
+    std::mutex touched_mtx;
+    const glm::vec3 origin = glm::vec3(pose * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+    ThreadPool& pool = ThreadPool::Global();
+    pool.ParallelFor(0, intrinsics.height, kRowGrain, [&](size_t begin, size_t end){
+        std::unordered_set<uint64_t> local;
+        uint64_t last = ~uint64_t(0);
+        for(size_t y = begin; y < end; y++){
+            for(size_t x = 0; x < width; x++){
+                float d = depth[y * width + x] * scale;
+                if(d < range.min_depth || d > range.max_depth)
+                    continue;
+                glm::vec3 ray((x - intrinsics.cx) / intrinsics.fx,
+                              (y - intrinsics.cy) / intrinsics.fy, 1.0f);
+                glm::vec3 dir = glm::vec3(pose * glm::vec4(ray, 0.0f));
+                //half a block apart along the ray so no block on it is skipped
+                float step = 0.5f * block_length / glm::length(ray);
+                float near = std::max(d - truncation_, range.min_depth), far = d + truncation_;
+                for(float t = near; t < far + step; t += step){
+                    glm::vec3 p = origin + dir * std::min(t, far);
+                    uint64_t key = PackKey((int64_t)std::floor(p.x * inv_block_length),
+                                           (int64_t)std::floor(p.y * inv_block_length),
+                                           (int64_t)std::floor(p.z * inv_block_length));
+                    //neighboring pixels mostly hit the same blocks
+                    if(key != last)
+                        local.insert(key);
+                    last = key;
+                }
+            }
+        }
+        std::lock_guard<std::mutex> lck(touched_mtx);
+        touched.insert(local.begin(), local.end());
+    });
+
+    std::vector<std::pair<uint64_t, Block*>> blocks;
+    blocks.reserve(touched.size());
+    for(uint64_t key : touched){
+        blocks.emplace_back(key, &blocks_[key]);
+        //cubes of blocks below in any axis reach into this one
+        int64_t coord[3];
+        UnpackKey(key, coord);
+        for(int i = 0; i < 8; i++)
+            dirty_.insert(PackKey(coord[0] - (i & 1), coord[1] - ((i >> 1) & 1),
+                                  coord[2] - ((i >> 2) & 1)));
+    }
+
+    ChannelOrder order(color_format);
+    glm::mat4 world_to_camera = glm::inverse(pose);
+    pool.ParallelFor(0, blocks.size(), kBlockGrain, [&](size_t begin, size_t end){
+        for(size_t i = begin; i < end; i++)
+            IntegrateBlock(blocks[i].first, *blocks[i].second, depth, color, order.channels,
+                           order.rgb, intrinsics, world_to_camera, range);
+    });
+}
+
+void TSDFVolume::IntegrateBlock(uint64_t key, Block& block, const uint16_t* depth,
+                                const byte* color, int channels, const int* rgb,
+                                const CameraIntrinsics& intrinsics,
+                                const glm::mat4& world_to_camera, const DepthRange& range) const{
+    int64_t coord[3];
+    UnpackKey(key, coord);
+    const float scale = 1.0f / range.factor;
+    Voxel* voxel = block.voxels;
+    for(int z = 0; z < kBlockSize; z++){
+        for(int y = 0; y < kBlockSize; y++){
+            for(int x = 0; x < kBlockSize; x++, voxel++){
+                glm::vec3 p = glm::vec3(coord[0] * kBlockSize + x, coord[1] * kBlockSize + y,
+                                        coord[2] * kBlockSize + z) * voxel_size_;
+                glm::vec3 pc = glm::vec3(world_to_camera * glm::vec4(p, 1.0f));
+                if(pc.z <= 0.0f)
+                    continue;
+                int u = (int)std::lround(intrinsics.fx * pc.x / pc.z + intrinsics.cx);
+                int v = (int)std::lround(intrinsics.fy * pc.y / pc.z + intrinsics.cy);
+                if(u < 0 || v < 0 || u >= intrinsics.width || v >= intrinsics.height)
+                    continue;
+                size_t pixel = (size_t)v * intrinsics.width + u;
+                float d = depth[pixel] * scale;
+                if(d < range.min_depth || d > range.max_depth)
+                    continue;
+                //voxels far behind the surface are occluded, leave them unobserved
+                float sdf = d - pc.z;
+                if(sdf < -truncation_)
+                    continue;
+                float tsdf = std::min(1.0f, sdf / truncation_);
+                float w = voxel->weight;
+                voxel->sdf = (voxel->sdf * w + tsdf) / (w + 1.0f);
+                if(color != nullptr){
+                    const byte* c = color + pixel * channels;
+                    for(int k = 0; k < 3; k++)
+                        voxel->color[k] = (byte)((voxel->color[k] * w + c[rgb[k]]) / (w + 1.0f) + 0.5f);
+                }else
+                    voxel->color[0] = voxel->color[1] = voxel->color[2] = 255;
+                voxel->weight = std::min(w + 1.0f, kMaxWeight);
+            }
+        }
+    }
+}
+
+void TSDFVolume::ExtractMeshes(std::vector<std::pair<uint64_t, TriangleMesh>>& meshes){
+    size_t first = meshes.size();
+    for(uint64_t key : dirty_){
+        //an absent block never had a surface
+        if(blocks_.count(key) > 0)
+            meshes.emplace_back(key, TriangleMesh());
+    }
+    dirty_.clear();
+    ThreadPool::Global().ParallelFor(first, meshes.size(), kBlockGrain, [&](size_t begin, size_t end){
+        for(size_t i = begin; i < end; i++)
+            MeshBlock(meshes[i].first, meshes[i].second);
+    });
+}
+
+void TSDFVolume::MeshBlock(uint64_t key, TriangleMesh& mesh) const{
+    constexpr int kSide = kBlockSize + 1;
+    int64_t coord[3];
+    UnpackKey(key, coord);
+    //cubes on the upper faces take corners from the following blocks
+    const Block* blocks[8];
+    for(int i = 0; i < 8; i++){
+        auto iter = blocks_.find(PackKey(coord[0] + (i & 1), coord[1] + ((i >> 1) & 1),
+                                         coord[2] + ((i >> 2) & 1)));
+        blocks[i] = iter == blocks_.end() ? nullptr : &iter->second;
+    }
+    auto voxel_at = [&](int x, int y, int z) -> const Voxel*{
+        const Block* block = blocks[(x / kBlockSize) | ((y / kBlockSize) << 1) | ((z / kBlockSize) << 2)];
+        if(block == nullptr)
+            return nullptr;
+        x %= kBlockSize;
+        y %= kBlockSize;
+        z %= kBlockSize;
+        return &block->voxels[(z * kBlockSize + y) * kBlockSize + x];
+    };
+
+    //vertex on each voxel edge is shared by the up to four cubes around it
+    std::vector<int> edge_vertex(kSide * kSide * kSide * 3, -1);
+    const Voxel* corners[8];
+    for(int z = 0; z < kBlockSize; z++){
+        for(int y = 0; y < kBlockSize; y++){
+            for(int x = 0; x < kBlockSize; x++){
+                int cube = 0;
+                bool observed = true;
+                for(int i = 0; i < 8 && observed; i++){
+                    corners[i] = voxel_at(x + kCorners[i][0], y + kCorners[i][1], z + kCorners[i][2]);
+                    observed = corners[i] != nullptr && corners[i]->weight > 0.0f;
+                    if(observed && corners[i]->sdf < 0.0f)
+                        cube |= 1 << i;
+                }
+                if(!observed || cube == 0 || cube == 255)
+                    continue;
+                for(const int8_t* e = kTriangleTable[cube]; *e >= 0; e++){
+                    const int* a = kCorners[kEdges[*e][0]];
+                    const int* b = kCorners[kEdges[*e][1]];
+                    int axis = a[0] != b[0] ? 0 : (a[1] != b[1] ? 1 : 2);
+                    int lower[3] = {x + std::min(a[0], b[0]), y + std::min(a[1], b[1]),
+                                    z + std::min(a[2], b[2])};
+                    int& index = edge_vertex[((lower[2] * kSide + lower[1]) * kSide + lower[0]) * 3 + axis];
+                    if(index < 0){
+                        const Voxel* va = corners[kEdges[*e][0]];
+                        const Voxel* vb = corners[kEdges[*e][1]];
+                        float t = va->sdf / (va->sdf - vb->sdf);
+                        glm::vec3 pa(coord[0] * kBlockSize + x + a[0], coord[1] * kBlockSize + y + a[1],
+                                     coord[2] * kBlockSize + z + a[2]);
+                        glm::vec3 pb(coord[0] * kBlockSize + x + b[0], coord[1] * kBlockSize + y + b[1],
+                                     coord[2] * kBlockSize + z + b[2]);
+                        glm::vec3 p = (pa + (pb - pa) * t) * voxel_size_;
+                        index = mesh.vertices.size() / 6;
+                        mesh.vertices.insert(mesh.vertices.end(), {p.x, p.y, p.z});
+                        for(int k = 0; k < 3; k++)
+                            mesh.vertices.push_back((va->color[k] + (vb->color[k] - va->color[k]) * t) / 255.0f);
+                        mesh.box.Extend(p);
+                    }
+                    mesh.indices.push_back(index);
+                }
+            }
+        }
+    }
+}
+
+}
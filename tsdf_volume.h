@@ -0,0 +1,70 @@
+#ifndef TSDF_VOLUME_H
+#define TSDF_VOLUME_H
+
+#include "DRViewer.h"
+#include "geometry.h"
+
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <stdint.h>
+#include <stddef.h>
+
+namespace visual_utils {
+
+//indexed triangles in the viewer's default vertex layout
+struct TriangleMesh{
+    std::vector<float> vertices;    //|x y z r g b|
+    std::vector<uint32_t> indices;
+    AABB box;
+    size_t version = 0;
+};
+
+//truncated signed distance field over blocks of kBlockSize^3 voxels, allocated only within
+//the truncation band of observed surfaces so memory grows with surface area. A depth frame
+//is integrated block by block in parallel, and only blocks it touched are remeshed by
+//marching cubes afterwards.
+class TSDFVolume{
+public:
+    static constexpr int kBlockSize = 8;
+
+    explicit TSDFVolume(float voxel_size = 0.0f, float truncation = 0.0f) :
+        voxel_size_(voxel_size), truncation_(truncation) {}
+
+    //drop all blocks and use new parameters, truncation is in meters
+    void Reset(float voxel_size, float truncation);
+    //pose is from camera frame to world frame, color is optional
+    void Integrate(const uint16_t* depth, const byte* color, ImageFormat color_format,
+                   const CameraIntrinsics& intrinsics, const glm::mat4& pose,
+                   const DepthRange& range);
+    //remesh blocks changed since the last call, appending (block key, mesh) pairs; a block
+    //whose surface disappeared gets an empty mesh
+    void ExtractMeshes(std::vector<std::pair<uint64_t, TriangleMesh>>& meshes);
+
+    float VoxelSize() const { return voxel_size_; }
+    size_t NumBlocks() const { return blocks_.size(); }
+
+private:
+    static constexpr int kBlockVolume = kBlockSize * kBlockSize * kBlockSize;
+
+    struct Voxel{
+        float sdf = 1.0f;       //signed distance divided by truncation, clamped to [-1, 1]
+        float weight = 0.0f;    //unobserved when zero
+        byte color[3] = {0, 0, 0};
+    };
+    struct Block{
+        Voxel voxels[kBlockVolume];  //x fastest
+    };
+
+    float voxel_size_, truncation_;
+    std::unordered_map<uint64_t, Block> blocks_;
+    std::unordered_set<uint64_t> dirty_;
+
+    void IntegrateBlock(uint64_t key, Block& block, const uint16_t* depth, const byte* color,
+                        int channels, const int* rgb, const CameraIntrinsics& intrinsics,
+                        const glm::mat4& world_to_camera, const DepthRange& range) const;
+    void MeshBlock(uint64_t key, TriangleMesh& mesh) const;
+};
+
+}
+#endif // TSDF_VOLUME_H
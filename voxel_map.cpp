@@ -0,0 +1,187 @@
+#include "voxel_map.h"
+#include "thread_pool.h"
+#include "grid_utils.h"
+
+#include <cmath>
+#include <algorithm>
+#include <string.h>
+
+namespace visual_utils {
+
+namespace {
+
+constexpr size_t kInsertGrain = 16384;
+inline uint64_t VoxelKey(const float* p, float inv_size){
+    return PackKey((int64_t)std::floor(p[0] * inv_size), (int64_t)std::floor(p[1] * inv_size),
+                   (int64_t)std::floor(p[2] * inv_size));
+}
+
+}
+
+VoxelMap::VoxelMap(const VoxelMap& rhs) : voxel_size_(rhs.voxel_size_),
+    min_neighbors_(rhs.min_neighbors_), shards_(rhs.shards_), vertices_(rhs.vertices_),
+    weights_(rhs.weights_), num_vertices_(rhs.num_vertices_) {
+    shards_.resize(kNumShards);
+}
+
+VoxelMap& VoxelMap::operator=(const VoxelMap& rhs){
+    if(this != &rhs){
+        voxel_size_ = rhs.voxel_size_;
+        min_neighbors_ = rhs.min_neighbors_;
+        //a moved-from map has no shards
+        shards_.resize(kNumShards);
+        for(size_t i = 0; i < kNumShards; i++)
+            shards_[i].voxels = rhs.shards_[i].voxels;
+        vertices_ = rhs.vertices_;
+        weights_ = rhs.weights_;
+        num_vertices_ = rhs.num_vertices_;
+    }
+    return *this;
+}
+
+void VoxelMap::Clear(){
+    for(auto& shard : shards_)
+        shard.voxels.clear();
+    vertices_.clear();
+    weights_.clear();
+    num_vertices_ = 0;
+}
+
+void VoxelMap::Insert(const void* data, size_t num_vertices, int stride, int pos_off, int col_off,
+                      std::vector<std::pair<size_t, size_t>>& updated){
+    if(data == nullptr || num_vertices == 0)
+        return;
+    const size_t num_old = num_vertices_;
+    //room for the worst case of every point opening a voxel, trimmed afterwards
+    vertices_.resize((num_old + num_vertices) * 6);
+    weights_.resize(num_old + num_vertices);
+    std::atomic<size_t> next(num_old);
+    std::vector<size_t> pages;
+    std::mutex pages_mtx;
+
+    const unsigned char* src = static_cast<const unsigned char*>(data);
+    if(voxel_size_ <= 0.0f){
+        float* dst = &vertices_[num_old * 6];
+        for(size_t i = 0; i < num_vertices; i++, src += stride, dst += 6){
+            memcpy(dst, src + pos_off, 3 * sizeof(float));
+            memcpy(dst + 3, src + col_off, 3 * sizeof(float));
+            weights_[num_old + i] = 1;
+        }
+        num_vertices_ += num_vertices;
+        return;
+    }
+
+    const float inv_size = 1.0f / voxel_size_;
+    ThreadPool::Global().ParallelFor(0, num_vertices, kInsertGrain, [&](size_t begin, size_t end){
+        std::vector<size_t> local_pages;
+        for(size_t i = begin; i < end; i++){
+            float pos[3], col[3];
+            memcpy(pos, src + i * stride + pos_off, sizeof(pos));
+            memcpy(col, src + i * stride + col_off, sizeof(col));
+            if(!(std::isfinite(pos[0]) && std::isfinite(pos[1]) && std::isfinite(pos[2])))
+                continue;
+            uint64_t key = VoxelKey(pos, inv_size);
+            Shard& shard = shards_[ShardOf(key, kNumShards)];
+            std::lock_guard<std::mutex> lck(shard.mtx);
+            auto iter = shard.voxels.find(key);
+            if(iter == shard.voxels.end()){
+                size_t idx = next++;
+                shard.voxels.emplace(key, (uint32_t)idx);
+                float* v = &vertices_[idx * 6];
+                memcpy(v, pos, sizeof(pos));
+                memcpy(v + 3, col, sizeof(col));
+                weights_[idx] = 1;
+            }else{
+                size_t idx = iter->second;
+                float* v = &vertices_[idx * 6 + 3];
+                uint32_t& w = weights_[idx];
+                for(int k = 0; k < 3; k++)
+                    v[k] = (v[k] * w + col[k]) / (w + 1);
+                w = std::min(w + 1, kMaxWeight);
+                size_t page = idx / kPageSize;
+                if(idx < num_old && (local_pages.empty() || local_pages.back() != page))
+                    local_pages.push_back(page);
+            }
+        }
+        std::lock_guard<std::mutex> lck(pages_mtx);
+        pages.insert(pages.end(), local_pages.begin(), local_pages.end());
+    });
+
+    num_vertices_ = next;
+    if(min_neighbors_ > 0)
+        RemoveOutliers(num_old);
+    vertices_.resize(num_vertices_ * 6);
+    weights_.resize(num_vertices_);
+
+    std::sort(pages.begin(), pages.end());
+    pages.erase(std::unique(pages.begin(), pages.end()), pages.end());
+    for(size_t page : pages){
+        size_t first = page * kPageSize;
+        size_t last = std::min(first + kPageSize, num_old);
+        if(!updated.empty() && updated.back().second == first)
+            updated.back().second = last;
+        else
+            updated.emplace_back(first, last);
+    }
+}
+
+void VoxelMap::RemoveOutliers(size_t first){
+    const size_t count = num_vertices_ - first;
+    if(count == 0)
+        return;
+    const float inv_size = 1.0f / voxel_size_;
+    ThreadPool& pool = ThreadPool::Global();
+
+    //insertion is over, so shards are only read here and need no locking
+    std::vector<uint8_t> keep(count, 0);
+    pool.ParallelFor(0, count, kInsertGrain, [&](size_t begin, size_t end){
+        for(size_t i = begin; i < end; i++){
+            const float* p = &vertices_[(first + i) * 6];
+            int64_t c[3];
+            for(int k = 0; k < 3; k++)
+                c[k] = (int64_t)std::floor(p[k] * inv_size);
+            int neighbors = 0;
+            for(int n = 0; n < 27 && neighbors < min_neighbors_; n++){
+                if(n == 13)
+                    continue;   //the voxel itself
+                uint64_t key = PackKey(c[0] + n % 3 - 1, c[1] + n / 3 % 3 - 1, c[2] + n / 9 - 1);
+                const Shard& shard = shards_[ShardOf(key, kNumShards)];
+                neighbors += shard.voxels.count(key) > 0;
+            }
+            keep[i] = neighbors >= min_neighbors_;
+        }
+    });
+
+    std::vector<size_t> target(count);
+    size_t num_kept = 0;
+    for(size_t i = 0; i < count; i++){
+        target[i] = num_kept;
+        num_kept += keep[i];
+    }
+    if(num_kept == count)
+        return;
+    //kept vertices are gathered into a copy first, so that moves never overwrite a vertex
+    //another thread has yet to read
+    std::vector<float> vertices(num_kept * 6);
+    std::vector<uint32_t> weights(num_kept);
+    pool.ParallelFor(0, count, kInsertGrain, [&](size_t begin, size_t end){
+        for(size_t i = begin; i < end; i++){
+            const float* v = &vertices_[(first + i) * 6];
+            uint64_t key = VoxelKey(v, inv_size);
+            Shard& shard = shards_[ShardOf(key, kNumShards)];
+            std::lock_guard<std::mutex> lck(shard.mtx);
+            if(!keep[i]){
+                shard.voxels.erase(key);
+                continue;
+            }
+            shard.voxels[key] = (uint32_t)(first + target[i]);
+            memcpy(&vertices[target[i] * 6], v, 6 * sizeof(float));
+            weights[target[i]] = weights_[first + i];
+        }
+    });
+    memcpy(&vertices_[first * 6], vertices.data(), vertices.size() * sizeof(float));
+    memcpy(&weights_[first], weights.data(), weights.size() * sizeof(uint32_t));
+    num_vertices_ = first + num_kept;
+}
+
+}
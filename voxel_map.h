@@ -0,0 +1,66 @@
+#ifndef VOXEL_MAP_H
+#define VOXEL_MAP_H
+
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <stdint.h>
+#include <stddef.h>
+
+namespace visual_utils {
+
+//point cloud keeping one point per voxel, the first point falling into a voxel keeps its
+//position and later ones are averaged into its color. Insertion runs in parallel over a
+//spatial hash split into independently locked shards. With a voxel size of zero every
+//point is kept.
+class VoxelMap{
+public:
+    static constexpr size_t kPageSize = 4096; //granularity of reported color updates
+
+    explicit VoxelMap(float voxel_size = 0.0f) : voxel_size_(voxel_size), shards_(kNumShards) {}
+    VoxelMap(const VoxelMap& rhs);
+    VoxelMap& operator=(const VoxelMap& rhs);
+    VoxelMap(VoxelMap&& rhs) noexcept = default;
+    VoxelMap& operator=(VoxelMap&& rhs) noexcept = default;
+
+    //input layout is the same as DRViewer::BindPoinCloudData; ranges [first, last) of
+    //existing vertices whose color changed are appended to updated, new vertices are
+    //always appended behind the existing ones
+    void Insert(const void* data, size_t num_vertices, int stride, int pos_off, int col_off,
+                std::vector<std::pair<size_t, size_t>>& updated);
+    void Clear();
+    void SetVoxelSize(float voxel_size) { Clear(); voxel_size_ = voxel_size; }
+    //new voxels with fewer occupied voxels than this among their 26 neighbors are isolated
+    //outliers, they are dropped by Insert before joining the vertices; 0 keeps every point
+    void SetMinNeighbors(int min_neighbors) { min_neighbors_ = min_neighbors; }
+
+    float VoxelSize() const { return voxel_size_; }
+    const float* Vertices() const { return vertices_.data(); } //|x y z r g b|
+    size_t NumVertices() const { return num_vertices_; }
+
+private:
+    static constexpr size_t kNumShards = 64;
+    static constexpr uint32_t kMaxWeight = 64;
+
+    struct Shard{
+        std::unordered_map<uint64_t, uint32_t> voxels; //voxel key to vertex index
+        std::mutex mtx;
+
+        Shard() = default;
+        Shard(const Shard& rhs) : voxels(rhs.voxels) {}
+    };
+
+    float voxel_size_;
+    int min_neighbors_ = 0;
+    std::vector<Shard> shards_;
+    std::vector<float> vertices_;
+    std::vector<uint32_t> weights_;
+    size_t num_vertices_ = 0;
+
+    //judge vertices from first on, which are all new, and compact the survivors in place
+    void RemoveOutliers(size_t first);
+};
+
+}
+#endif // VOXEL_MAP_H